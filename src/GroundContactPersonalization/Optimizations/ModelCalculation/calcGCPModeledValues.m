@@ -41,7 +41,8 @@ function modeledValues = calcGCPModeledValues(inputs, values, ...
     modeledJointPositions, modeledJointVelocities, params, task, foot, ...
     models)
 model = models.("model_" + foot);
-if ~isequal(mexext, 'mexw64')
+useMex = hasNativeMexFunctions(inputs.osimVersion);
+if ~useMex
     state = model.initSystem();
 end
 markerNamesFields = fieldnames(inputs.surfaces{foot}.markerNames);
@@ -94,26 +95,34 @@ if ~isempty(intersect(includedCostTypes, "neighbor_spring_constant"))
         length(inputs.springConstants));
 end
 % Calculate modeled values
-if isCalculated(1) && isequal(mexext, 'mexw64')
+if isCalculated(1) && useMex
     [modeledValues.markerPositions, modeledValues.markerVelocities] = ...
         findModeledMarkerCoordinatesMex(inputs.surfaces{foot}, ...
         modeledJointPositions, modeledJointVelocities, ...
         inputs.osimVersion, foot);
 end
-if isCalculated(2) && isequal(mexext, 'mexw64')
+if isCalculated(2) && useMex
     [springPositions, springVelocities] = ...
         findModeledSpringMarkerCoordinatesMex(inputs.surfaces{foot}, ...
         modeledJointPositions, modeledJointVelocities, ...
         inputs.osimVersion, foot);
 end
+% The native contact model evaluates every spring and frame in one call
+useGroundReactionsMex = isCalculated(2) && useMex && ...
+    hasGroundReactionsMex();
+if useGroundReactionsMex
+    modeledValues = calcModeledGroundReactionsMex(inputs, values, ...
+        modeledValues, springPositions, springVelocities, isCalculated, ...
+        foot);
+end
 for i=1:size(modeledJointPositions, 2)
-    if ~isequal(mexext, 'mexw64')
+    if ~useMex
         [model, state] = updateModelPositionAndVelocity(model, state, ...
             modeledJointPositions(:, i), ...
             modeledJointVelocities(:, i), inputs.surfaces{foot});
     end
     % Foot marker positions and velocities
-    if isCalculated(1) && ~isequal(mexext, 'mexw64')
+    if isCalculated(1) && ~useMex
         [modeledValues.markerPositions, ...
             modeledValues.markerVelocities] ...
             = findModeledMarkerCoordinates(model, state, ...
@@ -121,13 +130,13 @@ for i=1:size(modeledJointPositions, 2)
             inputs.surfaces{foot}.markerNames, i);
     end
     % Vertical ground reaction force
-    if isCalculated(2)
+    if isCalculated(2) && ~useGroundReactionsMex
         markerKinematics.height = zeros(size(values.springConstants));
         markerKinematics.yVelocity = zeros(size(values.springConstants));
         springForces = zeros(3, length(values.springConstants));
         % Get position and velocity for each spring marker
         for j = 1:length(values.springConstants)
-            if isequal(mexext, 'mexw64')
+            if useMex
                 markerKinematics.height(j) = springPositions(i, 2, j);
                 markerKinematics.yVelocity(j) = springVelocities(i, 2, j);
             else
@@ -148,11 +157,11 @@ for i=1:size(modeledJointPositions, 2)
             values.restingSpringLength, markerKinematics, springForces);
     end
     % Horizontal ground reaction force
-    if isCalculated(3)
+    if isCalculated(3) && ~useGroundReactionsMex
         markerKinematics.xVelocity = zeros(size(values.springConstants));
         markerKinematics.zVelocity = zeros(size(values.springConstants));
         for j = 1:length(values.springConstants)
-            if isequal(mexext, 'mexw64')
+            if useMex
                 markerKinematics.xVelocity(j) = springVelocities(i, 1, j);
                 markerKinematics.zVelocity(j) = springVelocities(i, 3, j);
             else
@@ -169,11 +178,11 @@ for i=1:size(modeledJointPositions, 2)
             markerKinematics, springForces);
     end
     % Ground reaction moments
-    if isCalculated(4)
+    if isCalculated(4) && ~useGroundReactionsMex
         markerKinematics.xPosition = zeros(size(values.springConstants));
         markerKinematics.zPosition = zeros(size(values.springConstants));
 
-        if isequal(mexext, 'mexw64')
+        if useMex
             inputs.surfaces{foot}.midfootSuperiorPosition(:, i) = ...
                 modeledValues.markerPositions.midfootSuperior(:, i);
         else
@@ -184,7 +193,7 @@ for i=1:size(modeledJointPositions, 2)
         end
 
         for j = 1:length(values.springConstants)
-            if isequal(mexext, 'mexw64')
+            if useMex
                 markerKinematics.xPosition(j) = springPositions(i, 1, j);
                 markerKinematics.zPosition(j) = springPositions(i, 3, j);
             else
@@ -200,6 +209,11 @@ for i=1:size(modeledJointPositions, 2)
     % Calculate marker- and time-specific Gaussian weights for stiffness
     % deviation from neighbors cost. 
     if ~isempty(intersect(includedCostTypes, "neighbor_spring_constant"))
+        if useGroundReactionsMex
+            markerKinematics.xPosition = squeeze(springPositions(i, 1, :))';
+            markerKinematics.height = squeeze(springPositions(i, 2, :))';
+            markerKinematics.zPosition = squeeze(springPositions(i, 3, :))';
+        end
         for j = 1:length(inputs.springConstants)
             for k = j:length(inputs.springConstants)
                 if j ~= k
@@ -222,6 +236,41 @@ for i=1:size(modeledJointPositions, 2)
 end
 end
 
+% Use MEX to calculate the ground reactions of all springs and frames
+function modeledValues = calcModeledGroundReactionsMex(inputs, values, ...
+    modeledValues, springPositions, springVelocities, isCalculated, foot)
+contactSurface.dampingFactor = values.dampingFactor;
+contactSurface.restingSpringLength = values.restingSpringLength;
+contactSurface.dynamicFrictionCoefficient = 0;
+contactSurface.viscousFrictionCoefficient = 0;
+if isCalculated(3)
+    contactSurface.dynamicFrictionCoefficient = ...
+        values.dynamicFrictionCoefficient;
+    contactSurface.viscousFrictionCoefficient = ...
+        values.viscousFrictionCoefficient;
+end
+contactSurface.beltSpeed = inputs.surfaces{foot}.beltSpeed;
+contactSurface.latchingVelocity = inputs.latchingVelocity;
+midfootSuperiorPosition = [];
+if isCalculated(4)
+    midfootSuperiorPosition = ...
+        modeledValues.markerPositions.midfootSuperior';
+end
+[forces, moments] = calcGroundReactionsMex(springPositions, ...
+    springVelocities, values.springConstants, midfootSuperiorPosition, ...
+    contactSurface);
+modeledValues.verticalGrf = forces(:, 2)';
+if isCalculated(3)
+    modeledValues.anteriorGrf = forces(:, 1)';
+    modeledValues.lateralGrf = forces(:, 3)';
+end
+if isCalculated(4)
+    modeledValues.xGrfMoment = moments(:, 1)';
+    modeledValues.yGrfMoment = moments(:, 2)';
+    modeledValues.zGrfMoment = moments(:, 3)';
+end
+end
+
 % Updates model at each time point
 function [model, state] = updateModelPositionAndVelocity(model, state, ...
     jointPositions, jointVelocities, foot)
@@ -52,7 +52,7 @@ writeFullBodyKinematicsFromGcp(inputs, params, resultsDirectory);
 warning('off')
 for pass = 1 : 2
     for i = 1 : length(inputs.surfaces)
-        mexCopy = "pointKinematics" + i + ".mexw64";
+        mexCopy = "pointKinematics" + i + "." + mexext;
         if isfile(mexCopy)
             clear(mexCopy)
             delete(mexCopy)
@@ -109,7 +109,7 @@ surface.model = "footModel_" + surfaceNumber + ".osim";
 taskFootModel.print(surface.model);
 surface.numSpringMarkers = findNumSpringMarkers(surface.model);
 
-if isequal(mexext, 'mexw64')
+if hasNativeMexFunctions()
     locations = [];
     bodies = [];
     for i = 1:length(markerNamesFields)
@@ -236,13 +236,16 @@ end
 mexPath = strjoin(mexPath, '');
 mexPath = fullfile(mexPath, 'src', 'core', 'mex');
 version = getOpenSimVersion();
-if version >= 40501
+if ~isequal(mexext, 'mexw64')
+    mexPath = fullfile(mexPath, "pointKinematicsMexLinux" + version + ...
+        "." + mexext);
+elseif version >= 40501
     mexPath = fullfile(mexPath, 'pointKinematicsMexWindows40501.mexw64');
 else
     mexPath = fullfile(mexPath, 'pointKinematicsMexWindows40400.mexw64');
 end
 warning('off')
-destination = "pointKinematics" + foot + ".mexw64";
+destination = "pointKinematics" + foot + "." + mexext;
 % Needs two attempts to successfully delete a used MEX function
 for pass = 1 : 2
     if isfile(destination)
@@ -28,6 +28,16 @@
 
 function modeledValues = calcMtpModeledValues(values, ...
     experimentalData, params)
+if isfield(experimentalData, 'nativeEmgSplines') && ...
+        isfield(experimentalData, 'muscleTendonLength') && ...
+        isfield(experimentalData, 'muscleTendonVelocity')
+    [modeledValues.muscleExcitations, modeledValues.muscleActivations, ...
+        modeledValues.normalizedFiberLength, ...
+        modeledValues.normalizedFiberVelocity, ...
+        modeledValues.passiveForce, modeledValues.muscleJointMoments] = ...
+        calcMtpModeledValuesMex(experimentalData, values);
+    return
+end
 modeledValues.muscleExcitations = calcMuscleExcitations(experimentalData.emgTime, ...
     experimentalData.emgSplines, values.electromechanicalDelays, ...
     values.emgScaleFactors);
@@ -0,0 +1,60 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function packs the EMG splines of the Muscle Tendon Personalization
+% inputs for calcMtpModeledValuesMex if it is available. The breaks are
+% (pieces + 1) x trials and the coefficients are 4 x pieces x muscles x
+% trials. The splines are left unpacked, and the MATLAB muscle model is
+% used, if they are not cubic or do not share the breaks of their trial.
+%
+% (struct) -> (struct)
+% Adds the packed EMG splines to the inputs
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function inputs = makeNativeEmgSplines(inputs)
+if isfield(inputs, 'nativeEmgSplines')
+    inputs = rmfield(inputs, 'nativeEmgSplines');
+end
+if ~hasMtpModelMex() || ~isfield(inputs, 'emgSplines')
+    return
+end
+[numTrials, numMuscles] = size(inputs.emgSplines);
+numPieces = inputs.emgSplines{1, 1}.pieces;
+breaks = zeros(numPieces + 1, numTrials);
+coefficients = zeros(4, numPieces, numMuscles, numTrials);
+for trial = 1 : numTrials
+    for muscle = 1 : numMuscles
+        [splineBreaks, splineCoefficients, pieces, order, dimension] = ...
+            unmkpp(inputs.emgSplines{trial, muscle});
+        if order ~= 4 || pieces ~= numPieces || prod(dimension) ~= 1 || ...
+                (muscle > 1 && ~isequal(splineBreaks(:), ...
+                breaks(:, trial)))
+            return
+        end
+        breaks(:, trial) = splineBreaks;
+        coefficients(:, :, muscle, trial) = splineCoefficients.';
+    end
+end
+inputs.nativeEmgSplines.breaks = breaks;
+inputs.nativeEmgSplines.coefficients = coefficients;
+end
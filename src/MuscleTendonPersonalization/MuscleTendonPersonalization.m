@@ -131,6 +131,7 @@ end
 end
 
 function inputs = finalizeInputs(inputs, primaryValues, params)
+inputs = makeNativeEmgSplines(inputs);
 values = makeMtpValuesAsStruct(struct(), primaryValues, zeros(1, 7), inputs);
 modeledValues = calcMtpModeledValues(values, inputs, params);
 inputs = mergeStructs(inputs, modeledValues);
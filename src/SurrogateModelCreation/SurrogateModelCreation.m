@@ -29,7 +29,8 @@
 function inputs = SurrogateModelCreation(inputs)
 
 inputs = getMuscleSpecificSurrogateModelData(inputs);
-[inputs.surrogateMuscles, inputs.surrogateMusclesNumArgs] = createSurrogateModel( ...
+[inputs.surrogateMuscles, inputs.surrogateMusclesNumArgs, ...
+    inputs.surrogateMonomials] = createSurrogateModel( ...
     inputs.muscleSpecificJointAngles, inputs.muscleTendonLengths, ...
     inputs.muscleSpecificMomentArms,  inputs.polynomialDegree);
 
@@ -62,6 +62,15 @@ if isempty(indexMatrix)
         end
     end
 end
+if isfield(inputs, 'nativeSurrogateModel')
+    [newMuscleTendonLengths, newMomentArms, newMuscleTendonVelocities] = ...
+        evaluateSurrogateModelMex(inputs.nativeSurrogateModel, ...
+        scatterCoordinates(jointAngles, indexMatrix, ...
+        length(inputs.coordinateNames)), ...
+        scatterCoordinates(jointVelocities, indexMatrix, ...
+        length(inputs.coordinateNames)));
+    return
+end
 for i = 1 : size(jointAngles, 2)
     [newMuscleTendonLengths(:, i), newMuscleTendonVelocities(:, i), ...
         momentArms] = inputs.surrogateMuscles{i}(jointAngles{i}, ...
@@ -72,3 +81,11 @@ for i = 1 : size(jointAngles, 2)
     end
 end
 end
+
+function values = scatterCoordinates(muscleValues, indexMatrix, ...
+    numCoordinates)
+values = zeros(size(muscleValues{1}, 1), numCoordinates);
+for i = 1 : length(muscleValues)
+    values(:, indexMatrix{i}(:, 1)) = muscleValues{i}(:, indexMatrix{i}(:, 2));
+end
+end
@@ -10,11 +10,13 @@
 % polynomialDegree (value)
 %
 % (2D Number matrix, Number array, 2D Number matrix, Number) -> 
-% (Symbol array, 2D Symbol array, Number array)
+% (Symbol array, 2D Symbol array, Number array, Cell)
 %
 % returns polynomial expressions with corresponding coefficients that
 % best fit experimental muscle tendon lengths and moment arms for all 
-% muscles.
+% muscles. The monomials of each muscle are also returned as a struct of
+% exponents (monomials x joint angles) and coefficients for the native
+% surrogate model.
 
 % ----------------------------------------------------------------------- %
 % The NMSM Pipeline is a toolkit for model personalization and treatment  %
@@ -38,9 +40,10 @@
 % permissions and limitations under the License.                          %
 % ----------------------------------------------------------------------- %
 
-function [surrogateMuscles, numArgs] = createSurrogateModel(jointAngles, ...
-    muscleTendonLengths, momentArms, polynomialDegree)
+function [surrogateMuscles, numArgs, monomials] = createSurrogateModel( ...
+    jointAngles, muscleTendonLengths, momentArms, polynomialDegree)
 surrogateMuscles = cell(1, size(muscleTendonLengths, 2));
+monomials = cell(1, size(muscleTendonLengths, 2));
 numArgs = ones(1, size(muscleTendonLengths, 2) * 3);
 % Create surorogate model for all muscles
 for i = 1 : size(muscleTendonLengths, 2)
@@ -67,5 +70,20 @@ surrogateMuscles{i} = @(jointAngles, jointVelocities, numArgs)evaluateSurrogate(
     polynomialMuscleTendonLengths, ...
     polynomialMuscleTendonVelocities, ...
     polynomialMomentArms, coefficients, numArgs(i * 3 - 2 : i * 3));
+monomials{i}.exponents = getMonomialExponents( ...
+    polynomialExpressionMuscleTendonLengths, size(jointAngles{i}, 2));
+monomials{i}.coefficients = coefficients;
+end
+end
+
+% Exponent of each joint angle in each monomial of the length polynomial,
+% in the order of the coefficients
+function exponents = getMonomialExponents(lengthMonomials, numCoordinates)
+theta = sym('theta', [1 numCoordinates]);
+exponents = zeros(length(lengthMonomials), numCoordinates);
+for j = 1 : length(lengthMonomials)
+    for k = 1 : numCoordinates
+        exponents(j, k) = polynomialDegree(lengthMonomials(j), theta(k));
+    end
 end
 end
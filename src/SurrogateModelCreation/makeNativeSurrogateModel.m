@@ -0,0 +1,75 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function compiles the surrogate muscles for evaluateSurrogateModelMex
+% if it is available, from the monomial exponents and coefficients that
+% createSurrogateModel stores in inputs.surrogateMonomials. Surrogate
+% muscles without them, such as those loaded from an older
+% surrogateMuscles.mat, or whose exponents do not match their surrogate
+% model labels, are evaluated with their MATLAB functions instead. Muscle
+% coordinates are mapped to inputs.coordinateNames in the same order as
+% calcSurrogateModel.
+%
+% (struct) -> (struct)
+% Adds the compiled surrogate model to the inputs
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function inputs = makeNativeSurrogateModel(inputs)
+if isfield(inputs, 'nativeSurrogateModel')
+    inputs = rmfield(inputs, 'nativeSurrogateModel');
+end
+if ~hasSurrogateModelMex()
+    return
+end
+numMuscles = length(inputs.surrogateMuscles);
+monomials = valueOrAlternate(inputs, 'surrogateMonomials', {});
+if length(monomials) ~= numMuscles
+    return
+end
+coordinates = cell(1, numMuscles);
+exponents = cell(1, numMuscles);
+coefficients = cell(1, numMuscles);
+for i = 1 : numMuscles
+    coordinates{i} = getMuscleCoordinates(inputs, i);
+    exponents{i} = monomials{i}.exponents;
+    coefficients{i} = monomials{i}.coefficients;
+    if size(exponents{i}, 2) ~= length(coordinates{i}) || ...
+            size(exponents{i}, 1) ~= length(coefficients{i})
+        return
+    end
+end
+inputs.nativeSurrogateModel = evaluateSurrogateModelMex('compile', ...
+    length(inputs.coordinateNames), coordinates, exponents, coefficients);
+end
+
+function coordinates = getMuscleCoordinates(inputs, muscle)
+coordinates = zeros(1, 0);
+for j = 1 : length(inputs.coordinateNames)
+    for k = 1 : length(inputs.surrogateModelLabels{muscle})
+        if strcmp(inputs.coordinateNamesStrings(j), ...
+                inputs.surrogateModelLabels{muscle}(k))
+            coordinates(end + 1) = j - 1;
+        end
+    end
+end
+end
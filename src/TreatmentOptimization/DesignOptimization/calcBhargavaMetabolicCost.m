@@ -4,9 +4,12 @@
 % et al., (2004), Arones et al., (2020) and OpenSim
 % Bhargava2004SmoothedMuscleMetabolics.cpp 
 %
+% calcMetabolicCostMex is used when it is compiled. It can also return the
+% derivative of the metabolic power with respect to each muscle activation.
+%
 % (double, Array of double, Array of double, Array of double, 
 % Array of double, Array of double, Array of double, Array of double) 
-% -> (Array of double)
+% -> (Array of double, 2D matrix of double)
 % returns the metabolic power
 
 % ----------------------------------------------------------------------- %
@@ -30,10 +33,25 @@
 % implied. See the License for the specific language governing            %
 % permissions and limitations under the License.                          %
 % ----------------------------------------------------------------------- %
-function metabolicPower = calcBhargavaMetabolicCost(mass, ...
+function [metabolicPower, activationDerivatives] = ...
+    calcBhargavaMetabolicCost(mass, ...
     allMuscleActivations, normalizedMuscleFiberLengths, ...
     normalizedMuscleFiberVelocities, maxIsometricForce, optimalFiberLength,...
     vMaxFactor,pennationAngle)
+if hasMetabolicCostMex()
+    mexArguments = {'bhargava', mass, allMuscleActivations, ...
+        normalizedMuscleFiberLengths, normalizedMuscleFiberVelocities, ...
+        maxIsometricForce, optimalFiberLength, vMaxFactor, pennationAngle};
+    if nargout > 1
+        [metabolicPower, activationDerivatives] = ...
+            calcMetabolicCostMex(mexArguments{:});
+    else
+        metabolicPower = calcMetabolicCostMex(mexArguments{:});
+    end
+    return
+end
+assert(nargout < 2, "Metabolic cost activation derivatives require " + ...
+    "calcMetabolicCostMex. Run compileMetabolicCostMex.")
 
 % muscle constants
 muscleSpecificStress = 610e3; % N/square meters
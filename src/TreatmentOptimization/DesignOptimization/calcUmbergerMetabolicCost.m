@@ -0,0 +1,52 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calculates the metabolic power (W) based on Umberger et
+% al., (2003) with the stretched fiber scaling of Umberger (2010), using
+% calcMetabolicCostMex. Muscle excitations are not available, so the
+% activation is used for the combined excitation and activation term.
+% The derivative of the metabolic power with respect to each muscle
+% activation is also returned if requested.
+%
+% (double, Array of double, Array of double, Array of double,
+% Array of double, Array of double, Array of double, Array of double)
+% -> (Array of double, 2D matrix of double)
+% returns the metabolic power
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [metabolicPower, activationDerivatives] = ...
+    calcUmbergerMetabolicCost(mass, muscleActivations, ...
+    normalizedFiberLengths, normalizedFiberVelocities, ...
+    maxIsometricForce, optimalFiberLength, vMaxFactor, pennationAngle)
+assert(hasMetabolicCostMex(), "The Umberger metabolic model requires " + ...
+    "calcMetabolicCostMex. Run compileMetabolicCostMex.")
+mexArguments = {'umberger', mass, muscleActivations, ...
+    normalizedFiberLengths, normalizedFiberVelocities, ...
+    maxIsometricForce, optimalFiberLength, vMaxFactor, pennationAngle};
+if nargout > 1
+    [metabolicPower, activationDerivatives] = ...
+        calcMetabolicCostMex(mexArguments{:});
+else
+    metabolicPower = calcMetabolicCostMex(mexArguments{:});
+end
+end
@@ -42,7 +42,7 @@ momentLabelsNoSuffix = erase(params.inverseDynamicsMomentLabels, '_moment');
 momentLabelsNoSuffix = erase(momentLabelsNoSuffix, '_force');
 includedJointMomentCols = ismember(momentLabelsNoSuffix, ...
     convertCharsToStrings(params.coordinateNames));
-if isequal(mexext, 'mexw64')
+if hasNativeMexFunctions()
     jointMoment = jointMoment(:, includedJointMomentCols);
 end
 jointPower = jointMoment(:, indx) .* jointVelocity(:, indx);
@@ -47,6 +47,12 @@ end
 function [forces, moments] = calcGroundReactionForcesAndMoments(markerPositions, ...
     markerVelocities, springConstants, midfootSuperiorPosition, contactSurface)
 
+if hasGroundReactionsMex()
+    [forces, moments] = calcGroundReactionsMex(markerPositions, ...
+        markerVelocities, springConstants, midfootSuperiorPosition, ...
+        contactSurface);
+    return
+end
 markerPositions = reshape(markerPositions, [], 3, size(springConstants, 2));
 markerVelocities = reshape(markerVelocities, [], 3, size(springConstants, 2));
 
@@ -34,9 +34,16 @@
 
 function modeledValues = calcSynergyBasedModeledValues(values, inputs)
 if strcmp(inputs.controllerType, 'synergy')
-    [jointAngles, jointVelocities] = getMuscleActuatedDOFs(values, inputs);
-    [muscleTendonLength, momentArms, muscleTendonVelocity] = ...
-        calcSurrogateModel(inputs, jointAngles, jointVelocities);
+    if isfield(inputs, 'nativeSurrogateModel')
+        [muscleTendonLength, momentArms, muscleTendonVelocity] = ...
+            evaluateSurrogateModelMex(inputs.nativeSurrogateModel, ...
+            values.positions, values.velocities);
+    else
+        [jointAngles, jointVelocities] = ...
+            getMuscleActuatedDOFs(values, inputs);
+        [muscleTendonLength, momentArms, muscleTendonVelocity] = ...
+            calcSurrogateModel(inputs, jointAngles, jointVelocities);
+    end
     [modeledValues.normalizedFiberLength, ...
         modeledValues.normalizedFiberVelocity] = ...
         calcNormalizedFiberQuantities(inputs, muscleTendonLength, ...
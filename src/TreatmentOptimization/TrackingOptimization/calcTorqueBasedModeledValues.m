@@ -32,30 +32,61 @@
 
 function modeledValues = calcTorqueBasedModeledValues(values, inputs, ...
     modeledValues)
-[springPositions, springVelocities, modeledValues.bodyLocations, ...
-    modeledValues.markerPositions, modeledValues.markerVelocities] = ...
-    calculateModeledValuesPointKinematics(values, inputs);
-[appliedLoads, modeledValues.groundReactionsLab] = setupAppliedLoads(values, inputs, ...
-    modeledValues, springPositions, springVelocities);
-[modeledValues.inverseDynamicsMoments, modeledValues.angularMomentum, ....
-    modeledValues.metabolicCost, massCenterPositons, ...
-    modeledValues.bodyOrientations] = ...
-    inverseDynamics(values.time, ...
-    values.positions, values.velocities, ...
-    values.accelerations, inputs.coordinateNames, appliedLoads, ...
-    inputs.mexModel, modeledValues.muscleActivations, ...
-    inputs.trackedOrientationIndices, ...
-    sum(valueOrAlternate(inputs, 'calculateAngularMomentum', false)), ...
-    false, sum(valueOrAlternate(inputs, 'calculateBodyOrientation', ...
-    false)), inputs.osimVersion);
-if sum(valueOrAlternate(inputs, 'calculateMetabolicCost', false))
-    modeledValues.metabolicCost = calcBhargavaMetabolicCost( ...
+calculateMetabolicCost = sum(valueOrAlternate(inputs, ...
+    'calculateMetabolicCost', false));
+ticket = [];
+if ~isempty(inputs.contactSurfaces) && ...
+        valueOrAlternate(inputs, 'useBodyForceInverseDynamics', false) ...
+        && getNativeMexInterfaceVersion(inputs.osimVersion) >= 12
+    [modeledValues, massCenterPositons] = ...
+        calcBodyForceInverseDynamics(values, inputs, modeledValues);
+elseif ~isempty(inputs.contactSurfaces) && calculateMetabolicCost && ...
+        getNativeMexInterfaceVersion(inputs.osimVersion) >= 11
+    % Solved on a native worker thread while the metabolic cost is
+    % calculated below. Without that work, submitting would only add the
+    % hand-off to the worker, so the call below is made directly.
+    contactArguments = getGroundContactArguments(values, inputs, ...
+        modeledValues);
+    ticket = submitNativeKernelCall("inverseDynamics", ...
+        inputs.osimVersion, 'groundContactInverseDynamics', ...
+        contactArguments{:});
+elseif ~isempty(inputs.contactSurfaces) && ...
+        getNativeMexInterfaceVersion(inputs.osimVersion) >= 1
+    [modeledValues, massCenterPositons] = ...
+        calcGroundContactInverseDynamics(values, inputs, modeledValues);
+else
+    [springPositions, springVelocities, modeledValues.bodyLocations, ...
+        modeledValues.markerPositions, modeledValues.markerVelocities] = ...
+        calculateModeledValuesPointKinematics(values, inputs);
+    [appliedLoads, modeledValues.groundReactionsLab] = setupAppliedLoads(values, inputs, ...
+        modeledValues, springPositions, springVelocities);
+    [modeledValues.inverseDynamicsMoments, modeledValues.angularMomentum, ....
+        modeledValues.metabolicCost, massCenterPositons, ...
+        modeledValues.bodyOrientations] = ...
+        inverseDynamics(values.time, ...
+        values.positions, values.velocities, ...
+        values.accelerations, inputs.coordinateNames, appliedLoads, ...
+        inputs.mexModel, modeledValues.muscleActivations, ...
+        inputs.trackedOrientationIndices, ...
+        sum(valueOrAlternate(inputs, 'calculateAngularMomentum', false)), ...
+        false, sum(valueOrAlternate(inputs, 'calculateBodyOrientation', ...
+        false)), inputs.osimVersion);
+end
+if calculateMetabolicCost
+    metabolicCost = calcBhargavaMetabolicCost( ...
         inputs.mass, modeledValues.muscleActivations, ...
         modeledValues.normalizedFiberLength, ...
         modeledValues.normalizedFiberVelocity, ...
         inputs.maxIsometricForce, inputs.optimalFiberLength, ...
         inputs.vMaxFactor, inputs.pennationAngle);
 end
+if ~isempty(ticket)
+    [modeledValues, massCenterPositons] = ...
+        collectGroundContactInverseDynamics(ticket, inputs, modeledValues);
+end
+if calculateMetabolicCost
+    modeledValues.metabolicCost = metabolicCost;
+end
 if sum(valueOrAlternate(inputs, 'calculateBrakingImpulse', false))
     modeledValues.brakingImpulse = calcBrakingForce(modeledValues, ...
         values, inputs.contactSurfaces);
@@ -68,6 +99,97 @@ modeledValues.massCenterVelocity = (massCenterPositons(2) - ...
     massCenterPositons(1)) / values.time(end);
 end
 
+% Spring kinematics, ground reactions and inverse dynamics in one pass of
+% the native MEX function. The contact loads are applied inside the MEX
+% function, so only muscle and coordinate actuator controls are passed.
+function [modeledValues, massCenterPositons] = ...
+    calcGroundContactInverseDynamics(values, inputs, modeledValues)
+contactArguments = getGroundContactArguments(values, inputs, modeledValues);
+[modeledValues.inverseDynamicsMoments, modeledValues.angularMomentum, ...
+    modeledValues.metabolicCost, massCenterPositons, ...
+    modeledValues.bodyOrientations, modeledValues.groundReactionsLab, ...
+    modeledValues.bodyLocations.midfootSuperior, ...
+    modeledValues.markerPositions, modeledValues.markerVelocities] = ...
+    inverseDynamicsWithGroundContact(contactArguments{:}, ...
+    inputs.osimVersion);
+modeledValues = clearUntrackedMarkers(modeledValues, inputs);
+end
+
+% Ground reactions calculated here and applied as forces on the contact
+% bodies in the native solve, so the model needs no ground reaction
+% actuators and no controls are passed. Muscles apply no force in the solve.
+function [modeledValues, massCenterPositons] = ...
+    calcBodyForceInverseDynamics(values, inputs, modeledValues)
+[springPositions, springVelocities, modeledValues.bodyLocations, ...
+    modeledValues.markerPositions, modeledValues.markerVelocities] = ...
+    calculateModeledValuesPointKinematics(values, inputs);
+[forceBodyIndices, bodyForces, modeledValues.groundReactionsLab] = ...
+    setupBodyForces(inputs, modeledValues, springPositions, ...
+    springVelocities);
+[modeledValues.inverseDynamicsMoments, modeledValues.angularMomentum, ...
+    modeledValues.metabolicCost, massCenterPositons, ...
+    modeledValues.bodyOrientations] = inverseDynamicsWithBodyForces( ...
+    values.time, values.positions, values.velocities, ...
+    values.accelerations, inputs.coordinateNames, ...
+    modeledValues.muscleActivations, inputs.trackedOrientationIndices, ...
+    sum(valueOrAlternate(inputs, 'calculateAngularMomentum', false)), ...
+    false, sum(valueOrAlternate(inputs, 'calculateBodyOrientation', ...
+    false)), forceBodyIndices, zeros(length(forceBodyIndices), 3), ...
+    bodyForces, inputs.osimVersion);
+end
+
+% The outputs of a ground contact inverse dynamics call submitted with
+% getGroundContactArguments
+function [modeledValues, massCenterPositons] = ...
+    collectGroundContactInverseDynamics(ticket, inputs, modeledValues)
+[modeledValues.inverseDynamicsMoments, modeledValues.angularMomentum, ...
+    modeledValues.metabolicCost, massCenterPositons, ...
+    modeledValues.bodyOrientations, forces, moments, ...
+    midfootSuperiorPositions, modeledValues.markerPositions, ...
+    modeledValues.markerVelocities] = waitNativeKernelCall(ticket);
+[modeledValues.groundReactionsLab, ...
+    modeledValues.bodyLocations.midfootSuperior] = ...
+    splitGroundContactOutputs(forces, moments, ...
+    midfootSuperiorPositions, length(inputs.contactSurfaces));
+modeledValues = clearUntrackedMarkers(modeledValues, inputs);
+end
+
+% The arguments of the native ground contact inverse dynamics call
+function contactArguments = getGroundContactArguments(values, inputs, ...
+    modeledValues)
+numCoordinateLoads = inputs.model.getForceSet().getSize() - ...
+    inputs.model.getForceSet().getMuscles().getSize() - ...
+    (12 * length(inputs.contactSurfaces));
+appliedLoads = zeros(length(values.time), ...
+    inputs.model.getForceSet().getMuscles().getSize() + ...
+    numCoordinateLoads);
+[markerLocations, markerBodyIndices] = getTrackedMarkers(inputs);
+contactArguments = {values.time, values.positions, values.velocities, ...
+    values.accelerations, inputs.coordinateNames, appliedLoads, ...
+    modeledValues.muscleActivations, ...
+    inputs.trackedOrientationIndices, ...
+    sum(valueOrAlternate(inputs, 'calculateAngularMomentum', false)), ...
+    false, sum(valueOrAlternate(inputs, 'calculateBodyOrientation', ...
+    false)), inputs.contactSurfaces, markerLocations, markerBodyIndices};
+end
+
+function [markerLocations, markerBodyIndices] = getTrackedMarkers(inputs)
+markerLocations = [];
+markerBodyIndices = [];
+if isfield(inputs, 'trackedMarkerNames') ...
+        && ~isempty(inputs.trackedMarkerNames)
+    markerLocations = inputs.trackedMarkerLocations;
+    markerBodyIndices = inputs.trackedMarkerBodyIndices;
+end
+end
+
+function modeledValues = clearUntrackedMarkers(modeledValues, inputs)
+if isempty(getTrackedMarkers(inputs))
+    modeledValues.markerPositions = [];
+    modeledValues.markerVelocities = [];
+end
+end
+
 function [appliedLoads, groundReactionsLab] = setupAppliedLoads(values, ...
     inputs, modeledValues, springPositions, springVelocities)
 appliedLoads = [];
@@ -90,6 +212,32 @@ else
 end
 end
 
+% The ground reactions of each contact surface as a force and a moment
+% about the body origin on its parent and child bodies
+function [forceBodyIndices, bodyForces, groundReactionsLab] = ...
+    setupBodyForces(inputs, modeledValues, springPositions, ...
+    springVelocities)
+bodyLocations = modeledValues.bodyLocations;
+groundReactions = calcFootGroundReactions(springPositions, ...
+    springVelocities, inputs, bodyLocations);
+groundReactionsLab = calcGroundReactionsLab(groundReactions);
+forceBodyIndices = [];
+bodyForces = [];
+for i = 1:length(inputs.contactSurfaces)
+    parentMoment = transferMoments(bodyLocations.midfootSuperior{i}, ...
+        bodyLocations.parent{i}, groundReactions.parentMoments{i}, ...
+        groundReactions.parentForces{i});
+    childMoment = transferMoments(bodyLocations.midfootSuperior{i}, ...
+        bodyLocations.child{i}, groundReactions.childMoments{i}, ...
+        groundReactions.childForces{i});
+    forceBodyIndices = [forceBodyIndices, ...
+        inputs.contactSurfaces{i}.parentBody, ...
+        inputs.contactSurfaces{i}.childBody];
+    bodyForces = [bodyForces, groundReactions.parentForces{i}, ...
+        parentMoment, groundReactions.childForces{i}, childMoment];
+end
+end
+
 function groundReactionsBody = transferGroundReactionMoments( ...
     bodyLocations, groundReactions, params)
 
@@ -55,6 +55,10 @@ if strcmpi(inputs.controllerType, "synergy")
         temp = load("surrogateMuscles.mat");
         inputs.surrogateMuscles = temp.surrogateMuscles;
         inputs.surrogateMusclesNumArgs = temp.surrogateMusclesNumArgs;
+        % Files saved before the monomials were kept only use MATLAB
+        if isfield(temp, 'surrogateMonomials')
+            inputs.surrogateMonomials = temp.surrogateMonomials;
+        end
         inputs = getMuscleSpecificSurrogateModelData(inputs);
     else
         inputs = SurrogateModelCreation(inputs);
@@ -62,7 +66,11 @@ if strcmpi(inputs.controllerType, "synergy")
     if inputs.saveSurrogate
         surrogateMuscles = inputs.surrogateMuscles;
         surrogateMusclesNumArgs = inputs.surrogateMusclesNumArgs;
-        save("surrogateMuscles.mat", "surrogateMuscles", "surrogateMusclesNumArgs");
+        surrogateMonomials = valueOrAlternate(inputs, ...
+            'surrogateMonomials', {});
+        save("surrogateMuscles.mat", "surrogateMuscles", ...
+            "surrogateMusclesNumArgs", "surrogateMonomials");
     end
+    inputs = makeNativeSurrogateModel(inputs);
 end
 end
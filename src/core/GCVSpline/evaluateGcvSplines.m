@@ -7,7 +7,11 @@
 % set. The derivative level is given as an integer (0 for position, 1 for
 % velocity, 2 for acceleration, etc.).
 %
-% (GCVSplineSet, string OR int, Array of double, int) -> (Array of double)
+% Spline sets fit natively by makeGcvSplineSet are evaluated for all
+% columns and time points in one multithreaded MEX call.
+%
+% (GCVSplineSet or struct, string OR int, Array of double, int) ->
+% (Array of double)
 % Evaluate GCV spline values or derivatives at a set of time points.
 
 % ----------------------------------------------------------------------- %
@@ -34,6 +38,15 @@
 
 function values = evaluateGcvSplines(splineSet, columnLabels, time, ...
     derivative)
+if nargin < 4
+    derivative = 0;
+end
+if isstruct(splineSet)
+    values = evaluateNativeGcvSplines(splineSet, columnLabels, time, ...
+        derivative);
+    return
+end
+
 values = zeros(length(time), length(columnLabels));
 
 if iscell(columnLabels)
@@ -48,18 +61,26 @@ if isstring(columnLabels) || ischar(columnLabels)
     columnLabels = str2double(columnLabels);
 end
 
-if nargin < 4
-    derivative = 0;
-end
-
-% if isequal(mexext, 'mexw64')
-%     values = evaluateGcvSplinesMexWindows(splineSet, columnLabels, time, ...
-%         derivative);
-% else
 for i = 1 : length(columnLabels)
     for j = 1 : length(time)
         values(j, i) = splineSet.evaluate(columnLabels(i), derivative, time(j));
     end
 end
-% end
+end
+
+function values = evaluateNativeGcvSplines(splineSet, columnLabels, ...
+    time, derivative)
+if iscell(columnLabels) || ischar(columnLabels)
+    columnLabels = string(columnLabels);
+end
+if isstring(columnLabels)
+    [isIncluded, columns] = ismember(columnLabels, splineSet.columnLabels);
+    assert(all(isIncluded), "The specified coordinate is not included" + ...
+        " in the spline set.")
+    columns = columns - 1;
+else
+    columns = columnLabels;
+end
+values = feval(splineSet.mexName, 'evaluate', splineSet.nativeHandle, ...
+    double(columns), double(time), derivative);
 end
@@ -2,12 +2,18 @@
 %
 % Fit data with a GCVSplineSet, a set of GCV splines defined by the OpenSim
 % API. The arguments represent a time column, data to fit, column labels,
-% the degree of splines to fit, and a smoothing parameter. The first three
-% arguments are required, and the last two are optional, defaulting to
-% degree 5 and no smoothing. 
+% and the degree of splines to fit. The first three arguments are
+% required, and the degree is optional, defaulting to 5. The splines
+% interpolate the data without smoothing.
 %
-% (Array of double, 2D Array of double, Array of string, int, double) -> 
-% (GCVSplineSet)
+% If native GCV splines have been enabled with configureNativeGcvSplines,
+% the splines are fit natively and a struct referring to them is returned
+% instead of a GCVSplineSet. Both are evaluated with evaluateGcvSplines.
+% The native splines are freed when the last copy of the struct is
+% cleared.
+%
+% (Array of double, 2D Array of double, Array of string, int) ->
+% (GCVSplineSet or struct)
 %
 % Fit data with a set of GCV splines.
 
@@ -44,16 +50,29 @@ assert(length(time) == size(data, 1), "Length of time column must" + ...
 assert(length(columnLabels)==size(data, 2), "Number of column labels" + ...
     " must match number of data columns to spline-fit.")
 
-timeVec = StdVectorDouble(time);
-matrix = Matrix.createFromMat(data);
-labels = StdVectorString(columnLabels);
-table = TimeSeriesTable(timeVec, matrix, labels);
-
 if nargin < 4
     degree = 5;
 elseif isempty(degree)
     degree = 5;
 end
 
+[isCompiled, mexName] = hasNativeGcvSplines();
+if isCompiled && configureNativeGcvSplines()
+    nativeHandle = feval(mexName, 'fit', double(time(:)), ...
+        double(data), degree);
+    splineSet.nativeHandle = nativeHandle;
+    splineSet.mexName = mexName;
+    splineSet.columnLabels = string(columnLabels);
+    % Shared by the copies of the struct and run when the last is cleared
+    splineSet.releaser = onCleanup(@() feval(mexName, 'release', ...
+        nativeHandle));
+    return
+end
+
+timeVec = StdVectorDouble(time);
+matrix = Matrix.createFromMat(data);
+labels = StdVectorString(columnLabels);
+table = TimeSeriesTable(timeVec, matrix, labels);
+
 splineSet = GCVSplineSet(table, labels, degree);
 end
@@ -0,0 +1,38 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function frees the native memory of a spline set made by
+% makeGcvSplineSet when native GCV splines are used, before the spline set
+% is cleared, which frees it otherwise. Java spline sets are freed by the
+% garbage collector, so nothing is done for them. The spline set cannot be
+% evaluated after it is released.
+%
+% (struct or GCVSplineSet) -> (None)
+% Frees a native GCV spline set
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function releaseGcvSplineSet(splineSet)
+if isstruct(splineSet) && isfield(splineSet, 'nativeHandle')
+    feval(splineSet.mexName, 'release', splineSet.nativeHandle);
+end
+end
@@ -0,0 +1,99 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Resolves coordinate labels into State indices and locked flags once so
+// the OpenMP frame loops only perform indexed writes into the State.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Marleny Vega, Spencer Williams                               //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_COORDINATE_BINDING_H
+#define NMSM_COORDINATE_BINDING_H
+
+#include <OpenSim/OpenSim.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FrameResultCache.h"
+
+// Index data for the coordinate label order used by the caller. The same
+// binding is valid for every replica of a model because replicas share the
+// multibody tree order.
+struct CoordinateBinding {
+    std::vector<std::string> labels;
+    // Q index (equal to the U index, quaternions are not supported) of the
+    // coordinate named by each label
+    std::vector<int> stateIndex;
+    // Default locked flag of the coordinate named by each label
+    std::vector<char> isLocked;
+    int numStateCoordinates = 0;
+    int numModelControls = 0;
+};
+
+inline CoordinateBinding bindCoordinates(const OpenSim::Model& model,
+        const SimTK::State& state, const std::vector<std::string>& labels) {
+    const std::vector<SimTK::ReferencePtr<const OpenSim::Coordinate>>
+        coordinates = model.getCoordinatesInMultibodyTreeOrder();
+    if ((int) coordinates.size() != state.getNQ() ||
+            state.getNQ() != state.getNU()) {
+        throw OpenSim::Exception("Coordinate binding requires one Q and "
+            "one U per coordinate, models with quaternions are not "
+            "supported.");
+    }
+    std::unordered_map<std::string, int> treeIndex;
+    for (int i = 0; i < (int) coordinates.size(); i++) {
+        treeIndex[coordinates[i]->getName()] = i;
+    }
+
+    CoordinateBinding binding;
+    binding.labels = labels;
+    binding.numStateCoordinates = state.getNQ();
+    binding.numModelControls = model.getNumControls();
+    binding.stateIndex.resize(labels.size());
+    binding.isLocked.resize(labels.size());
+    for (size_t k = 0; k < labels.size(); k++) {
+        auto found = treeIndex.find(labels[k]);
+        if (found == treeIndex.end()) {
+            throw OpenSim::Exception("Coordinate " + labels[k] +
+                " is not in the model.");
+        }
+        binding.stateIndex[k] = found->second;
+        binding.isLocked[k] = coordinates[found->second]->get_locked();
+    }
+    return binding;
+}
+
+// Mixes the state indices and locked flags of a binding into a cache
+// request hash. Bindings of the same labels hash equally, so callers that
+// alternate label orders keep their cached frames.
+inline std::uint64_t hashCoordinateBinding(std::uint64_t hash,
+        const CoordinateBinding& binding) {
+    hash = mixFrameCacheHash(hash, binding.numStateCoordinates);
+    hash = mixFrameCacheHash(hash, binding.numModelControls);
+    for (size_t k = 0; k < binding.stateIndex.size(); k++) {
+        hash = mixFrameCacheHash(hash, binding.stateIndex[k]);
+        hash = mixFrameCacheHash(hash, binding.isLocked[k]);
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,246 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Whole body quantities requested per call from the States of the inverse
+// dynamics kernel. Each request names one quantity and the bodies or
+// stations it is wanted for, and is filled from the State of each frame in
+// the same pass as the solve, so callers do not realize the frames again
+// for body positions or reaction loads.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_FRAME_CHANNELS_H
+#define NMSM_FRAME_CHANNELS_H
+
+#include <OpenSim/OpenSim.h>
+#include <string>
+#include <vector>
+#include "MatrixView.h"
+
+// Vectors are in ground. Rotations are body-fixed XYZ angles. Momentum is
+// the angular then linear momentum about the mass center. Joint reactions
+// are the force then moment that the joint of each body's mobilizer
+// applies to the body, about the joint center on the body. They include
+// the joint's generalized forces, as in OpenSim's JointReaction analysis.
+enum FrameChannelKind {
+    channelMassCenterPosition,
+    channelMassCenterVelocity,
+    channelBodyOriginPosition,
+    channelBodyOriginVelocity,
+    channelBodyRotation,
+    channelStationPosition,
+    channelStationVelocity,
+    channelSystemMomentum,
+    channelJointReaction,
+    numFrameChannelKinds
+};
+
+inline const char* getFrameChannelName(int kind) {
+    static const char* const names[numFrameChannelKinds] = {
+        "massCenterPosition", "massCenterVelocity", "bodyOriginPosition",
+        "bodyOriginVelocity", "bodyRotation", "stationPosition",
+        "stationVelocity", "systemMomentum", "jointReaction"};
+    return names[kind];
+}
+
+// Returns false if the name is not a channel
+inline bool getFrameChannelKind(const std::string& name,
+        FrameChannelKind& kind) {
+    for (int j = 0; j < numFrameChannelKinds; j++) {
+        if (name == getFrameChannelName(j)) {
+            kind = (FrameChannelKind) j;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct FrameChannel {
+    FrameChannelKind kind = channelMassCenterPosition;
+    // Bodies of the body, station and joint reaction channels
+    std::vector<SimTK::MobilizedBodyIndex> bodies;
+    // Stations of the station channels, one per body, in the body frame
+    std::vector<SimTK::Vec3> stations;
+
+    bool isPerBody() const {
+        return kind != channelMassCenterPosition &&
+            kind != channelMassCenterVelocity &&
+            kind != channelSystemMomentum;
+    }
+    int getNumItems() const { return isPerBody() ? (int) bodies.size() : 1; }
+    int getItemWidth() const {
+        return kind == channelSystemMomentum || kind == channelJointReaction
+            ? 6 : 3;
+    }
+    // Output columns, with the columns of each item together
+    int getNumColumns() const { return getNumItems() * getItemWidth(); }
+};
+
+inline bool hasJointReactionChannel(const std::vector<FrameChannel>& channels) {
+    for (const FrameChannel& channel : channels) {
+        if (channel.kind == channelJointReaction) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void writeChannelVec3(const OutputMatrixView& output, int frame,
+        int column, const SimTK::Vec3& value) {
+    for (int k = 0; k < 3; k++) {
+        output(frame, column + k) = value[k];
+    }
+}
+
+// Writes the channels other than joint reactions for a frame. The State
+// must be realized to Velocity.
+inline void writeKinematicChannels(const SimTK::SimbodyMatterSubsystem& matter,
+        const SimTK::State& state, const std::vector<FrameChannel>& channels,
+        const std::vector<OutputMatrixView>& outputs, int frame) {
+    for (size_t c = 0; c < channels.size(); c++) {
+        const FrameChannel& channel = channels[c];
+        const OutputMatrixView& output = outputs[c];
+        switch (channel.kind) {
+        case channelMassCenterPosition:
+            writeChannelVec3(output, frame, 0,
+                matter.calcSystemMassCenterLocationInGround(state));
+            break;
+        case channelMassCenterVelocity:
+            writeChannelVec3(output, frame, 0,
+                matter.calcSystemMassCenterVelocityInGround(state));
+            break;
+        case channelSystemMomentum: {
+            const SimTK::SpatialVec momentum =
+                matter.calcSystemCentralMomentum(state);
+            writeChannelVec3(output, frame, 0, momentum[0]);
+            writeChannelVec3(output, frame, 3, momentum[1]);
+            break;
+        }
+        case channelJointReaction:
+            break;
+        default:
+            for (int j = 0; j < (int) channel.bodies.size(); j++) {
+                const SimTK::MobilizedBody& body =
+                    matter.getMobilizedBody(channel.bodies[j]);
+                SimTK::Vec3 value;
+                if (channel.kind == channelBodyOriginPosition) {
+                    value = body.getBodyOriginLocation(state);
+                } else if (channel.kind == channelBodyOriginVelocity) {
+                    value = body.getBodyOriginVelocity(state);
+                } else if (channel.kind == channelBodyRotation) {
+                    value = body.getBodyRotation(state)
+                        .convertRotationToBodyFixedXYZ();
+                } else if (channel.kind == channelStationPosition) {
+                    value = body.findStationLocationInGround(state,
+                        channel.stations[j]);
+                } else {
+                    value = body.findStationVelocityInGround(state,
+                        channel.stations[j]);
+                }
+                writeChannelVec3(output, frame, 3 * j, value);
+            }
+        }
+    }
+}
+
+// Writes the joint reaction channels for a frame from the accelerations of
+// the solve and the body forces applied in it (moments about each body
+// origin and forces, in ground). The State must be realized to Velocity.
+// The spatial force each body needs for its acceleration, less the applied
+// force, is summed from the leaves of the tree to the root; the sum at a
+// body is what its mobilizer transmits. Mobilized body indices always
+// follow their parents, so one reverse pass visits children first.
+inline void writeJointReactionChannels(
+        const SimTK::SimbodyMatterSubsystem& matter,
+        const SimTK::State& state, const SimTK::Vector& accelerations,
+        const SimTK::Vector_<SimTK::SpatialVec>& appliedBodyForces,
+        const std::vector<FrameChannel>& channels,
+        const std::vector<OutputMatrixView>& outputs, int frame,
+        SimTK::Vector_<SimTK::SpatialVec>& bodyAccelerations,
+        std::vector<SimTK::SpatialVec>& subtreeForces) {
+    const int numBodies = matter.getNumBodies();
+    matter.calcBodyAccelerationFromUDot(state, accelerations,
+        bodyAccelerations);
+    subtreeForces.assign(numBodies, SimTK::SpatialVec(SimTK::Vec3(0.0),
+        SimTK::Vec3(0.0)));
+    for (int b = numBodies - 1; b > 0; b--) {
+        const SimTK::MobilizedBody& body =
+            matter.getMobilizedBody(SimTK::MobilizedBodyIndex(b));
+        const SimTK::MassProperties& massProperties =
+            body.getBodyMassProperties(state);
+        const SimTK::Rotation& rotation = body.getBodyRotation(state);
+        const SimTK::Vec3& angularVelocity =
+            body.getBodyAngularVelocity(state);
+        const SimTK::Vec3& angularAcceleration = bodyAccelerations[b][0];
+        const SimTK::Vec3& originAcceleration = bodyAccelerations[b][1];
+        const double mass = massProperties.getMass();
+        const SimTK::Vec3 massCenter = rotation *
+            massProperties.getMassCenter();
+        const SimTK::Mat33 inertia = massProperties.getInertia().toMat33();
+
+        // Newton-Euler equations about the body origin, in ground
+        const SimTK::Vec3 massCenterAcceleration = originAcceleration +
+            SimTK::cross(angularAcceleration, massCenter) +
+            SimTK::cross(angularVelocity,
+            SimTK::cross(angularVelocity, massCenter));
+        const SimTK::Vec3 inertiaAlpha = rotation *
+            (inertia * (~rotation * angularAcceleration));
+        const SimTK::Vec3 inertiaOmega = rotation *
+            (inertia * (~rotation * angularVelocity));
+        SimTK::SpatialVec& total = subtreeForces[b];
+        total[0] += inertiaAlpha + SimTK::cross(angularVelocity,
+            inertiaOmega) + SimTK::cross(massCenter,
+            mass * originAcceleration) - appliedBodyForces[b][0];
+        total[1] += mass * massCenterAcceleration - appliedBodyForces[b][1];
+
+        // Shift to the parent's origin and add to the parent's subtree
+        const SimTK::MobilizedBody& parent = body.getParentMobilizedBody();
+        const SimTK::Vec3 offset = body.getBodyOriginLocation(state) -
+            parent.getBodyOriginLocation(state);
+        SimTK::SpatialVec& parentTotal =
+            subtreeForces[parent.getMobilizedBodyIndex()];
+        parentTotal[0] += total[0] + SimTK::cross(offset, total[1]);
+        parentTotal[1] += total[1];
+    }
+
+    for (size_t c = 0; c < channels.size(); c++) {
+        const FrameChannel& channel = channels[c];
+        if (channel.kind != channelJointReaction) {
+            continue;
+        }
+        for (int j = 0; j < (int) channel.bodies.size(); j++) {
+            const SimTK::MobilizedBody& body =
+                matter.getMobilizedBody(channel.bodies[j]);
+            const SimTK::SpatialVec& total = subtreeForces[channel.bodies[j]];
+            // The joint center is the origin of the mobilizer's frame on
+            // the body
+            const SimTK::Vec3 offset = body.getBodyOriginLocation(state) -
+                body.findStationLocationInGround(state,
+                body.getOutboardFrame(state).p());
+            writeChannelVec3(outputs[c], frame, 6 * j, total[1]);
+            writeChannelVec3(outputs[c], frame, 6 * j + 3,
+                total[0] + SimTK::cross(offset, total[1]));
+        }
+    }
+}
+
+#endif
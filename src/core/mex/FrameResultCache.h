@@ -0,0 +1,199 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Bounded least recently used cache of per-frame kernel outputs. Entries
+// are keyed by the frame's input row and a hash of everything else the
+// outputs depend on (coordinate binding, requested outputs), so repeated
+// rows, such as the unperturbed frames of a finite difference sweep, are
+// copied instead of solved again.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_FRAME_RESULT_CACHE_H
+#define NMSM_FRAME_RESULT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "MatrixView.h"
+
+// Mixes one 64-bit word into a hash
+inline std::uint64_t mixFrameCacheHash(std::uint64_t hash,
+        std::uint64_t word) {
+    word *= 0x9e3779b97f4a7c15ULL;
+    word ^= word >> 32;
+    hash ^= word;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return hash ^ (hash >> 29);
+}
+
+// Values are compared by their bits, so -0.0 and 0.0 are different keys
+// and NaN inputs can still be found.
+inline std::uint64_t getFrameCacheBits(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+struct FrameCacheKey {
+    // Hash of the coordinate binding and requested outputs of the call
+    std::uint64_t request = 0;
+    std::vector<double> inputs;
+    std::uint64_t hash = 0;
+
+    void reset(std::uint64_t requestHash) {
+        request = requestHash;
+        inputs.clear();
+    }
+    void append(double value) { inputs.push_back(value); }
+    void appendRow(const MatrixView& matrix, int row, int columns) {
+        for (int j = 0; j < columns; j++) {
+            inputs.push_back(matrix(row, j));
+        }
+    }
+    void finish() {
+        hash = request;
+        for (double value : inputs) {
+            hash = mixFrameCacheHash(hash, getFrameCacheBits(value));
+        }
+    }
+};
+
+struct FrameCacheStatistics {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::size_t entries = 0;
+    std::size_t capacity = 0;
+};
+
+// Lookups and insertions are guarded by a mutex, so the frame loops may
+// share one cache. The capacity is only changed between calls.
+class FrameResultCache {
+public:
+    // Sets the maximum number of cached frames and clears the entries and
+    // counters. A capacity of zero disables the cache.
+    void configure(std::size_t newCapacity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = newCapacity;
+        entries.clear();
+        index.clear();
+        hits = 0;
+        misses = 0;
+    }
+
+    // Removes the entries and keeps the capacity and counters. Called when
+    // the model changes.
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+    }
+
+    bool isEnabled() const { return capacity > 0; }
+
+    // Copies the cached outputs of the key into values and returns true if
+    // the key was found with the same number of outputs.
+    bool find(const FrameCacheKey& key, double* values,
+            std::size_t numValues) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(key.hash);
+        if (found == index.end() || !matches(*found->second, key) ||
+                found->second->values.size() != numValues) {
+            misses++;
+            return false;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        std::memcpy(values, entries.front().values.data(),
+            numValues * sizeof(double));
+        hits++;
+        return true;
+    }
+
+    // Stores the outputs of the key, replacing the least recently used
+    // entry when the cache is full. A key whose hash collides with another
+    // entry replaces that entry.
+    void insert(const FrameCacheKey& key, const double* values,
+            std::size_t numValues) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (capacity == 0) {
+            return;
+        }
+        auto found = index.find(key.hash);
+        if (found != index.end()) {
+            entries.splice(entries.begin(), entries, found->second);
+        } else if (entries.size() >= capacity) {
+            // The evicted entry's buffers are reused for the new key
+            index.erase(entries.back().hash);
+            entries.splice(entries.begin(), entries,
+                std::prev(entries.end()));
+            index[key.hash] = entries.begin();
+        } else {
+            entries.emplace_front();
+            index[key.hash] = entries.begin();
+        }
+        Entry& entry = entries.front();
+        entry.hash = key.hash;
+        entry.request = key.request;
+        entry.inputs.assign(key.inputs.begin(), key.inputs.end());
+        entry.values.assign(values, values + numValues);
+    }
+
+    FrameCacheStatistics getStatistics() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        FrameCacheStatistics statistics;
+        statistics.hits = hits;
+        statistics.misses = misses;
+        statistics.entries = entries.size();
+        statistics.capacity = capacity;
+        return statistics;
+    }
+
+private:
+    struct Entry {
+        std::uint64_t hash = 0;
+        std::uint64_t request = 0;
+        std::vector<double> inputs;
+        std::vector<double> values;
+    };
+
+    static bool matches(const Entry& entry, const FrameCacheKey& key) {
+        return entry.request == key.request &&
+            entry.inputs.size() == key.inputs.size() &&
+            std::memcmp(entry.inputs.data(), key.inputs.data(),
+                key.inputs.size() * sizeof(double)) == 0;
+    }
+
+    std::size_t capacity = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::uint64_t, std::list<Entry>::iterator> index;
+    mutable std::mutex mutex;
+};
+
+#endif
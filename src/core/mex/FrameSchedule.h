@@ -0,0 +1,277 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// How the frames of a model kernel are divided among threads. Short trials
+// get no more threads than frames, and calls with uneven frame costs
+// (metabolic cost, ground contact, cache hits) hand out chunks on demand
+// instead of fixed blocks. Chunks are dispatched here rather than with
+// schedule(runtime) because MSVC only supports OpenMP 2.0, which cannot
+// set the schedule of a loop from code.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_FRAME_SCHEDULE_H
+#define NMSM_FRAME_SCHEDULE_H
+
+#include <omp.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+enum FrameScheduleKind {
+    // Static blocks for even frame costs and chunks on demand otherwise,
+    // with no more threads than cores
+    frameScheduleAutomatic,
+    frameScheduleStatic,
+    frameScheduleDynamic,
+    frameScheduleGuided
+};
+
+// Returns false if the name is not automatic, static, dynamic or guided
+inline bool getFrameScheduleKind(const std::string& name,
+        FrameScheduleKind& kind) {
+    static const char* const names[4] = {"automatic", "static", "dynamic",
+        "guided"};
+    for (int j = 0; j < 4; j++) {
+        if (name == names[j]) {
+            kind = (FrameScheduleKind) j;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct FrameScheduleOptions {
+    FrameScheduleKind kind = frameScheduleAutomatic;
+    // Frames per chunk, or 0 to choose from the frames and threads
+    int grain = 0;
+    // Binds each worker thread to one processor before it makes its model
+    // replica, so the replica is allocated in that processor's memory
+    bool pinThreads = false;
+};
+
+// The plan of one call. Automatic options are resolved to a kind other
+// than frameScheduleAutomatic and a positive grain.
+struct FrameSchedule {
+    FrameScheduleKind kind = frameScheduleStatic;
+    int numThreads = 1;
+    int grain = 1;
+    bool pinThreads = false;
+};
+
+// Plans a call of numPts frames on a pool of numThreads replicas. Uneven
+// calls have frames whose cost differs by more than the cost of a chunk
+// dispatch.
+inline FrameSchedule planFrameSchedule(const FrameScheduleOptions& options,
+        int numPts, int numThreads, bool isUneven) {
+    FrameSchedule schedule;
+    schedule.pinThreads = options.pinThreads;
+    schedule.kind = options.kind;
+    int threads = std::min(numThreads, numPts);
+    if (options.kind == frameScheduleAutomatic) {
+        // More threads than processors only adds switching
+        threads = std::min(threads, omp_get_num_procs());
+        schedule.kind = isUneven ? frameScheduleDynamic : frameScheduleStatic;
+    }
+    schedule.numThreads = std::max(threads, 1);
+    if (options.grain > 0) {
+        schedule.grain = options.grain;
+    } else if (schedule.kind == frameScheduleStatic) {
+        // One contiguous block per thread
+        schedule.grain = (numPts + schedule.numThreads - 1) /
+            schedule.numThreads;
+    } else {
+        // Enough chunks per thread to even out slow frames
+        schedule.grain = numPts / (8 * schedule.numThreads);
+    }
+    schedule.grain = std::max(schedule.grain, 1);
+    return schedule;
+}
+
+// The processors a thread may run on
+#if defined(_WIN32)
+typedef DWORD_PTR ThreadAffinity;
+#elif defined(__linux__)
+typedef cpu_set_t ThreadAffinity;
+#else
+typedef int ThreadAffinity;
+#endif
+
+// Binds the calling thread to the index-th processor the process may run
+// on and saves the processors it could run on before in previous. Returns
+// false, with the thread unchanged, if it could not be pinned or the
+// platform has no thread affinity.
+inline bool pinCurrentThread(int index, ThreadAffinity& previous) {
+#if defined(_WIN32)
+    DWORD_PTR processMask = 0;
+    DWORD_PTR systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask,
+            &systemMask) || processMask == 0) {
+        return false;
+    }
+    int numAllowed = 0;
+    for (DWORD_PTR bits = processMask; bits != 0; bits &= bits - 1) {
+        numAllowed++;
+    }
+    int remaining = index % numAllowed;
+    DWORD_PTR mask = processMask;
+    for (int cpu = 0; cpu < (int) (8 * sizeof(DWORD_PTR)); cpu++) {
+        const DWORD_PTR bit = (DWORD_PTR) 1 << cpu;
+        if ((processMask & bit) != 0 && remaining-- == 0) {
+            mask = bit;
+            break;
+        }
+    }
+    previous = SetThreadAffinityMask(GetCurrentThread(), mask);
+    return previous != 0;
+#elif defined(__linux__)
+    cpu_set_t processSet;
+    CPU_ZERO(&processSet);
+    if (sched_getaffinity(0, sizeof(processSet), &processSet) != 0 ||
+            pthread_getaffinity_np(pthread_self(), sizeof(previous),
+            &previous) != 0) {
+        return false;
+    }
+    const int numAllowed = CPU_COUNT(&processSet);
+    if (numAllowed == 0) {
+        return false;
+    }
+    int remaining = index % numAllowed;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &processSet) && remaining-- == 0) {
+            CPU_SET(cpu, &set);
+            break;
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) index;
+    (void) previous;
+    return false;
+#endif
+}
+
+// Lets the calling thread run on the processors saved by pinCurrentThread
+inline void restoreCurrentThreadAffinity(const ThreadAffinity& previous) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), previous);
+#elif defined(__linux__)
+    pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+#else
+    (void) previous;
+#endif
+}
+
+// The next unclaimed frame of a call. Chunks are claimed with an atomic
+// capture, which OpenMP 2.0, the version MSVC supports, does not have, so
+// there the counter is a std::atomic. Neither takes a lock.
+#if defined(_OPENMP) && _OPENMP >= 201107
+typedef int FrameChunkCounter;
+
+// Returns the first frame of a chunk of size frames
+inline int claimFrameChunk(FrameChunkCounter& next, int size) {
+    int first;
+    #pragma omp atomic capture
+    { first = next; next += size; }
+    return first;
+}
+
+inline int peekFrameChunk(FrameChunkCounter& next) {
+    int value;
+    #pragma omp atomic read
+    value = next;
+    return value;
+}
+#else
+typedef std::atomic<int> FrameChunkCounter;
+
+inline int claimFrameChunk(FrameChunkCounter& next, int size) {
+    return next.fetch_add(size);
+}
+
+inline int peekFrameChunk(FrameChunkCounter& next) { return next.load(); }
+#endif
+
+// Calls body(thread, frame) for every frame in [0, numPts) on the threads
+// of the schedule. A thread's id is the same in every call, so it always
+// uses the same model replica. The calling thread is never pinned because
+// it belongs to the host program, and pinned threads get their processors
+// back when the call ends, because OpenMP reuses them for other teams,
+// such as those of KernelTaskQueue workers. The body must not throw.
+template <class FrameBody>
+inline void runFrameSchedule(const FrameSchedule& schedule, int numPts,
+        FrameBody body) {
+    FrameChunkCounter nextFrame(0);
+    #pragma omp parallel num_threads(schedule.numThreads)
+    {
+        const int thread = omp_get_thread_num();
+        const int numTeamThreads = omp_get_num_threads();
+        ThreadAffinity previousAffinity;
+        const bool isPinned = schedule.pinThreads && thread > 0 &&
+            pinCurrentThread(thread, previousAffinity);
+        if (schedule.kind == frameScheduleStatic) {
+            // Chunks are dealt to the threads in turn
+            const int stride = schedule.grain * numTeamThreads;
+            for (int first = thread * schedule.grain; first < numPts;
+                    first += stride) {
+                const int last = std::min(first + schedule.grain, numPts);
+                for (int i = first; i < last; i++) {
+                    body(thread, i);
+                }
+            }
+        } else {
+            while (true) {
+                int chunk = schedule.grain;
+                if (schedule.kind == frameScheduleGuided) {
+                    // Sized from the frames left when it was read, which
+                    // other threads may have claimed since
+                    chunk = std::max(chunk, (numPts -
+                        peekFrameChunk(nextFrame)) / (2 * numTeamThreads));
+                }
+                const int first = claimFrameChunk(nextFrame, chunk);
+                if (first >= numPts) {
+                    break;
+                }
+                const int last = std::min(first + chunk, numPts);
+                for (int i = first; i < last; i++) {
+                    body(thread, i);
+                }
+            }
+        }
+        if (isPinned) {
+            restoreCurrentThreadAffinity(previousAffinity);
+        }
+    }
+}
+
+#endif
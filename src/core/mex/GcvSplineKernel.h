@@ -0,0 +1,91 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Fits generalized cross-validation splines to the columns of a matrix and
+// evaluates any of them at many times, both with OpenMP. Used by the GCV
+// spline MEX function and callers without MATLAB.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_GCV_SPLINE_KERNEL_H
+#define NMSM_GCV_SPLINE_KERNEL_H
+
+#include <OpenSim/OpenSim.h>
+#include <omp.h>
+#include <string>
+#include <vector>
+#include "MatrixView.h"
+
+// Fits one spline of the odd degree to each column of data, whose rows
+// are the numPts times. The error variance is zero, as in OpenSim's
+// GCVSplineSet, so the splines interpolate the data rather than smooth it.
+// Returns an empty string or the first fit error.
+inline std::string fitGcvSplines(const double* time, int numPts,
+        const MatrixView& data, int degree,
+        std::vector<SimTK::Spline>& splines) {
+    splines.resize(data.columns);
+    const SimTK::Vector x(numPts, time, true);
+    std::string parallelError;
+    #pragma omp parallel for schedule(dynamic)
+    for (int j = 0; j < data.columns; j++) {
+        try {
+            const SimTK::Vector y(numPts, &data(0, j), true);
+            splines[j] = SimTK::SplineFitter<SimTK::Real>::
+                fitFromErrorVariance(degree, x, y, 0.0).getSpline();
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(gcvSplineError)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    }
+    return parallelError;
+}
+
+// Writes the derivative of the given order of each listed spline at each
+// time to values, which is times x columns. Columns must index splines.
+inline void evaluateGcvSplines(const std::vector<SimTK::Spline>& splines,
+        const std::vector<int>& columns, const double* time, int numPts,
+        int derivative, const OutputMatrixView& values) {
+    const int numColumns = (int) columns.size();
+    // Spline evaluation only reads the fitted coefficients
+    #pragma omp parallel
+    {
+        const std::vector<int> derivativeComponents(derivative, 0);
+        SimTK::Vector point(1);
+        // One loop over all (column, time) pairs, since MSVC only
+        // supports OpenMP 2.0 and so no collapse clause
+        #pragma omp for schedule(static)
+        for (int n = 0; n < numColumns * numPts; n++) {
+            const int i = n / numPts;
+            const int j = n % numPts;
+            const SimTK::Spline& spline = splines[columns[i]];
+            point[0] = time[j];
+            values(j, i) = derivative == 0
+                ? spline.calcValue(point)
+                : spline.calcDerivative(derivativeComponents, point);
+        }
+    }
+}
+
+#endif
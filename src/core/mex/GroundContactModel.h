@@ -0,0 +1,197 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Native version of the ground contact model used by Ground Contact
+// Personalization and Treatment Optimization. Each spring produces a
+// vertical force from its height and vertical velocity and a friction force
+// opposing its slip velocity. The formulas match
+// calcModeledVerticalGroundReactionForce.m,
+// calcModeledHorizontalGroundReactionForces.m and
+// calcModeledGroundReactionMoments.m. This header does not depend on
+// OpenSim or MATLAB so it can be shared by every kernel that evaluates the
+// contact model.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_GROUND_CONTACT_MODEL_H
+#define NMSM_GROUND_CONTACT_MODEL_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "MatrixView.h"
+
+// Parameters shared by all springs of a contact surface
+struct ContactSurfaceParameters {
+    double dampingFactor = 0.0;
+    double restingSpringLength = 0.0;
+    double dynamicFrictionCoefficient = 0.0;
+    double viscousFrictionCoefficient = 0.0;
+    double beltSpeed = 0.0;
+    double latchingVelocity = 0.0;
+};
+
+// log(cosh(x)) without overflow for large |x|
+#pragma omp declare simd
+inline double logCosh(double x) {
+    const double magnitude = std::fabs(x);
+    return magnitude + std::log1p(std::exp(-2.0 * magnitude)) -
+        0.69314718055994531;
+}
+
+// Out-of-contact stiffness, transition offset, transition curvature and
+// zero-force height of the vertical model
+const double contactKLow = 1e-1;
+const double contactH = 1e-3;
+const double contactC = 1e-3;
+const double contactYMax = 1e-2;
+
+// Terms of the vertical model that only depend on the spring constant
+struct VerticalSpringTerms {
+    double v = 0.0;
+    double s = 0.0;
+    double constant = 0.0;
+};
+
+inline VerticalSpringTerms calcVerticalSpringTerms(double springConstant) {
+    VerticalSpringTerms terms;
+    terms.v = (springConstant + contactKLow) / (springConstant - contactKLow);
+    terms.s = (springConstant - contactKLow) / 2.0;
+    terms.constant = -terms.s * (terms.v * contactYMax - contactC *
+        logCosh((contactYMax + contactH) / contactC));
+    return terms;
+}
+
+// Force of one spring in the lab frame from the spring marker height and
+// velocity in the lab frame. Branch free so loops over springs vectorize.
+inline void calcSpringForce(double v, double s, double constant,
+        double height, double xVelocity, double yVelocity, double zVelocity,
+        const ContactSurfaceParameters& parameters, double& xForce,
+        double& yForce, double& zForce) {
+    // The tanh keeps the height below the singularity of the vertical
+    // model while staying linear in contact
+    height = 0.7 * std::tanh((height - parameters.restingSpringLength) / 0.7);
+    yForce = (-s * (v * height - contactC *
+        logCosh((height + contactH) / contactC)) - constant) *
+        (1.0 - parameters.dampingFactor * yVelocity);
+
+    const double slipOffset = 1e-4;
+    xVelocity += parameters.beltSpeed;
+    double slipVelocity = std::sqrt(xVelocity * xVelocity +
+        zVelocity * zVelocity);
+    slipVelocity = slipVelocity < 1e-10 ? 0.0 : slipVelocity;
+    const double horizontalForce = yForce *
+        (parameters.dynamicFrictionCoefficient *
+        std::tanh(slipVelocity / parameters.latchingVelocity) +
+        parameters.viscousFrictionCoefficient * slipVelocity);
+    xForce = -xVelocity / (slipVelocity + slipOffset) * horizontalForce;
+    zForce = -zVelocity / (slipVelocity + slipOffset) * horizontalForce;
+}
+
+inline void calcSpringForce(double springConstant, double height,
+        double xVelocity, double yVelocity, double zVelocity,
+        const ContactSurfaceParameters& parameters, double force[3]) {
+    const VerticalSpringTerms terms = calcVerticalSpringTerms(springConstant);
+    calcSpringForce(terms.v, terms.s, terms.constant, height, xVelocity,
+        yVelocity, zVelocity, parameters, force[0], force[1], force[2]);
+}
+
+// Spring marker kinematics of a batch of frames in a structure-of-arrays
+// layout. Each array is frames x springs with the springs of one frame
+// contiguous, so the loop over springs reads unit-stride memory.
+struct ContactSpringKinematics {
+    int numFrames = 0;
+    int numSprings = 0;
+    const double* x = nullptr;
+    const double* y = nullptr;
+    const double* z = nullptr;
+    const double* xVelocity = nullptr;
+    const double* yVelocity = nullptr;
+    const double* zVelocity = nullptr;
+};
+
+// Sums the spring forces of every frame and their moments about the
+// midfoot superior point projected onto the floor. midfootSuperior is
+// frames x 3 and may be empty if moments are not needed. forces and
+// moments are frames x 3. Frames are split across threads and springs are
+// vectorized within a frame.
+inline void calcGroundReactionsBatch(const ContactSpringKinematics& springs,
+        const double* springConstants,
+        const ContactSurfaceParameters& parameters,
+        const MatrixView& midfootSuperior, const OutputMatrixView& forces,
+        const OutputMatrixView& moments, int numThreads) {
+    const int numSprings = springs.numSprings;
+    std::vector<double> v(numSprings), s(numSprings), constant(numSprings);
+    for (int j = 0; j < numSprings; j++) {
+        const VerticalSpringTerms terms =
+            calcVerticalSpringTerms(springConstants[j]);
+        v[j] = terms.v;
+        s[j] = terms.s;
+        constant[j] = terms.constant;
+    }
+    const double* vData = v.data();
+    const double* sData = s.data();
+    const double* constantData = constant.data();
+    const bool hasMidfoot = !midfootSuperior.isEmpty();
+
+    #pragma omp parallel for num_threads(numThreads) schedule(static)
+    for (int i = 0; i < springs.numFrames; i++) {
+        const std::ptrdiff_t offset = (std::ptrdiff_t) i * numSprings;
+        const double* x = springs.x + offset;
+        const double* y = springs.y + offset;
+        const double* z = springs.z + offset;
+        const double* xVelocity = springs.xVelocity + offset;
+        const double* yVelocity = springs.yVelocity + offset;
+        const double* zVelocity = springs.zVelocity + offset;
+        const double midfootX = hasMidfoot ? midfootSuperior(i, 0) : 0.0;
+        const double midfootZ = hasMidfoot ? midfootSuperior(i, 2) : 0.0;
+        double xForceSum = 0.0, yForceSum = 0.0, zForceSum = 0.0;
+        double xMomentSum = 0.0, yMomentSum = 0.0, zMomentSum = 0.0;
+        #pragma omp simd reduction(+:xForceSum, yForceSum, zForceSum, \
+            xMomentSum, yMomentSum, zMomentSum)
+        for (int j = 0; j < numSprings; j++) {
+            double xForce, yForce, zForce;
+            calcSpringForce(vData[j], sData[j], constantData[j], y[j],
+                xVelocity[j], yVelocity[j], zVelocity[j], parameters,
+                xForce, yForce, zForce);
+            // Offset from the projected midfoot point is (dx, 0, dz)
+            const double dx = x[j] - midfootX;
+            const double dz = z[j] - midfootZ;
+            xForceSum += xForce;
+            yForceSum += yForce;
+            zForceSum += zForce;
+            xMomentSum += -dz * yForce;
+            yMomentSum += dz * xForce - dx * zForce;
+            zMomentSum += dx * yForce;
+        }
+        forces(i, 0) = xForceSum;
+        forces(i, 1) = yForceSum;
+        forces(i, 2) = zForceSum;
+        if (hasMidfoot) {
+            moments(i, 0) = xMomentSum;
+            moments(i, 1) = yMomentSum;
+            moments(i, 2) = zMomentSum;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,905 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Batched inverse dynamics over the frames of a trial. Frames are solved in
+// parallel, one model replica per OpenMP thread. Ground contact surfaces,
+// when given, are evaluated on the same State as the solve and applied as
+// body forces, so spring kinematics, contact forces and inverse dynamics
+// take one pass per frame.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Marleny Vega, Spencer Williams                               //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_INVERSE_DYNAMICS_KERNEL_H
+#define NMSM_INVERSE_DYNAMICS_KERNEL_H
+
+#include <OpenSim/OpenSim.h>
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CoordinateBinding.h"
+#include "FrameChannels.h"
+#include "FrameResultCache.h"
+#include "FrameSchedule.h"
+#include "GroundContactModel.h"
+#include "KernelProfiler.h"
+#include "MatrixView.h"
+#include "ModelReplicaPool.h"
+
+// Springs attached to one body of a contact surface
+struct ContactSpringBody {
+    SimTK::MobilizedBodyIndex body;
+    std::vector<SimTK::Vec3> stations;
+    std::vector<double> springConstants;
+};
+
+struct ContactSurface {
+    ContactSpringBody parent;
+    ContactSpringBody child;
+    SimTK::MobilizedBodyIndex midfootSuperiorBody;
+    SimTK::Vec3 midfootSuperiorStation;
+    ContactSurfaceParameters parameters;
+};
+
+// Sums the spring forces of one body and their moment about the midfoot
+// superior point projected onto the floor. The State must be realized to
+// Velocity.
+inline void sumContactSpringLoads(const SimTK::SimbodyMatterSubsystem& matter,
+        const SimTK::State& state, const ContactSpringBody& springs,
+        const ContactSurfaceParameters& parameters,
+        const SimTK::Vec3& midfootSuperior, SimTK::Vec3& force,
+        SimTK::Vec3& moment) {
+    const SimTK::MobilizedBody& body = matter.getMobilizedBody(springs.body);
+    force = SimTK::Vec3(0.0);
+    moment = SimTK::Vec3(0.0);
+    for (size_t j = 0; j < springs.stations.size(); j++) {
+        const SimTK::Vec3 position = body.findStationLocationInGround(state,
+            springs.stations[j]);
+        const SimTK::Vec3 velocity = body.findStationVelocityInGround(state,
+            springs.stations[j]);
+        double springForce[3];
+        calcSpringForce(springs.springConstants[j], position[1],
+            velocity[0], velocity[1], velocity[2], parameters, springForce);
+        const SimTK::Vec3 springForceVec(springForce[0], springForce[1],
+            springForce[2]);
+        const SimTK::Vec3 offset(position[0] - midfootSuperior[0], 0.0,
+            position[2] - midfootSuperior[2]);
+        force += springForceVec;
+        moment += offset % springForceVec;
+    }
+}
+
+// Forces given for each frame and applied to bodies at stations, such as
+// ground reactions calculated outside the kernel. values has six columns
+// per body: the force and then the moment about the station, in ground.
+struct FrameBodyForces {
+    std::vector<SimTK::MobilizedBodyIndex> bodies;
+    // Points of application in the body frames
+    std::vector<SimTK::Vec3> stations;
+    MatrixView values;
+
+    bool isEmpty() const { return bodies.empty(); }
+};
+
+// Adds the given forces of a frame to bodyForces, shifted to the body
+// origins. The State must be realized to Position.
+inline void applyFrameBodyForces(const SimTK::SimbodyMatterSubsystem& matter,
+        const SimTK::State& state, const FrameBodyForces& forces, int frame,
+        SimTK::Vector_<SimTK::SpatialVec>& bodyForces) {
+    for (int j = 0; j < (int) forces.bodies.size(); j++) {
+        const SimTK::Vec3 force(forces.values(frame, 6 * j),
+            forces.values(frame, 6 * j + 1), forces.values(frame, 6 * j + 2));
+        const SimTK::Vec3 moment(forces.values(frame, 6 * j + 3),
+            forces.values(frame, 6 * j + 4), forces.values(frame, 6 * j + 5));
+        // Station relative to the body origin, in ground
+        const SimTK::Vec3 offset = matter.getMobilizedBody(forces.bodies[j])
+            .getBodyRotation(state) * forces.stations[j];
+        bodyForces[forces.bodies[j]] += SimTK::SpatialVec(
+            moment + offset % force, force);
+    }
+}
+
+// Inputs are frames x columns. Columns of q, qp and qpp follow the
+// coordinate binding, columns of controls follow the model controls.
+struct InverseDynamicsInputs {
+    const double* time = nullptr;
+    MatrixView q;
+    MatrixView qp;
+    MatrixView qpp;
+    MatrixView controls;
+    MatrixView muscleActivations;
+    std::vector<SimTK::MobilizedBodyIndex> orientationBodies;
+    bool computeAngularMomentum = false;
+    bool computeMetabolicCost = false;
+    bool computeBodyOrientation = false;
+    std::vector<ContactSurface> contactSurfaces;
+    std::vector<SimTK::MobilizedBodyIndex> markerBodies;
+    std::vector<SimTK::Vec3> markerStations;
+    // Quantities requested from each frame's State, written to the output
+    // channel of the same index
+    std::vector<FrameChannel> channels;
+    // Muscles apply no force in the solve, as with the muscles excluded by
+    // OpenSim's inverse dynamics tool, so their forces are not evaluated
+    bool excludeMuscleForces = false;
+    // Added to the body forces of the solve, so loads such as ground
+    // reactions need no actuators in the model or columns of controls
+    FrameBodyForces bodyForces;
+};
+
+// Outputs are frames x columns with three columns per vector quantity.
+// Outputs for disabled calculations are not written.
+struct InverseDynamicsOutputs {
+    OutputMatrixView idLoads;
+    OutputMatrixView angularMomentum;
+    OutputMatrixView metabolicCost;
+    OutputMatrixView bodyOrientations;
+    // x velocity of the mass center at the first and last frame, not
+    // written if null
+    double* massCenterVelocity = nullptr;
+    // Lab frame ground reactions of each contact surface, with moments
+    // about the midfoot superior point projected onto the floor
+    OutputMatrixView groundReactionForces;
+    OutputMatrixView groundReactionMoments;
+    OutputMatrixView midfootSuperiorPositions;
+    OutputMatrixView markerPositions;
+    OutputMatrixView markerVelocities;
+    // Frames x columns of each requested channel
+    std::vector<OutputMatrixView> channels;
+};
+
+// Evaluates the contact surfaces on a State realized to Velocity, adds the
+// loads to bodyForces at the parent and child body origins and writes the
+// lab frame reactions for the frame unless those outputs are empty.
+inline void applyGroundContact(const SimTK::SimbodyMatterSubsystem& matter,
+        const SimTK::State& state,
+        const std::vector<ContactSurface>& surfaces, int frame,
+        SimTK::Vector_<SimTK::SpatialVec>& bodyForces,
+        const InverseDynamicsOutputs& outputs) {
+    for (int s = 0; s < (int) surfaces.size(); s++) {
+        const ContactSurface& surface = surfaces[s];
+        SimTK::Vec3 midfootSuperior = matter.getMobilizedBody(
+            surface.midfootSuperiorBody).findStationLocationInGround(state,
+            surface.midfootSuperiorStation);
+        midfootSuperior[1] = surface.parameters.restingSpringLength;
+
+        SimTK::Vec3 parentForce, parentMoment, childForce, childMoment;
+        sumContactSpringLoads(matter, state, surface.parent,
+            surface.parameters, midfootSuperior, parentForce, parentMoment);
+        sumContactSpringLoads(matter, state, surface.child,
+            surface.parameters, midfootSuperior, childForce, childMoment);
+
+        // Moments are transferred from the midfoot superior point to the
+        // body origins, as in transferMoments.m
+        const SimTK::Vec3& parentOrigin = matter.getMobilizedBody(
+            surface.parent.body).getBodyOriginLocation(state);
+        const SimTK::Vec3& childOrigin = matter.getMobilizedBody(
+            surface.child.body).getBodyOriginLocation(state);
+        bodyForces[surface.parent.body] += SimTK::SpatialVec(
+            (midfootSuperior - parentOrigin) % parentForce + parentMoment,
+            parentForce);
+        bodyForces[surface.child.body] += SimTK::SpatialVec(
+            (midfootSuperior - childOrigin) % childForce + childMoment,
+            childForce);
+
+        if (outputs.groundReactionForces.isEmpty()) {
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            outputs.groundReactionForces(frame, s * 3 + k) =
+                parentForce[k] + childForce[k];
+            outputs.groundReactionMoments(frame, s * 3 + k) =
+                parentMoment[k] + childMoment[k];
+            outputs.midfootSuperiorPositions(frame, s * 3 + k) =
+                midfootSuperior[k];
+        }
+    }
+}
+
+// Writes the time, coordinate values and speeds of a frame into the State.
+// Locked coordinates keep their value, as in Coordinate::setValue.
+inline void setFrameCoordinates(SimTK::State& state,
+        const CoordinateBinding& binding, const InverseDynamicsInputs& inputs,
+        int frame) {
+    const int numLabels = (int) binding.labels.size();
+    const int* stateIndex = binding.stateIndex.data();
+    const char* isLocked = binding.isLocked.data();
+    state.setTime(inputs.time[frame]);
+    SimTK::Vector& stateQ = state.updQ();
+    for (int k = 0; k < numLabels; k++){
+        if (!isLocked[k]) {
+            stateQ[stateIndex[k]] = inputs.q(frame, k);
+        }
+    }
+    SimTK::Vector& stateU = state.updU();
+    for (int k = 0; k < numLabels; k++){
+        stateU[stateIndex[k]] = inputs.qp(frame, k);
+    }
+}
+
+// Fills the model-sized controls and accelerations of a frame. Controls
+// beyond the given columns and accelerations of unlisted coordinates are 0.
+inline void getFrameControlsAndAccelerations(const CoordinateBinding& binding,
+        const InverseDynamicsInputs& inputs, int frame,
+        SimTK::Vector& controls, SimTK::Vector& accelerations) {
+    const int numLabels = (int) binding.labels.size();
+    const int numControls = inputs.controls.columns;
+    controls.resize(binding.numModelControls);
+    controls = 0.0;
+    for (int j = 0; j < numControls && j < binding.numModelControls; j++){
+        controls[j] = inputs.controls(frame, j);
+    }
+    accelerations.resize(binding.numStateCoordinates);
+    accelerations = 0.0;
+    for (int k = 0; k < numLabels; k++){
+        accelerations[binding.stateIndex[k]] = inputs.qpp(frame, k);
+    }
+}
+
+// Applies the controls, realizes Dynamics and solves for the generalized
+// forces in idLoads, as InverseDynamicsSolver::solve(state, udot) does but
+// without allocating the result. The State must belong to the replica's
+// System. Contact reactions are written to outputs for the frame when the
+// ground reaction outputs are not empty. The stages are timed for the
+// thread if a profiler is given. Returns the body forces of the solve,
+// including contact and the given body forces, which stay valid until the
+// State or the replica's workspace changes.
+inline const SimTK::Vector_<SimTK::SpatialVec>& solveFrameInverseDynamics(
+        ModelReplica& replica, SimTK::State& state,
+        const InverseDynamicsInputs& inputs, const SimTK::Vector& controls,
+        const SimTK::Vector& accelerations, int frame,
+        const InverseDynamicsOutputs& outputs, SimTK::Vector& idLoads,
+        KernelProfiler* profiler = nullptr, int thread = 0) {
+    OpenSim::Model& model = *replica.model;
+    {
+        ProfileScope scope(profiler, thread, profileRealizeDynamics);
+        model.setControls(state, controls);
+        model.markControlsAsValid(state);
+        model.realizeDynamics(state);
+    }
+    ProfileScope scope(profiler, thread, profileInverseDynamicsSolve);
+    const SimTK::MultibodySystem& system = model.getMultibodySystem();
+    const SimTK::Vector_<SimTK::SpatialVec>* bodyForces =
+        &system.getRigidBodyForces(state, SimTK::Stage::Dynamics);
+    if (!inputs.contactSurfaces.empty() || !inputs.bodyForces.isEmpty()) {
+        SimTK::Vector_<SimTK::SpatialVec>& addedBodyForces =
+            replica.workspace.bodyForces;
+        addedBodyForces = *bodyForces;
+        applyGroundContact(model.getMatterSubsystem(), state,
+            inputs.contactSurfaces, frame, addedBodyForces, outputs);
+        applyFrameBodyForces(model.getMatterSubsystem(), state,
+            inputs.bodyForces, frame, addedBodyForces);
+        bodyForces = &addedBodyForces;
+    }
+    model.getMatterSubsystem().calcResidualForceIgnoringConstraints(state,
+        system.getMobilityForces(state, SimTK::Stage::Dynamics), *bodyForces,
+        accelerations, idLoads);
+    return *bodyForces;
+}
+
+// Hash of the binding and requested outputs of a call. The first and last
+// frames also cache the mass center velocity, so they use their own
+// request.
+inline std::uint64_t getInverseDynamicsCacheRequest(
+        const CoordinateBinding& binding, const InverseDynamicsInputs& inputs,
+        bool isBoundaryFrame) {
+    std::uint64_t request = hashCoordinateBinding(0x4944u, binding);
+    request = mixFrameCacheHash(request, inputs.controls.columns);
+    request = mixFrameCacheHash(request, isBoundaryFrame);
+    request = mixFrameCacheHash(request, inputs.computeAngularMomentum);
+    request = mixFrameCacheHash(request, inputs.computeMetabolicCost);
+    if (inputs.computeMetabolicCost) {
+        request = mixFrameCacheHash(request,
+            inputs.muscleActivations.columns);
+    }
+    request = mixFrameCacheHash(request, inputs.computeBodyOrientation);
+    request = mixFrameCacheHash(request, inputs.excludeMuscleForces);
+    for (const SimTK::MobilizedBodyIndex& body : inputs.orientationBodies) {
+        request = mixFrameCacheHash(request, (int) body);
+    }
+    return request;
+}
+
+// The cache key of a frame is its time, coordinate values, speeds and
+// accelerations, the controls the kernel reads and, with metabolic cost,
+// the muscle activations.
+inline void makeInverseDynamicsCacheKey(const CoordinateBinding& binding,
+        const InverseDynamicsInputs& inputs, int frame,
+        std::uint64_t request, FrameCacheKey& key) {
+    const int numLabels = (int) binding.labels.size();
+    key.reset(request);
+    key.append(inputs.time[frame]);
+    key.appendRow(inputs.q, frame, numLabels);
+    key.appendRow(inputs.qp, frame, numLabels);
+    key.appendRow(inputs.qpp, frame, numLabels);
+    key.appendRow(inputs.controls, frame,
+        std::min(inputs.controls.columns, binding.numModelControls));
+    if (inputs.computeMetabolicCost) {
+        key.appendRow(inputs.muscleActivations, frame,
+            inputs.muscleActivations.columns);
+    }
+    key.finish();
+}
+
+// Copies the cached outputs of a frame from the outputs to row, or from row
+// to the outputs, in the order of loads, angular momentum, metabolic cost,
+// body orientations and the mass center velocity of the first and last
+// frames, if it is an output. Returns the row length, and only counts it if
+// row is null.
+inline int copyCachedInverseDynamicsFrame(const InverseDynamicsInputs& inputs,
+        const InverseDynamicsOutputs& outputs, int frame, int numPts,
+        bool isToRow, double* row) {
+    int length = 0;
+    auto copy = [&](double& output) {
+        if (row != nullptr) {
+            if (isToRow) {
+                row[length] = output;
+            } else {
+                output = row[length];
+            }
+        }
+        length++;
+    };
+    for (int j = 0; j < outputs.idLoads.columns; j++) {
+        copy(outputs.idLoads(frame, j));
+    }
+    if (inputs.computeAngularMomentum) {
+        for (int j = 0; j < 3; j++) {
+            copy(outputs.angularMomentum(frame, j));
+        }
+    }
+    if (inputs.computeMetabolicCost) {
+        copy(outputs.metabolicCost(frame, 0));
+    }
+    if (inputs.computeBodyOrientation) {
+        for (int j = 0; j < outputs.bodyOrientations.columns; j++) {
+            copy(outputs.bodyOrientations(frame, j));
+        }
+    }
+    if (outputs.massCenterVelocity != nullptr) {
+        if (frame == 0) {
+            copy(outputs.massCenterVelocity[0]);
+        } else if (frame == numPts - 1) {
+            copy(outputs.massCenterVelocity[1]);
+        }
+    }
+    return length;
+}
+
+// Solves every frame of the inputs. The binding must come from a replica of
+// the pool. Returns an empty string or the first error raised by a frame.
+// Frames found in an enabled cache are copied instead of solved. Calls with
+// contact surfaces, markers, output channels or given body forces do not
+// use the cache.
+// Stages are timed per thread if a profiler is given.
+inline std::string calcInverseDynamics(ModelReplicaPool& modelPool,
+        const CoordinateBinding& binding, const InverseDynamicsInputs& inputs,
+        const InverseDynamicsOutputs& outputs,
+        FrameResultCache* cache = nullptr,
+        KernelProfiler* profiler = nullptr) {
+    const int numPts = inputs.q.rows;
+    const int numCoords = binding.numStateCoordinates;
+    const int numMuscles = inputs.muscleActivations.columns;
+    const int numBodies = (int) inputs.orientationBodies.size();
+    const int numMarkers = (int) inputs.markerStations.size();
+    const bool useCache = cache != nullptr && cache->isEnabled() &&
+        inputs.contactSurfaces.empty() && inputs.markerStations.empty() &&
+        inputs.channels.empty() && inputs.bodyForces.isEmpty();
+    const bool hasJointReactions = hasJointReactionChannel(inputs.channels);
+    const std::uint64_t cacheRequest = useCache ?
+        getInverseDynamicsCacheRequest(binding, inputs, false) : 0;
+    // Without the mass center velocity output the first and last rows are
+    // like the others
+    const std::uint64_t boundaryCacheRequest = useCache ?
+        getInverseDynamicsCacheRequest(binding, inputs,
+        outputs.massCenterVelocity != nullptr) : 0;
+    if (profiler != nullptr) {
+        profiler->prepare(modelPool.getNumThreads());
+    }
+
+    // No MATLAB API calls are allowed in this region. Errors are stored
+    // and reported after the region ends.
+    // Metabolic and contact frames cost more and cache hits cost almost
+    // nothing, so those calls take chunks of frames on demand
+    const FrameSchedule schedule = modelPool.planSchedule(numPts,
+        useCache || inputs.computeMetabolicCost ||
+        !inputs.contactSurfaces.empty());
+    std::string parallelError;
+    runFrameSchedule(schedule, numPts, [&](int thread_id, int i) {
+        try {
+            if (profiler != nullptr) {
+                profiler->addFrame(thread_id);
+            }
+            ModelReplica& replica = modelPool.acquire(thread_id);
+            FrameWorkspace& workspace = replica.workspace;
+            FrameCacheKey& cacheKey = workspace.cacheKey;
+            std::vector<double>& cachedRow = workspace.cachedRow;
+            if (useCache) {
+                ProfileScope scope(profiler, thread_id, profileOutputWrites);
+                makeInverseDynamicsCacheKey(binding, inputs, i,
+                    i == 0 || i == numPts - 1 ? boundaryCacheRequest :
+                    cacheRequest, cacheKey);
+                cachedRow.resize(copyCachedInverseDynamicsFrame(inputs,
+                    outputs, i, numPts, false, nullptr));
+                if (cache->find(cacheKey, cachedRow.data(),
+                        cachedRow.size())) {
+                    copyCachedInverseDynamicsFrame(inputs, outputs, i,
+                        numPts, false, cachedRow.data());
+                    return;
+                }
+            }
+            OpenSim::Model& model = *replica.model;
+            SimTK::State& state = *replica.state;
+            const SimTK::SimbodyMatterSubsystem& matter =
+                model.getMatterSubsystem();
+            {
+                ProfileScope scope(profiler, thread_id,
+                    profileCoordinateSetting);
+                replica.setMusclesApplyForce(!inputs.excludeMuscleForces);
+                setFrameCoordinates(state, binding, inputs, i);
+            }
+            {
+                ProfileScope scope(profiler, thread_id,
+                    profileRealizeVelocity);
+                model.realizeVelocity(state);
+            }
+            if (inputs.computeAngularMomentum) {
+                ProfileScope scope(profiler, thread_id,
+                    profileAngularMomentum);
+                SimTK::SpatialVec momentum =
+                    matter.calcSystemCentralMomentum(state);
+                SimTK::Vec3 angularMomentumPoint = momentum.get(0);
+                for (int j = 0; j <= 2; j++) {
+                    outputs.angularMomentum(i, j) =
+                        angularMomentumPoint.get(j);
+                }
+            }
+
+            if (outputs.massCenterVelocity != nullptr &&
+                    (i == 0 || i == numPts - 1)) {
+                outputs.massCenterVelocity[i == 0 ? 0 : 1] =
+                    model.calcMassCenterVelocity(state).get(0);
+            }
+
+            if (numMarkers > 0) {
+                ProfileScope scope(profiler, thread_id, profileOutputWrites);
+                for (int j = 0; j < numMarkers; j++) {
+                    const SimTK::MobilizedBody& body =
+                        matter.getMobilizedBody(inputs.markerBodies[j]);
+                    const SimTK::Vec3 position =
+                        body.findStationLocationInGround(state,
+                        inputs.markerStations[j]);
+                    const SimTK::Vec3 velocity =
+                        body.findStationVelocityInGround(state,
+                        inputs.markerStations[j]);
+                    for (int k = 0; k < 3; k++) {
+                        outputs.markerPositions(i, j * 3 + k) = position[k];
+                        outputs.markerVelocities(i, j * 3 + k) = velocity[k];
+                    }
+                }
+            }
+            if (!inputs.channels.empty()) {
+                ProfileScope scope(profiler, thread_id, profileOutputChannels);
+                writeKinematicChannels(matter, state, inputs.channels,
+                    outputs.channels, i);
+            }
+
+            getFrameControlsAndAccelerations(binding, inputs, i,
+                workspace.controls, workspace.accelerations);
+            const SimTK::Vector_<SimTK::SpatialVec>& appliedBodyForces =
+                solveFrameInverseDynamics(replica, state, inputs,
+                workspace.controls, workspace.accelerations, i, outputs,
+                workspace.idLoads, profiler, thread_id);
+            {
+                ProfileScope scope(profiler, thread_id, profileOutputWrites);
+                for (int j = 0; j < numCoords; j++){
+                    outputs.idLoads(i, j) = workspace.idLoads[j];
+                }
+            }
+            if (hasJointReactions) {
+                ProfileScope scope(profiler, thread_id, profileOutputChannels);
+                writeJointReactionChannels(matter, state,
+                    workspace.accelerations, appliedBodyForces,
+                    inputs.channels, outputs.channels, i,
+                    workspace.bodyAccelerations, workspace.subtreeForces);
+            }
+
+            if (inputs.computeBodyOrientation) {
+                ProfileScope scope(profiler, thread_id,
+                    profileBodyOrientation);
+                for (int j = 0; j < numBodies; j++) {
+                    SimTK::Vec3 bodyOrientationVec = matter.getMobilizedBody(
+                        inputs.orientationBodies[j]).getBodyRotation(state)
+                        .convertRotationToBodyFixedXYZ();
+                    outputs.bodyOrientations(i, j * 3) = bodyOrientationVec(0);
+                    outputs.bodyOrientations(i, j * 3 + 1) = bodyOrientationVec(1);
+                    outputs.bodyOrientations(i, j * 3 + 2) = bodyOrientationVec(2);
+                }
+            }
+
+            if (inputs.computeMetabolicCost) {
+                ProfileScope scope(profiler, thread_id, profileMetabolicCost);
+                // The probe needs the muscles even when the solve excluded
+                // them
+                replica.setMusclesApplyForce(true);
+                for (int j = 0; j < numMuscles; j++) {
+                    replica.muscles[j]->setActivation(state,
+                        inputs.muscleActivations(i, j));
+                }
+                model.realizeDynamics(state);
+                model.equilibrateMuscles(state);
+                outputs.metabolicCost(i, 0) = model.getProbeSet().get(0)
+                    .getProbeOutputs(state).get(0);
+            }
+
+            if (useCache) {
+                ProfileScope scope(profiler, thread_id, profileOutputWrites);
+                copyCachedInverseDynamicsFrame(inputs, outputs, i, numPts,
+                    true, cachedRow.data());
+                cache->insert(cacheKey, cachedRow.data(), cachedRow.size());
+            }
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(inverseDynamicsError)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    });
+    return parallelError;
+}
+
+// Frame States realized to Velocity and kept between calls, so calls that
+// only change controls or accelerations skip the position and velocity
+// kinematics. A State is only realized by the System of the replica that
+// made it, so each replica owns one contiguous block of frames.
+struct RetainedFrameKinematics {
+    CoordinateBinding binding;
+    std::vector<SimTK::State> states;
+    // Whether the muscles apply force in each State, which is changed
+    // only when a call excludes them or includes them again
+    std::vector<char> musclesApplyForce;
+    // Frames of replica r are [blockStarts[r], blockStarts[r + 1])
+    std::vector<int> blockStarts;
+
+    bool isEmpty() const { return states.empty(); }
+    int getNumFrames() const { return (int) states.size(); }
+    void clear() {
+        states.clear();
+        musclesApplyForce.clear();
+        blockStarts.clear();
+    }
+};
+
+// Schedule of the retained blocks. Each block is one chunk because its
+// States can only be used with the replica of the same index.
+inline FrameSchedule planRetainedBlockSchedule(ModelReplicaPool& modelPool,
+        int numBlocks) {
+    FrameSchedule schedule = modelPool.planSchedule(numBlocks, false);
+    schedule.grain = 1;
+    return schedule;
+}
+
+// Sets the time, coordinate values and speeds of each frame of the inputs
+// and keeps the States realized to Velocity. Returns an empty string or the
+// first error raised by a frame.
+inline std::string retainFrameKinematics(ModelReplicaPool& modelPool,
+        const CoordinateBinding& binding, const InverseDynamicsInputs& inputs,
+        RetainedFrameKinematics& retained) {
+    const int numPts = inputs.q.rows;
+    // One block per thread the schedule would use for these frames
+    const int numBlocks = modelPool.planSchedule(numPts, false).numThreads;
+    retained.clear();
+    retained.binding = binding;
+    retained.states.resize(numPts);
+    retained.musclesApplyForce.assign(numPts, 1);
+    retained.blockStarts.resize(numBlocks + 1);
+    for (int r = 0; r <= numBlocks; r++) {
+        retained.blockStarts[r] = (int) ((long long) numPts * r / numBlocks);
+    }
+
+    std::string parallelError;
+    runFrameSchedule(planRetainedBlockSchedule(modelPool, numBlocks),
+            numBlocks, [&](int, int r) {
+        if (retained.blockStarts[r] == retained.blockStarts[r + 1]) {
+            return;
+        }
+        try {
+            ModelReplica& replica = modelPool.acquire(r);
+            replica.setMusclesApplyForce(true);
+            for (int i = retained.blockStarts[r];
+                    i < retained.blockStarts[r + 1]; i++) {
+                setFrameCoordinates(*replica.state, binding, inputs, i);
+                replica.model->realizeVelocity(*replica.state);
+                // Copies keep the realized cache entries
+                retained.states[i] = *replica.state;
+            }
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(inverseDynamicsError)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    });
+    if (!parallelError.empty()) {
+        retained.clear();
+    }
+    return parallelError;
+}
+
+// Realizes the retained frames again with the replicas' current Systems,
+// after they were rebuilt for new model parameters. A State only belongs
+// to the System that made it, so the time, values and speeds are copied
+// into a State of the rebuilt System. Returns an empty string or the first
+// error raised by a frame.
+inline std::string refreshRetainedFrameKinematics(
+        ModelReplicaPool& modelPool, RetainedFrameKinematics& retained) {
+    const int numBlocks = (int) retained.blockStarts.size() - 1;
+    std::string parallelError;
+    runFrameSchedule(planRetainedBlockSchedule(modelPool, numBlocks),
+            numBlocks, [&](int, int r) {
+        if (retained.blockStarts[r] == retained.blockStarts[r + 1]) {
+            return;
+        }
+        try {
+            ModelReplica& replica = modelPool.acquire(r);
+            replica.setMusclesApplyForce(true);
+            SimTK::State& state = *replica.state;
+            for (int i = retained.blockStarts[r];
+                    i < retained.blockStarts[r + 1]; i++) {
+                const SimTK::State& previous = retained.states[i];
+                state.setTime(previous.getTime());
+                state.setQ(previous.getQ());
+                state.setU(previous.getU());
+                replica.model->realizeVelocity(state);
+                retained.states[i] = state;
+                retained.musclesApplyForce[i] = 1;
+            }
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(inverseDynamicsError)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    });
+    if (!parallelError.empty()) {
+        retained.clear();
+    }
+    return parallelError;
+}
+
+// Solves every retained frame with the accelerations, controls, contact
+// surfaces, body forces and muscle setting of the inputs, whose rows are
+// the retained frames and whose columns follow the retained binding. Only
+// the Dynamics and later stages of the retained States are invalidated,
+// so the cost is the force evaluation and the solve. A call that changes
+// whether muscles apply force realizes the kinematics of its frames again,
+// once. Returns an empty string or the first error raised by a frame.
+inline std::string calcRetainedInverseDynamics(ModelReplicaPool& modelPool,
+        RetainedFrameKinematics& retained, const InverseDynamicsInputs& inputs,
+        const InverseDynamicsOutputs& outputs,
+        KernelProfiler* profiler = nullptr) {
+    const int numThreads = (int) retained.blockStarts.size() - 1;
+    const int numCoords = retained.binding.numStateCoordinates;
+    const char applyMuscleForces = inputs.excludeMuscleForces ? 0 : 1;
+    if (profiler != nullptr) {
+        profiler->prepare(numThreads);
+    }
+
+    std::string parallelError;
+    runFrameSchedule(planRetainedBlockSchedule(modelPool, numThreads),
+            numThreads, [&](int, int r) {
+        if (retained.blockStarts[r] == retained.blockStarts[r + 1]) {
+            return;
+        }
+        try {
+            ModelReplica& replica = modelPool.acquire(r);
+            FrameWorkspace& workspace = replica.workspace;
+            for (int i = retained.blockStarts[r];
+                    i < retained.blockStarts[r + 1]; i++) {
+                if (profiler != nullptr) {
+                    profiler->addFrame(r);
+                }
+                SimTK::State& state = retained.states[i];
+                if (retained.musclesApplyForce[i] != applyMuscleForces) {
+                    // The setting is an Instance variable, so changing it
+                    // invalidates the retained kinematics
+                    replica.setMusclesApplyForce(state,
+                        applyMuscleForces != 0);
+                    replica.model->realizeVelocity(state);
+                    retained.musclesApplyForce[i] = applyMuscleForces;
+                }
+                // Forces of the previous call's controls are cached at
+                // Dynamics
+                state.invalidateAllCacheAtOrAbove(SimTK::Stage::Dynamics);
+                getFrameControlsAndAccelerations(retained.binding, inputs, i,
+                    workspace.controls, workspace.accelerations);
+                solveFrameInverseDynamics(replica, state, inputs,
+                    workspace.controls, workspace.accelerations, i, outputs,
+                    workspace.idLoads, profiler, r);
+                ProfileScope scope(profiler, r, profileOutputWrites);
+                for (int j = 0; j < numCoords; j++){
+                    outputs.idLoads(i, j) = workspace.idLoads[j];
+                }
+            }
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(inverseDynamicsError)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    });
+    return parallelError;
+}
+
+// Per-frame blocks of the inverse dynamics Jacobian. Each block is
+// coordinates x columns and the blocks of all frames are stored one after
+// another, so a block is a column-major matrix at frame * rows * columns.
+// Columns of positions, velocities and accelerations follow the coordinate
+// binding and columns of controls follow the controls input.
+struct InverseDynamicsJacobian {
+    double* positions = nullptr;
+    double* velocities = nullptr;
+    double* accelerations = nullptr;
+    double* controls = nullptr;
+};
+
+// Central difference step for a value
+inline double getDifferenceStep(double value) {
+    // Cube root of machine epsilon balances truncation and rounding error
+    return 6.0554544523933395e-06 * (1.0 + std::fabs(value));
+}
+
+// Solves every frame and differentiates the result with respect to the
+// frame's inputs. Perturbations are applied in place to the replica's
+// State, so each derivative only re-realizes the stages its input affects:
+// controls from Dynamics, speeds from Velocity and values from Position.
+// Derivatives with respect to accelerations are the columns of the mass
+// matrix. Columns for locked coordinates are zero for positions because
+// the kernel does not write their values.
+inline std::string calcInverseDynamicsJacobian(ModelReplicaPool& modelPool,
+        const CoordinateBinding& binding, const InverseDynamicsInputs& inputs,
+        const InverseDynamicsOutputs& outputs,
+        const InverseDynamicsJacobian& jacobian) {
+    const int numPts = inputs.q.rows;
+    const int numLabels = (int) binding.labels.size();
+    const int numCoords = binding.numStateCoordinates;
+    const int numControls = std::min(inputs.controls.columns,
+        binding.numModelControls);
+    const int* stateIndex = binding.stateIndex.data();
+    const char* isLocked = binding.isLocked.data();
+    const std::ptrdiff_t coordinateBlock = (std::ptrdiff_t) numCoords * numLabels;
+    const std::ptrdiff_t controlBlock =
+        (std::ptrdiff_t) numCoords * inputs.controls.columns;
+    // Contact reactions are only written for the unperturbed solve
+    const InverseDynamicsOutputs perturbedOutputs;
+
+    const FrameSchedule schedule = modelPool.planSchedule(numPts,
+        !inputs.contactSurfaces.empty());
+    std::string parallelError;
+    runFrameSchedule(schedule, numPts, [&](int thread_id, int i) {
+        try {
+            ModelReplica& replica = modelPool.acquire(thread_id);
+            OpenSim::Model& model = *replica.model;
+            SimTK::State& state = *replica.state;
+            replica.setMusclesApplyForce(!inputs.excludeMuscleForces);
+            setFrameCoordinates(state, binding, inputs, i);
+            FrameWorkspace& workspace = replica.workspace;
+            SimTK::Vector& controls = workspace.controls;
+            const SimTK::Vector& accelerations = workspace.accelerations;
+            SimTK::Vector& forward = workspace.forwardLoads;
+            SimTK::Vector& backward = workspace.backwardLoads;
+            getFrameControlsAndAccelerations(binding, inputs, i, controls,
+                workspace.accelerations);
+            solveFrameInverseDynamics(replica, state, inputs, controls,
+                accelerations, i, outputs, workspace.idLoads);
+            for (int j = 0; j < numCoords; j++){
+                outputs.idLoads(i, j) = workspace.idLoads[j];
+            }
+
+            // Writes one central difference column of a frame's block
+            auto writeColumn = [&](double* block, int column, double step) {
+                for (int r = 0; r < numCoords; r++) {
+                    block[r + (std::ptrdiff_t) column * numCoords] =
+                        (forward[r] - backward[r]) / (2.0 * step);
+                }
+            };
+
+            SimTK::Matrix& massMatrix = workspace.massMatrix;
+            model.getMatterSubsystem().calcM(state, massMatrix);
+            double* accelerationBlock = jacobian.accelerations +
+                i * coordinateBlock;
+            for (int k = 0; k < numLabels; k++) {
+                for (int r = 0; r < numCoords; r++) {
+                    accelerationBlock[r + (std::ptrdiff_t) k * numCoords] =
+                        massMatrix(r, stateIndex[k]);
+                }
+            }
+
+            double* controlBlockData = jacobian.controls + i * controlBlock;
+            for (int j = numControls * numCoords;
+                    j < inputs.controls.columns * numCoords; j++) {
+                controlBlockData[j] = 0.0;
+            }
+            for (int j = 0; j < numControls; j++) {
+                const double value = controls[j];
+                const double step = getDifferenceStep(value);
+                controls[j] = value + step;
+                solveFrameInverseDynamics(replica, state, inputs, controls,
+                    accelerations, i, perturbedOutputs, forward);
+                controls[j] = value - step;
+                solveFrameInverseDynamics(replica, state, inputs, controls,
+                    accelerations, i, perturbedOutputs, backward);
+                controls[j] = value;
+                writeColumn(controlBlockData, j, step);
+            }
+
+            double* velocityBlock = jacobian.velocities + i * coordinateBlock;
+            for (int k = 0; k < numLabels; k++) {
+                const double value = state.getU()[stateIndex[k]];
+                const double step = getDifferenceStep(value);
+                state.updU()[stateIndex[k]] = value + step;
+                solveFrameInverseDynamics(replica, state, inputs, controls,
+                    accelerations, i, perturbedOutputs, forward);
+                state.updU()[stateIndex[k]] = value - step;
+                solveFrameInverseDynamics(replica, state, inputs, controls,
+                    accelerations, i, perturbedOutputs, backward);
+                state.updU()[stateIndex[k]] = value;
+                writeColumn(velocityBlock, k, step);
+            }
+
+            double* positionBlock = jacobian.positions + i * coordinateBlock;
+            for (int k = 0; k < numLabels; k++) {
+                if (isLocked[k]) {
+                    for (int r = 0; r < numCoords; r++) {
+                        positionBlock[r + (std::ptrdiff_t) k * numCoords] = 0.0;
+                    }
+                    continue;
+                }
+                const double value = state.getQ()[stateIndex[k]];
+                const double step = getDifferenceStep(value);
+                state.updQ()[stateIndex[k]] = value + step;
+                solveFrameInverseDynamics(replica, state, inputs, controls,
+                    accelerations, i, perturbedOutputs, forward);
+                state.updQ()[stateIndex[k]] = value - step;
+                solveFrameInverseDynamics(replica, state, inputs, controls,
+                    accelerations, i, perturbedOutputs, backward);
+                state.updQ()[stateIndex[k]] = value;
+                writeColumn(positionBlock, k, step);
+            }
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(inverseDynamicsError)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    });
+    return parallelError;
+}
+
+#endif
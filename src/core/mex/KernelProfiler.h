@@ -0,0 +1,190 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Per-thread stage timers for the model kernels. Each thread adds to its
+// own counters, so timing a stage costs two clock reads and no locking.
+// When tracing is enabled each timed stage is also kept as an event and
+// can be written as Chrome trace JSON (chrome://tracing or Perfetto).
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_KERNEL_PROFILER_H
+#define NMSM_KERNEL_PROFILER_H
+
+#include <omp.h>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum ProfileStage {
+    profileInputMarshalling,
+    profileCoordinateSetting,
+    profileRealizeVelocity,
+    profileRealizeDynamics,
+    profileInverseDynamicsSolve,
+    profileAngularMomentum,
+    profileBodyOrientation,
+    profileMetabolicCost,
+    profileOutputChannels,
+    profileOutputWrites,
+    numProfileStages
+};
+
+inline const char* getProfileStageName(int stage) {
+    static const char* const names[numProfileStages] = {
+        "inputMarshalling", "coordinateSetting", "realizeVelocity",
+        "realizeDynamics", "inverseDynamicsSolve", "angularMomentum",
+        "bodyOrientation", "metabolicCost", "outputChannels",
+        "outputWrites"};
+    return names[stage];
+}
+
+struct ProfileTraceEvent {
+    int stage;
+    double start;
+    double duration;
+};
+
+// Aligned to a cache line so threads do not share counters
+struct alignas(64) ThreadProfile {
+    double seconds[numProfileStages] = {};
+    long long frames = 0;
+    std::vector<ProfileTraceEvent> events;
+};
+
+class KernelProfiler {
+public:
+    // Trace events beyond this count per thread are dropped
+    static const std::size_t maxTraceEventsPerThread = 1000000;
+
+    // Enables or disables the timers and clears the counters and events
+    void configure(bool isEnabled, bool isTracing) {
+        enabled = isEnabled;
+        tracing = isEnabled && isTracing;
+        origin = omp_get_wtime();
+        threads.clear();
+        calls = 0;
+    }
+
+    bool isEnabled() const { return enabled; }
+    bool isTracing() const { return tracing; }
+
+    // Makes counters for numThreads threads. Called before each parallel
+    // region, never inside one.
+    void prepare(int numThreads) {
+        if (enabled && (int) threads.size() < numThreads) {
+            threads.resize(numThreads);
+        }
+    }
+
+    // Counts a call of the kernel and prepares its threads
+    void beginCall(int numThreads) {
+        if (enabled) {
+            prepare(numThreads);
+            calls++;
+        }
+    }
+
+    double now() const { return omp_get_wtime(); }
+
+    void addStage(int thread, ProfileStage stage, double start) {
+        const double end = omp_get_wtime();
+        ThreadProfile& profile = threads[thread];
+        profile.seconds[stage] += end - start;
+        if (tracing && profile.events.size() < maxTraceEventsPerThread) {
+            profile.events.push_back({stage, start - origin, end - start});
+        }
+    }
+
+    void addFrame(int thread) {
+        if (enabled) {
+            threads[thread].frames++;
+        }
+    }
+
+    long long getNumCalls() const { return calls; }
+    const std::vector<ThreadProfile>& getThreads() const { return threads; }
+
+    // Writes the trace events as Chrome trace JSON with one row per thread.
+    // Returns an empty string or an error.
+    std::string writeChromeTrace(const std::string& fileName,
+            const std::string& processName) const {
+        std::ofstream file(fileName);
+        if (!file) {
+            return "Could not open " + fileName + " for writing.";
+        }
+        // Microsecond times with nanosecond digits
+        file << std::fixed;
+        file.precision(3);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+            "\"args\":{\"name\":\"" << processName << "\"}}";
+        for (std::size_t t = 0; t < threads.size(); t++) {
+            for (const ProfileTraceEvent& event : threads[t].events) {
+                file << ",\n{\"name\":\"" << getProfileStageName(event.stage)
+                    << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t
+                    << ",\"ts\":" << event.start * 1e6
+                    << ",\"dur\":" << event.duration * 1e6 << "}";
+            }
+        }
+        file << "\n]}\n";
+        return file ? std::string() : "Could not write " + fileName + ".";
+    }
+
+private:
+    bool enabled = false;
+    bool tracing = false;
+    double origin = 0.0;
+    long long calls = 0;
+    std::vector<ThreadProfile> threads;
+};
+
+// Times the enclosing block for one thread and stage. Does nothing when
+// the profiler is null or disabled.
+class ProfileScope {
+public:
+    ProfileScope(KernelProfiler* profiler, int thread, ProfileStage stage)
+        : profiler(profiler != nullptr && profiler->isEnabled() ?
+              profiler : nullptr),
+          thread(thread), stage(stage),
+          start(this->profiler != nullptr ? this->profiler->now() : 0.0) {}
+    ~ProfileScope() { stop(); }
+
+    // Ends the timed stage before the end of the block
+    void stop() {
+        if (profiler != nullptr) {
+            profiler->addStage(thread, stage, start);
+            profiler = nullptr;
+        }
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    KernelProfiler* profiler;
+    int thread;
+    ProfileStage stage;
+    double start;
+};
+
+#endif
@@ -0,0 +1,119 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// A worker thread that runs the submitted calls of one model session in
+// order, so the caller can go on with its own work while a batch of frames
+// is solved and can keep several batches in flight. The parallelism of
+// each call is unchanged: the worker starts the call's OpenMP team the way
+// the caller's thread would.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_KERNEL_TASK_QUEUE_H
+#define NMSM_KERNEL_TASK_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+// Calls are run one at a time in the order they were submitted. A call's
+// exception is kept in its future. Calls must not submit to or drain their
+// own queue.
+class KernelTaskQueue {
+public:
+    KernelTaskQueue() = default;
+    KernelTaskQueue(const KernelTaskQueue&) = delete;
+    KernelTaskQueue& operator=(const KernelTaskQueue&) = delete;
+
+    ~KernelTaskQueue() { stop(); }
+
+    // Finishes the submitted calls and stops the worker until the next
+    // call is submitted. Owners stop the queue before a shared library is
+    // unloaded, where joining a thread can deadlock on Windows.
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            isStopping = true;
+        }
+        changed.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        isStopping = false;
+    }
+
+    // Queues a call and returns the future that it completes. The worker
+    // is started by the first call.
+    std::future<void> submit(std::function<void()> call) {
+        std::packaged_task<void()> task(std::move(call));
+        std::future<void> result = task.get_future();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            pending.push_back(std::move(task));
+            if (!worker.joinable()) {
+                worker = std::thread(&KernelTaskQueue::run, this);
+            }
+        }
+        changed.notify_all();
+        return result;
+    }
+
+    // Waits until every submitted call has finished
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return pending.empty() && !isRunning; });
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this]() {
+                return isStopping || !pending.empty();
+            });
+            if (pending.empty()) {
+                return;
+            }
+            std::packaged_task<void()> task = std::move(pending.front());
+            pending.pop_front();
+            isRunning = true;
+            lock.unlock();
+            task();
+            lock.lock();
+            isRunning = false;
+            changed.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::packaged_task<void()>> pending;
+    bool isRunning = false;
+    bool isStopping = false;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,67 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Non-owning views over column-major (MATLAB layout) matrices. The kernels
+// read inputs and write outputs through these views so no data is copied
+// or transposed between the caller's buffers and the frame loops.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Marleny Vega, Spencer Williams                               //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MATRIX_VIEW_H
+#define NMSM_MATRIX_VIEW_H
+
+#include <cstddef>
+
+// The leading dimension is the distance between columns, which is the row
+// count for a whole MATLAB matrix and larger for a block of rows.
+template <class T>
+struct BasicMatrixView {
+    T* data = nullptr;
+    int rows = 0;
+    int columns = 0;
+    std::ptrdiff_t leadingDimension = 0;
+
+    BasicMatrixView() {}
+    BasicMatrixView(T* data, int rows, int columns)
+        : data(data), rows(rows), columns(columns),
+          leadingDimension(rows) {}
+    BasicMatrixView(T* data, int rows, int columns,
+            std::ptrdiff_t leadingDimension)
+        : data(data), rows(rows), columns(columns),
+          leadingDimension(leadingDimension) {}
+
+    T& operator()(int row, int column) const {
+        return data[row + column * leadingDimension];
+    }
+    bool isEmpty() const { return rows == 0 || columns == 0; }
+
+    // View of rows [firstRow, firstRow + numRows) sharing this buffer
+    BasicMatrixView rowBlock(int firstRow, int numRows) const {
+        return BasicMatrixView(data + firstRow, numRows, columns,
+            leadingDimension);
+    }
+};
+
+typedef BasicMatrixView<const double> MatrixView;
+typedef BasicMatrixView<double> OutputMatrixView;
+
+#endif
@@ -0,0 +1,271 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Native muscle metabolic power models evaluated from muscle activations
+// and normalized fiber kinematics, without equilibrating the muscles of an
+// OpenSim model. The Bhargava model matches calcBhargavaMetabolicCost.m,
+// including its smoothing, and the Umberger model follows Umberger et al.
+// (2003) with the 2010 treatment of stretched fibers. Both can return the
+// derivative of the metabolic power with respect to each muscle
+// activation. This header does not depend on MATLAB.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_METABOLIC_COST_MODEL_H
+#define NMSM_METABOLIC_COST_MODEL_H
+
+#include <cmath>
+#include "MatrixView.h"
+#include "MuscleTendonModel.h"
+
+enum MetabolicModel {
+    bhargavaMetabolicModel,
+    umbergerMetabolicModel
+};
+
+// Muscle constants shared by both models
+const double muscleSpecificStress = 610e3; // N/square meters
+const double muscleDensity = 1059.7; // kg/cubic meters
+const double fastTwitchFraction = 0.5;
+// Basal rate is basalCoefficient * mass ^ basalExponent
+const double basalCoefficient = 1.2;
+const double basalExponent = 1.0;
+
+struct MetabolicMuscleParameters {
+    MuscleParameter maxIsometricForce;
+    MuscleParameter optimalFiberLength;
+    MuscleParameter vMaxFactor;
+    MuscleParameter pennationAngle;
+};
+
+// Metabolic power of one muscle and its derivative with respect to
+// activation
+struct MuscleMetabolicRate {
+    double power = 0.0;
+    double derivative = 0.0;
+};
+
+// Per-muscle terms of calcBhargavaMetabolicCost.m. The derivative follows
+// the same steps, with d holding the derivative of each quantity.
+inline MuscleMetabolicRate calcBhargavaMuscleRate(double activation,
+        double fiberLength, double fiberVelocity, double maxIsometricForce,
+        double optimalFiberLength, double vMaxFactor, double pennationAngle) {
+    const double pi = 3.14159265358979323846;
+    // Smoothing of the total power, the heat rate and the fiber velocity
+    const double b1 = 10.0;
+    const double b2 = 10.0;
+    const double b3 = 10.0;
+    const double r = fastTwitchFraction;
+
+    const double sine = std::sin(pi / 2 * activation);
+    const double cosine = std::cos(pi / 2 * activation);
+    const double fastActivation = r * (1 - cosine);
+    const double dFastActivation = r * pi / 2 * sine;
+    const double slowActivation = (1 - r) * sine;
+    const double dSlowActivation = (1 - r) * pi / 2 * cosine;
+    const double forceVelocity = calcForceVelocity(fiberVelocity);
+    const double dContractileForce = maxIsometricForce *
+        calcActiveForceLength(fiberLength) * forceVelocity;
+    const double contractileForce = activation * dContractileForce;
+    const double mass = muscleDensity * maxIsometricForce /
+        muscleSpecificStress * optimalFiberLength;
+
+    // Activation and maintenance heat rates
+    const double activationHeatRate = mass * (133 * fastActivation +
+        40 * slowActivation);
+    const double dActivationHeatRate = mass * (133 * dFastActivation +
+        40 * dSlowActivation);
+    double lengthFactor = 0.0;
+    if (fiberLength <= 0.5) lengthFactor = 0.5;
+    else if (fiberLength <= 1.0) lengthFactor = fiberLength;
+    else if (fiberLength <= 1.5) lengthFactor = -2 * fiberLength + 3;
+    const double maintenanceHeatRate = mass * lengthFactor *
+        (111 * fastActivation + 74 * slowActivation);
+    const double dMaintenanceHeatRate = mass * lengthFactor *
+        (111 * dFastActivation + 74 * dSlowActivation);
+
+    // Shortening heat rate and work rate
+    const double velocityRatio = calcForceVelocity(0.0) / forceVelocity;
+    const double isometricForce = contractileForce * velocityRatio;
+    const double dIsometricForce = dContractileForce * velocityRatio;
+    const double totalFiberForce = contractileForce + maxIsometricForce *
+        calcPassiveForceLength(fiberLength);
+    const double velocity = fiberVelocity * (vMaxFactor *
+        optimalFiberLength) * std::cos(pennationAngle);
+    const double lengtheningCoefficient = 0.5 + 0.5 * std::tanh(b3 *
+        velocity);
+    double proportionality = 0.16 * isometricForce + 0.18 * totalFiberForce;
+    double dProportionality = 0.16 * dIsometricForce + 0.18 *
+        dContractileForce;
+    proportionality += (-proportionality + 0.157 * totalFiberForce) *
+        lengtheningCoefficient;
+    dProportionality += (-dProportionality + 0.157 * dContractileForce) *
+        lengtheningCoefficient;
+    const double shorteningHeatRate = -proportionality * velocity;
+    const double dShorteningHeatRate = -dProportionality * velocity;
+    const double workRate = -contractileForce * velocity *
+        (1 - lengtheningCoefficient);
+    const double dWorkRate = -dContractileForce * velocity *
+        (1 - lengtheningCoefficient);
+
+    // Drive a negative total power to zero through the shortening heat
+    const double totalPower = activationHeatRate + maintenanceHeatRate +
+        shorteningHeatRate + workRate;
+    const double dTotalPower = dActivationHeatRate + dMaintenanceHeatRate +
+        dShorteningHeatRate + dWorkRate;
+    const double powerTanh = std::tanh(-b1 * totalPower);
+    const double negativeCoefficient = 0.5 + 0.5 * powerTanh;
+    const double dNegativeCoefficient = -0.5 * (1 - powerTanh * powerTanh) *
+        b1 * dTotalPower;
+    const double correctedShorteningHeatRate = shorteningHeatRate -
+        totalPower * negativeCoefficient;
+    const double dCorrectedShorteningHeatRate = dShorteningHeatRate -
+        dTotalPower * negativeCoefficient - totalPower *
+        dNegativeCoefficient;
+
+    // The heat rate per mass cannot fall below 1 W/kg, Umberger 2003
+    const double heatRate = (activationHeatRate + maintenanceHeatRate +
+        correctedShorteningHeatRate) / mass;
+    const double dHeatRate = (dActivationHeatRate + dMaintenanceHeatRate +
+        dCorrectedShorteningHeatRate) / mass;
+    const double heatTanh = std::tanh(b2 * (1 - heatRate));
+    const double belowOneCoefficient = 0.5 + 0.5 * heatTanh;
+    const double dBelowOneCoefficient = -0.5 * (1 - heatTanh * heatTanh) *
+        b2 * dHeatRate;
+    const double boundedHeatRate = heatRate + (1 - heatRate) *
+        belowOneCoefficient;
+    const double dBoundedHeatRate = dHeatRate - dHeatRate *
+        belowOneCoefficient + (1 - heatRate) * dBelowOneCoefficient;
+
+    MuscleMetabolicRate rate;
+    rate.power = boundedHeatRate * mass + workRate;
+    rate.derivative = dBoundedHeatRate * mass + dWorkRate;
+    return rate;
+}
+
+// Umberger et al. (2003) with the stretched fiber scaling of Umberger
+// (2010). Excitations are not available, so the activation is used for the
+// combined excitation and activation term. Heat rates are in W/kg with
+// fiber velocities in optimal fiber lengths per second and lengthening
+// positive.
+inline MuscleMetabolicRate calcUmbergerMuscleRate(double activation,
+        double fiberLength, double fiberVelocity, double maxIsometricForce,
+        double optimalFiberLength, double vMaxFactor, double pennationAngle) {
+    const double aerobicScale = 1.5;
+    const double fastTwitchPercent = 100 * fastTwitchFraction;
+    const double maxFastTwitchVelocity = vMaxFactor;
+    const double maxSlowTwitchVelocity = vMaxFactor / 2.5;
+    const double slowShorteningCoefficient = 100 / maxSlowTwitchVelocity;
+    const double fastShorteningCoefficient = 153 / maxFastTwitchVelocity;
+    const double lengtheningCoefficient = 4 * slowShorteningCoefficient;
+
+    const double a = activation > 0 ? activation : 0.0;
+    const double activeForceLength = calcActiveForceLength(fiberLength);
+    const double lengthScale = fiberLength <= 1.0 ? 1.0 :
+        0.4 + 0.6 * activeForceLength;
+    const double velocity = fiberVelocity * vMaxFactor *
+        std::cos(pennationAngle);
+    const double mass = muscleDensity * maxIsometricForce /
+        muscleSpecificStress * optimalFiberLength;
+
+    // Activation and maintenance heat rate scales with A ^ 0.6
+    const double maintenanceRate = aerobicScale * lengthScale *
+        (1.28 * fastTwitchPercent + 25);
+    double heatRate = maintenanceRate * std::pow(a, 0.6);
+    double dHeatRate = a > 0 ? maintenanceRate * 0.6 * std::pow(a, -0.4) :
+        0.0;
+
+    // Shortening heat scales with A ^ 2 and lengthening heat with A
+    const double stretchScale = fiberLength <= 1.0 ? 1.0 :
+        activeForceLength;
+    if (velocity <= 0) {
+        const double shorteningRate = aerobicScale * stretchScale *
+            -velocity * (slowShorteningCoefficient *
+            (1 - fastTwitchFraction) + fastShorteningCoefficient *
+            fastTwitchFraction);
+        heatRate += shorteningRate * a * a;
+        dHeatRate += shorteningRate * 2 * a;
+    } else {
+        const double lengtheningRate = aerobicScale * stretchScale *
+            lengtheningCoefficient * velocity;
+        heatRate += lengtheningRate * a;
+        dHeatRate += lengtheningRate;
+    }
+    if (heatRate < 1.0) {
+        heatRate = 1.0;
+        dHeatRate = 0.0;
+    }
+
+    // Mechanical work rate of the contractile element, negative when
+    // lengthening
+    const double dContractileForce = maxIsometricForce * activeForceLength *
+        calcForceVelocity(fiberVelocity);
+    const double fiberSpeed = velocity * optimalFiberLength;
+
+    MuscleMetabolicRate rate;
+    rate.power = heatRate * mass - activation * dContractileForce *
+        fiberSpeed;
+    rate.derivative = dHeatRate * mass - dContractileForce * fiberSpeed;
+    return rate;
+}
+
+inline double calcBasalMetabolicRate(double mass) {
+    return basalCoefficient * std::pow(mass, basalExponent);
+}
+
+// Whole body metabolic power of every frame. activations, fiberLengths
+// and fiberVelocities are frames x muscles. power has one value per frame
+// and derivatives is frames x muscles, or empty if not needed. Frames are
+// split across threads.
+inline void calcMetabolicPowerBatch(MetabolicModel model, double mass,
+        const MatrixView& activations, const MatrixView& fiberLengths,
+        const MatrixView& fiberVelocities,
+        const MetabolicMuscleParameters& parameters, double* power,
+        const OutputMatrixView& derivatives, int numThreads) {
+    const int numFrames = activations.rows;
+    const int numMuscles = activations.columns;
+    const bool hasDerivatives = !derivatives.isEmpty();
+    const double basalRate = calcBasalMetabolicRate(mass);
+
+    #pragma omp parallel for num_threads(numThreads) schedule(static)
+    for (int i = 0; i < numFrames; i++) {
+        double framePower = basalRate;
+        for (int j = 0; j < numMuscles; j++) {
+            const MuscleMetabolicRate rate = model == umbergerMetabolicModel
+                ? calcUmbergerMuscleRate(activations(i, j),
+                    fiberLengths(i, j), fiberVelocities(i, j),
+                    parameters.maxIsometricForce[j],
+                    parameters.optimalFiberLength[j],
+                    parameters.vMaxFactor[j], parameters.pennationAngle[j])
+                : calcBhargavaMuscleRate(activations(i, j),
+                    fiberLengths(i, j), fiberVelocities(i, j),
+                    parameters.maxIsometricForce[j],
+                    parameters.optimalFiberLength[j],
+                    parameters.vMaxFactor[j], parameters.pennationAngle[j]);
+            framePower += rate.power;
+            if (hasDerivatives) derivatives(i, j) = rate.derivative;
+        }
+        power[i] = framePower;
+    }
+}
+
+#endif
@@ -0,0 +1,189 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Helpers for reading MATLAB arguments in the MEX kernels. These must only
+// be called from the MATLAB thread, never inside an OpenMP region.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Marleny Vega, Spencer Williams                               //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MEX_ARRAY_HELPERS_H
+#define NMSM_MEX_ARRAY_HELPERS_H
+
+#include "mex.h"
+#include "FrameResultCache.h"
+#include "KernelProfiler.h"
+#include "MatrixView.h"
+#include <string>
+#include <vector>
+
+// Returned by the kernels when called without arguments. MATLAB code checks
+// it before using entry points that older compiled kernels do not have.
+// Kernels built before this was added return nothing for that call.
+#define NMSM_MEX_INTERFACE_VERSION 12
+
+// True if the argument is the char array command, which distinguishes the
+// named entry points of a kernel from its model file argument.
+inline bool mexArgumentIsCommand(const mxArray *input, const char* command) {
+    if (!mxIsChar(input)) {
+        return false;
+    }
+    char* cArray = mxArrayToString(input);
+    const bool isCommand = cArray != NULL && std::string(cArray) == command;
+    mxFree(cArray);
+    return isCommand;
+}
+
+inline std::vector<std::string> mexCellToStrings(const mxArray *input) {
+    const mwSize numElements = mxGetNumberOfElements(input);
+    std::vector<std::string> output(numElements);
+    for (mwIndex k = 0; k < numElements; k++) {
+        char* cArray = mxArrayToString(mxGetCell(input, k));
+        if (cArray == NULL) {
+            mexErrMsgTxt("Coordinate labels must be a cell array of char.\n");
+        }
+        output[k] = cArray;
+        mxFree(cArray);
+    }
+    return output;
+}
+
+// Views the first two dimensions of a real double array without copying
+inline MatrixView mexArrayToView(const mxArray *input) {
+    if (!mxIsEmpty(input) && (!mxIsDouble(input) || mxIsComplex(input))) {
+        mexErrMsgTxt("Kernel inputs must be real double matrices.\n");
+    }
+    return MatrixView(mxGetPr(input), (int) mxGetM(input),
+        (int) mxGetN(input));
+}
+
+// Creates a double matrix for the kernel to fill. Outputs that are not
+// completely written by the kernel must be created zeroed.
+inline OutputMatrixView createOutputMatrix(mxArray **output, int rows,
+        int columns, bool isCompletelyWritten) {
+    *output = isCompletelyWritten
+        ? mxCreateUninitNumericMatrix(rows, columns, mxDOUBLE_CLASS, mxREAL)
+        : mxCreateDoubleMatrix(rows, columns, mxREAL);
+    return OutputMatrixView(mxGetPr(*output), rows, columns);
+}
+
+inline void checkInputRows(const MatrixView& input, int rows, int columns,
+        const char* name) {
+    if (input.rows != rows || input.columns < columns) {
+        mexErrMsgIdAndTxt("NMSM:kernelInputSize",
+            "%s must have %d rows and at least %d columns.", name, rows,
+            columns);
+    }
+}
+
+// Handles the result cache commands shared by the model kernels and
+// returns false for other calls:
+// ('configureCache', capacity) sets the number of cached frames, where 0
+// disables the cache, and clears the entries and counters.
+// ('cacheStatistics') returns a struct with the hits, misses, entries and
+// capacity of the cache.
+inline bool mexFrameCacheCommand(FrameResultCache& cache, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[]) {
+    if (mexArgumentIsCommand(prhs[0], "configureCache")) {
+        if (nrhs != 2 || mxGetScalar(prhs[1]) < 0) {
+            mexErrMsgTxt("configureCache takes a nonnegative capacity.\n");
+        }
+        cache.configure((std::size_t) mxGetScalar(prhs[1]));
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "cacheStatistics")) {
+        const FrameCacheStatistics statistics = cache.getStatistics();
+        const char* fields[4] = {"hits", "misses", "entries", "capacity"};
+        plhs[0] = mxCreateStructMatrix(1, 1, 4, fields);
+        mxSetField(plhs[0], 0, "hits",
+            mxCreateDoubleScalar((double) statistics.hits));
+        mxSetField(plhs[0], 0, "misses",
+            mxCreateDoubleScalar((double) statistics.misses));
+        mxSetField(plhs[0], 0, "entries",
+            mxCreateDoubleScalar((double) statistics.entries));
+        mxSetField(plhs[0], 0, "capacity",
+            mxCreateDoubleScalar((double) statistics.capacity));
+        return true;
+    }
+    return false;
+}
+
+// Handles the profiler commands shared by the model kernels and returns
+// false for other calls:
+// ('configureProfiler', enabled[, tracing]) enables or disables the stage
+// timers, and trace events if tracing is true, and clears them.
+// ('profileStatistics') returns a struct with the number of timed calls,
+// the frames of each thread and one field per stage with the seconds of
+// each thread.
+// ('writeProfileTrace', fileName) writes the trace events as Chrome trace
+// JSON.
+inline bool mexProfilerCommand(KernelProfiler& profiler,
+        const char* kernelName, mxArray *plhs[], int nrhs,
+        const mxArray *prhs[]) {
+    if (mexArgumentIsCommand(prhs[0], "configureProfiler")) {
+        if (nrhs != 2 && nrhs != 3) {
+            mexErrMsgTxt("configureProfiler takes 2 or 3 arguments.\n");
+        }
+        profiler.configure(mxGetScalar(prhs[1]) > 0.5,
+            nrhs == 3 && mxGetScalar(prhs[2]) > 0.5);
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "profileStatistics")) {
+        const std::vector<ThreadProfile>& threads = profiler.getThreads();
+        const int numThreads = (int) threads.size();
+        const char* fields[2 + numProfileStages] = {"calls", "frames"};
+        for (int stage = 0; stage < numProfileStages; stage++) {
+            fields[2 + stage] = getProfileStageName(stage);
+        }
+        plhs[0] = mxCreateStructMatrix(1, 1, 2 + numProfileStages, fields);
+        mxSetField(plhs[0], 0, "calls",
+            mxCreateDoubleScalar((double) profiler.getNumCalls()));
+        mxArray* frames = mxCreateDoubleMatrix(1, numThreads, mxREAL);
+        for (int t = 0; t < numThreads; t++) {
+            mxGetPr(frames)[t] = (double) threads[t].frames;
+        }
+        mxSetField(plhs[0], 0, "frames", frames);
+        for (int stage = 0; stage < numProfileStages; stage++) {
+            mxArray* seconds = mxCreateDoubleMatrix(1, numThreads, mxREAL);
+            for (int t = 0; t < numThreads; t++) {
+                mxGetPr(seconds)[t] = threads[t].seconds[stage];
+            }
+            mxSetField(plhs[0], 0, getProfileStageName(stage), seconds);
+        }
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "writeProfileTrace")) {
+        char* fileName = nrhs == 2 ? mxArrayToString(prhs[1]) : NULL;
+        if (fileName == NULL) {
+            mexErrMsgTxt("writeProfileTrace takes a file name.\n");
+        }
+        const std::string error = profiler.writeChromeTrace(fileName,
+            kernelName);
+        mxFree(fileName);
+        if (!error.empty()) {
+            mexErrMsgTxt(error.c_str());
+        }
+        return true;
+    }
+    return false;
+}
+
+#endif
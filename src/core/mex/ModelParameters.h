@@ -0,0 +1,151 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Named property changes applied to a loaded model and its replicas, so
+// optimizers that change spring, muscle or segment parameters between
+// iterations do not write a model file and parse it again for every
+// thread. The changed models are finalized and their Systems rebuilt in
+// place, which skips the XML parse and the replica clones.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_PARAMETERS_H
+#define NMSM_MODEL_PARAMETERS_H
+
+#include <OpenSim/OpenSim.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "ModelReplicaPool.h"
+
+// New values of a double or Vec3 property of a model component, such as
+// ("/forceset/soleus_r", "tendon_slack_length") or ("/bodyset/pelvis",
+// "mass"). Values fill the property's elements in order, three per Vec3.
+struct ModelParameterUpdate {
+    std::string component;
+    std::string property;
+    std::vector<double> values;
+};
+
+// Throws unless the update names a double or Vec3 property of a component
+// of the model with as many values as the property has
+inline void checkModelParameterUpdate(const OpenSim::Model& model,
+        const ModelParameterUpdate& update) {
+    if (!model.hasComponent(update.component)) {
+        throw OpenSim::Exception("The model has no component " +
+            update.component + ".");
+    }
+    const OpenSim::Component& component =
+        model.getComponent(update.component);
+    if (!component.hasProperty(update.property)) {
+        throw OpenSim::Exception(update.component + " has no property " +
+            update.property + ".");
+    }
+    const OpenSim::AbstractProperty& property =
+        component.getPropertyByName(update.property);
+    const std::string type = property.getTypeName();
+    if (type != "double" && type != "Vec3") {
+        throw OpenSim::Exception("Only double and Vec3 properties can be "
+            "updated, " + update.property + " is " + type + ".");
+    }
+    const std::size_t width = type == "Vec3" ? 3 : 1;
+    if (update.values.size() != width * property.size()) {
+        throw OpenSim::Exception(update.component + " " + update.property +
+            " needs " + std::to_string(width * property.size()) +
+            " values.");
+    }
+}
+
+// Sets the properties of a checked update. The model must be finalized and
+// its System rebuilt before it is used.
+inline void applyModelParameterUpdate(OpenSim::Model& model,
+        const ModelParameterUpdate& update) {
+    OpenSim::AbstractProperty& property = model
+        .updComponent(update.component).updPropertyByName(update.property);
+    if (property.getTypeName() == "Vec3") {
+        for (int j = 0; j < property.size(); j++) {
+            property.updValue<SimTK::Vec3>(j) = SimTK::Vec3(
+                update.values[3 * j], update.values[3 * j + 1],
+                update.values[3 * j + 2]);
+        }
+    } else {
+        for (int j = 0; j < property.size(); j++) {
+            property.updValue<double>(j) = update.values[j];
+        }
+    }
+}
+
+// Adds updates to the updates applied so far. An update of a component
+// and property already in applied replaces its values, so each property
+// is set once, to its latest values, when applied is replayed.
+inline void mergeModelParameterUpdates(
+        std::vector<ModelParameterUpdate>& applied,
+        const std::vector<ModelParameterUpdate>& updates) {
+    for (const ModelParameterUpdate& update : updates) {
+        auto previous = std::find_if(applied.begin(), applied.end(),
+            [&](const ModelParameterUpdate& other) {
+                return other.component == update.component &&
+                    other.property == update.property;
+            });
+        if (previous != applied.end()) {
+            previous->values = update.values;
+        } else {
+            applied.push_back(update);
+        }
+    }
+}
+
+// Applies the updates to the loaded model and every replica cloned from it
+// and rebuilds their Systems. Replicas cloned later copy the updated model.
+// Each replica is rebuilt by the thread that uses it, as when it was
+// cloned. The updates must have been checked against the loaded model.
+// Returns an empty string or the first error raised by a replica.
+inline std::string updateModelParameters(ModelReplicaPool& modelPool,
+        const std::vector<ModelParameterUpdate>& updates) {
+    const int numThreads = modelPool.getNumThreads();
+    FrameSchedule schedule;
+    schedule.numThreads = numThreads;
+    schedule.pinThreads = modelPool.getScheduleOptions().pinThreads;
+    std::string parallelError;
+    runFrameSchedule(schedule, numThreads, [&](int, int r) {
+        if (!modelPool.isAcquired(r)) {
+            return;
+        }
+        try {
+            ModelReplica& replica = modelPool.acquire(r);
+            for (const ModelParameterUpdate& update : updates) {
+                applyModelParameterUpdate(*replica.model, update);
+            }
+            SimTK::State& state = replica.model->initSystem();
+            replica.initialize(*replica.model, state);
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(nmsmModelParameters)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    });
+    return parallelError;
+}
+
+#endif
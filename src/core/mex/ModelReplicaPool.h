@@ -0,0 +1,266 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Owns the per-thread copies of an OpenSim model used by the OpenMP
+// kernels. The model file is parsed once. Copies for other threads are
+// cloned from the loaded model the first time a thread needs one, so a
+// call over few frames only builds as many replicas as threads it uses.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Marleny Vega, Spencer Williams                               //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_REPLICA_POOL_H
+#define NMSM_MODEL_REPLICA_POOL_H
+
+#include <OpenSim/OpenSim.h>
+#include <omp.h>
+#include <cstddef>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FrameResultCache.h"
+#include "FrameSchedule.h"
+#if defined(_WIN32)
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+// Resident memory of the process in bytes, or 0 where it is not available
+inline std::size_t getResidentMemoryBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+            sizeof(counters))) {
+        return (std::size_t) counters.WorkingSetSize;
+    }
+    return 0;
+#elif defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    std::size_t totalPages = 0;
+    std::size_t residentPages = 0;
+    if (!(statm >> totalPages >> residentPages)) {
+        return 0;
+    }
+    return residentPages * (std::size_t) sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+// Rough resident bytes of a parsed and initialized model, from the number
+// of its components with their properties and their part of the System
+inline std::size_t estimateModelBytes(const OpenSim::Model& model) {
+    const std::size_t componentBytes = 16 * 1024;
+    return componentBytes * (std::size_t) model.countNumComponents();
+}
+
+// Records the bytes measured for a load of modelFile and returns the
+// largest recorded for it in this process. A model parsed again after an
+// eviction reuses memory the allocator kept from the evicted copies, so
+// the growth of the process then reads close to zero.
+inline std::size_t rememberModelBytes(const std::string& modelFile,
+        std::size_t measuredBytes) {
+    static std::mutex mutex;
+    static std::map<std::string, std::size_t> modelBytes;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::size_t& bytes = modelBytes[modelFile];
+    bytes = std::max(bytes, measuredBytes);
+    return bytes;
+}
+
+// Buffers one thread reuses for every frame of every call. They are sized
+// for the model when the replica is made and only grow, for cache rows,
+// when a call needs more, so the frame loops do not allocate them again.
+// Resizing a SimTK vector to its current size keeps its storage.
+struct FrameWorkspace {
+    SimTK::Vector controls;
+    SimTK::Vector accelerations;
+    SimTK::Vector idLoads;
+    // Model body forces with the contact loads added
+    SimTK::Vector_<SimTK::SpatialVec> bodyForces;
+    SimTK::Vector_<SimTK::SpatialVec> bodyAccelerations;
+    std::vector<SimTK::SpatialVec> subtreeForces;
+    // Loads of the Jacobian's central differences
+    SimTK::Vector forwardLoads;
+    SimTK::Vector backwardLoads;
+    SimTK::Matrix massMatrix;
+    FrameCacheKey cacheKey;
+    std::vector<double> cachedRow;
+
+    void reserve(const OpenSim::Model& model, const SimTK::State& state) {
+        const int numBodies = model.getMatterSubsystem().getNumBodies();
+        controls.resize(model.getNumControls());
+        // Accelerations follow the coordinate binding, which counts Q
+        accelerations.resize(state.getNQ());
+        idLoads.resize(state.getNU());
+        forwardLoads.resize(state.getNU());
+        backwardLoads.resize(state.getNU());
+        bodyForces.resize(numBodies);
+        bodyAccelerations.resize(numBodies);
+        subtreeForces.resize(numBodies);
+    }
+};
+
+// One thread's model, working State and the objects cached from them
+struct ModelReplica {
+    std::unique_ptr<OpenSim::Model> ownedModel;
+    OpenSim::Model* model = nullptr;
+    SimTK::State* state = nullptr;
+    // ForceSet::getMuscles() rebuilds its list on every call
+    std::vector<const OpenSim::Muscle*> muscles;
+    // False while the muscles are turned off in the State
+    bool musclesApplyForce = true;
+    FrameWorkspace workspace;
+
+    void initialize(OpenSim::Model& loadedModel, SimTK::State& loadedState) {
+        model = &loadedModel;
+        state = &loadedState;
+        const OpenSim::Set<OpenSim::Muscle>& modelMuscles = model->getMuscles();
+        muscles.clear();
+        for (int j = 0; j < modelMuscles.getSize(); j++) {
+            muscles.push_back(&modelMuscles.get(j));
+        }
+        musclesApplyForce = true;
+        workspace.reserve(*model, *state);
+    }
+
+    // Turns the forces of the muscles off in the State, or back to the
+    // model's setting. The State is only changed when the setting changes,
+    // so calls can set it for every frame.
+    void setMusclesApplyForce(bool applyForce) {
+        if (applyForce == musclesApplyForce) {
+            return;
+        }
+        setMusclesApplyForce(*state, applyForce);
+        musclesApplyForce = applyForce;
+    }
+
+    // The same for another State of this replica's System, such as a
+    // retained frame, which tracks its own setting
+    void setMusclesApplyForce(SimTK::State& otherState,
+            bool applyForce) const {
+        for (const OpenSim::Muscle* muscle : muscles) {
+            muscle->setAppliesForce(otherState,
+                applyForce && muscle->get_appliesForce());
+        }
+    }
+};
+
+class ModelReplicaPool {
+public:
+    // A thread count of zero or less uses omp_get_max_threads(), which
+    // follows OMP_NUM_THREADS.
+    void load(const std::string& modelFile, int numThreads) {
+        clear();
+        if (numThreads <= 0) {
+            numThreads = omp_get_max_threads();
+        }
+        const std::size_t residentBefore = getResidentMemoryBytes();
+        baseModel.reset(new OpenSim::Model(modelFile));
+        SimTK::State& baseState = baseModel->initSystem();
+        const std::size_t residentAfter = getResidentMemoryBytes();
+        const std::size_t grownBytes = residentAfter > residentBefore ?
+            residentAfter - residentBefore : 0;
+        // The growth is never trusted below the estimate from the model
+        replicaBytes = rememberModelBytes(modelFile,
+            std::max(grownBytes, estimateModelBytes(*baseModel)));
+        replicas.resize(numThreads);
+        replicas[0].reset(new ModelReplica());
+        replicas[0]->initialize(*baseModel, baseState);
+    }
+
+    void clear() {
+        replicas.clear();
+        baseModel.reset();
+        replicaBytes = 0;
+    }
+
+    bool isLoaded() const { return (bool) baseModel; }
+    int getNumThreads() const { return (int) replicas.size(); }
+    int getNumReplicas() const {
+        int count = 0;
+        for (const auto& replica : replicas) {
+            count += replica ? 1 : 0;
+        }
+        return count;
+    }
+
+    // Memory of the replicas made so far, from the largest growth of the
+    // process's resident memory while the model file was parsed and
+    // initialized, and at least the estimate from its components. Clones
+    // are assumed to be the size of the parsed model.
+    std::size_t getMemoryEstimate() const {
+        return replicaBytes * (std::size_t) getNumReplicas();
+    }
+
+    // Schedule options are kept when a model is loaded or cleared
+    const FrameScheduleOptions& getScheduleOptions() const {
+        return scheduleOptions;
+    }
+    void setScheduleOptions(const FrameScheduleOptions& options) {
+        scheduleOptions = options;
+    }
+
+    // Plans a call of numPts frames on this pool's threads
+    FrameSchedule planSchedule(int numPts, bool isUneven) const {
+        return planFrameSchedule(scheduleOptions, numPts, getNumThreads(),
+            isUneven);
+    }
+
+    // True once the replica of threadId has been made
+    bool isAcquired(int threadId) const { return (bool) replicas[threadId]; }
+
+    // Replica 0 is the parsed model and is always available for the serial
+    // prepass (binding, index resolution).
+    ModelReplica& getBase() { return *replicas[0]; }
+
+    // Returns the replica for threadId, cloning the loaded model on first
+    // use. Each thread id must only be acquired by one thread at a time.
+    // The clone is made on the acquiring thread, so with first-touch
+    // placement its memory is local to that thread.
+    ModelReplica& acquire(int threadId) {
+        std::unique_ptr<ModelReplica>& replica = replicas[threadId];
+        if (!replica) {
+            std::unique_ptr<ModelReplica> created(new ModelReplica());
+            // Copying reads the loaded model's properties, which replica 0
+            // may be using on another thread, so only the copy is guarded.
+            #pragma omp critical(nmsmModelReplicaClone)
+            created->ownedModel.reset(baseModel->clone());
+            SimTK::State& state = created->ownedModel->initSystem();
+            created->initialize(*created->ownedModel, state);
+            replica = std::move(created);
+        }
+        return *replica;
+    }
+
+private:
+    std::unique_ptr<OpenSim::Model> baseModel;
+    std::vector<std::unique_ptr<ModelReplica>> replicas;
+    FrameScheduleOptions scheduleOptions;
+    std::size_t replicaBytes = 0;
+};
+
+#endif
@@ -0,0 +1,173 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Client side of the local model server. A client sends one request at a
+// time through its own payload segment, which grows to the largest
+// request sent, and waits for the server to mark its slot done.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_SERVER_CLIENT_H
+#define NMSM_MODEL_SERVER_CLIENT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "ModelServerProtocol.h"
+#include "SharedMemory.h"
+
+class ModelServerClient {
+public:
+    // Opens the control segment of a running server
+    void connect(const std::string& serverName) {
+        disconnect();
+        control.open(getModelServerControlName(serverName),
+            sizeof(ModelServerControl));
+        const ModelServerControl& header = getControl();
+        if (header.magic != modelServerMagic ||
+                header.protocol != modelServerProtocol) {
+            control.close();
+            throw std::runtime_error("The model server " + serverName +
+                " uses a different protocol than this client.");
+        }
+        this->serverName = serverName;
+    }
+
+    void disconnect() {
+        payload.close();
+        control.close();
+        serverName.clear();
+    }
+
+    bool isConnected() const { return control.isOpen(); }
+    const std::string& getServerName() const { return serverName; }
+
+    // Sends a request and waits for its outputs, which are read through
+    // the request's output pointers until the next call. Throws the
+    // server's error if the request failed.
+    template <class Request>
+    void call(ModelServerRequestKind kind, Request& request) {
+        if (!isConnected()) {
+            throw std::runtime_error("No model server is connected.");
+        }
+        ModelServerPayloadWriter measure(nullptr, 0);
+        transferModelServerRequest(measure, request);
+        reservePayload(measure.getPosition());
+        ModelServerPayloadHeader& header =
+            *(ModelServerPayloadHeader*) payload.getData();
+        header.status = -1;
+        header.error[0] = '\0';
+        ModelServerPayloadWriter writer(payload.getData(), payload.getSize());
+        transferModelServerRequest(writer, request);
+
+        ModelServerControl& server = getControl();
+        ModelServerSlot& slot = claimSlot(server);
+        slot.kind = kind;
+        slot.clientProcess.store(getCurrentProcessNumber(),
+            std::memory_order_release);
+        slot.payloadSize = payload.getSize();
+        std::strncpy(slot.payloadName, payload.getName().c_str(),
+            sizeof(slot.payloadName) - 1);
+        slot.payloadName[sizeof(slot.payloadName) - 1] = '\0';
+        slot.ticket = server.nextTicket.fetch_add(1);
+        slot.state.store(slotReady, std::memory_order_release);
+
+        wait(server, [&]() {
+            return slot.state.load(std::memory_order_acquire) == slotDone;
+        });
+        slot.clientProcess.store(0, std::memory_order_relaxed);
+        slot.state.store(slotFree, std::memory_order_release);
+        if (header.status != 0) {
+            header.error[sizeof(header.error) - 1] = '\0';
+            throw std::runtime_error(header.error[0] != '\0' ? header.error :
+                "The model server could not read the request.");
+        }
+    }
+
+private:
+    ModelServerControl& getControl() const {
+        return *(ModelServerControl*) control.getData();
+    }
+
+    // A grown payload gets a new name, so a name always has one size
+    void reservePayload(std::size_t size) {
+        if (payload.isOpen() && payload.getSize() >= size) {
+            return;
+        }
+        const std::size_t newSize = std::max(size, 2 * payload.getSize());
+        payload.create(serverName + "_" +
+            std::to_string(getCurrentProcessNumber()) + "_" +
+            std::to_string(++numPayloads), newSize);
+    }
+
+    ModelServerSlot& claimSlot(ModelServerControl& server) {
+        ModelServerSlot* claimed = nullptr;
+        wait(server, [&]() {
+            for (ModelServerSlot& slot : server.slots) {
+                int expected = slotFree;
+                if (slot.state.compare_exchange_strong(expected,
+                        slotClaimed, std::memory_order_acquire)) {
+                    claimed = &slot;
+                    return true;
+                }
+            }
+            return false;
+        });
+        return *claimed;
+    }
+
+    // Polls until isDone is true, yielding at first and then sleeping.
+    // Throws if the server's heartbeat stops.
+    template <class Condition>
+    void wait(ModelServerControl& server, Condition isDone) {
+        std::uint64_t heartbeat = server.heartbeat.load();
+        auto lastBeat = std::chrono::steady_clock::now();
+        for (int poll = 0; !isDone(); poll++) {
+            if (poll < 1000) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            const std::uint64_t beat = server.heartbeat.load();
+            const auto now = std::chrono::steady_clock::now();
+            if (beat != heartbeat) {
+                heartbeat = beat;
+                lastBeat = now;
+            } else if (std::chrono::duration<double>(now - lastBeat)
+                    .count() > modelServerTimeout) {
+                throw std::runtime_error("The model server " + serverName +
+                    " stopped responding.");
+            }
+        }
+    }
+
+    SharedMemorySegment control;
+    SharedMemorySegment payload;
+    std::string serverName;
+    int numPayloads = 0;
+};
+
+#endif
@@ -0,0 +1,230 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// MATLAB commands of the model MEX functions that send their work to a
+// local model server instead of the models loaded in the MEX function.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_SERVER_MEX_H
+#define NMSM_MODEL_SERVER_MEX_H
+
+#include "mex.h"
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "MexArrayHelpers.h"
+#include "ModelServerClient.h"
+
+// The connection of one MEX function and the coordinate count of each
+// model it loaded on the server
+struct ModelServerConnection {
+    ModelServerClient client;
+    std::map<int, int> numCoordinates;
+};
+
+// Runs a client call and reports its exception as a MATLAB error
+template <class Call>
+inline void mexCallModelServer(Call call) {
+    std::string error;
+    try {
+        call();
+    }
+    catch (const std::exception& ex) {
+        error = ex.what();
+    }
+    if (!error.empty()) {
+        mexErrMsgTxt(error.c_str());
+    }
+}
+
+inline std::string mexReadServerString(const mxArray *input,
+        const char* name) {
+    char* cArray = mxArrayToString(input);
+    if (cArray == NULL) {
+        mexErrMsgIdAndTxt("NMSM:modelServer", "The %s must be a char array.",
+            name);
+    }
+    const std::string value = cArray;
+    mxFree(cArray);
+    return value;
+}
+
+inline void mexCheckModelServerHandle(ModelServerConnection& connection,
+        const mxArray *handle) {
+    if (!connection.client.isConnected()) {
+        mexErrMsgTxt("No model server is connected.\n");
+    }
+    if (connection.numCoordinates.count((int) mxGetScalar(handle)) == 0) {
+        mexErrMsgTxt("The model was not loaded on the model server by this MEX function.\n");
+    }
+}
+
+// Handles the model server commands shared by the model kernels and
+// returns false for other calls:
+// ('connectServer', serverName) connects to a running server.
+// ('serverLoad', modelFile) loads a model on the server, or shares the
+// model another client loaded from the same file, and returns its handle.
+// ('serverRelease', handle) releases this client's use of the model.
+// ('disconnectServer') closes the connection.
+inline bool mexModelServerCommand(ModelServerConnection& connection,
+        mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    if (mexArgumentIsCommand(prhs[0], "connectServer")) {
+        if (nrhs != 2) {
+            mexErrMsgTxt("connectServer takes a server name.\n");
+        }
+        const std::string serverName = mexReadServerString(prhs[1],
+            "server name");
+        connection.numCoordinates.clear();
+        mexCallModelServer([&]() { connection.client.connect(serverName); });
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "disconnectServer")) {
+        connection.client.disconnect();
+        connection.numCoordinates.clear();
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "serverLoad")) {
+        if (nrhs != 2) {
+            mexErrMsgTxt("serverLoad takes a model file.\n");
+        }
+        ModelServerLoadRequest request;
+        request.modelFile = mexReadServerString(prhs[1], "model file");
+        mexCallModelServer([&]() {
+            connection.client.call(requestLoadModel, request);
+        });
+        const int handle = (int) request.result[0];
+        connection.numCoordinates[handle] = (int) request.result[1];
+        plhs[0] = mxCreateDoubleScalar(handle);
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "serverRelease")) {
+        if (nrhs != 2) {
+            mexErrMsgTxt("serverRelease takes a model handle.\n");
+        }
+        mexCheckModelServerHandle(connection, prhs[1]);
+        ModelServerReleaseRequest request;
+        request.handle = (int) mxGetScalar(prhs[1]);
+        mexCallModelServer([&]() {
+            connection.client.call(requestReleaseModel, request);
+        });
+        connection.numCoordinates.erase(request.handle);
+        return true;
+    }
+    return false;
+}
+
+// Handles ('serverInverseDynamics', handle, time, q, qp, qpp,
+// coordinateLabels, appliedLoads) and returns false for other calls. The
+// output is the inverse dynamics loads of every frame.
+inline bool mexServerInverseDynamicsCommand(
+        ModelServerConnection& connection, mxArray *plhs[], int nrhs,
+        const mxArray *prhs[]) {
+    if (!mexArgumentIsCommand(prhs[0], "serverInverseDynamics")) {
+        return false;
+    }
+    if (nrhs != 8) {
+        mexErrMsgTxt("serverInverseDynamics takes 8 arguments.\n");
+    }
+    mexCheckModelServerHandle(connection, prhs[1]);
+    ModelServerInverseDynamicsRequest request;
+    request.handle = (int) mxGetScalar(prhs[1]);
+    request.labels = mexCellToStrings(prhs[6]);
+    const int numPts = (int) mxGetM(prhs[2]);
+    const int numLabels = (int) request.labels.size();
+    const MatrixView controls = mexArrayToView(prhs[7]);
+    for (int j = 3; j <= 5; j++) {
+        checkInputRows(mexArrayToView(prhs[j]), numPts, numLabels,
+            "Coordinate inputs");
+    }
+    if (controls.columns > 0) {
+        checkInputRows(controls, numPts, 0, "Applied loads");
+    }
+    request.numPts = numPts;
+    request.numControls = controls.columns;
+    request.numCoordinates = connection.numCoordinates[request.handle];
+    request.time = mxGetPr(prhs[2]);
+    request.q = mxGetPr(prhs[3]);
+    request.qp = mxGetPr(prhs[4]);
+    request.qpp = mxGetPr(prhs[5]);
+    request.controls = controls.data;
+    mexCallModelServer([&]() {
+        connection.client.call(requestInverseDynamics, request);
+    });
+    plhs[0] = mxCreateUninitNumericMatrix(numPts, request.numCoordinates,
+        mxDOUBLE_CLASS, mxREAL);
+    std::memcpy(mxGetPr(plhs[0]), request.idLoads,
+        sizeof(double) * numPts * request.numCoordinates);
+    return true;
+}
+
+// Handles ('serverPointKinematics', handle, time, q, qp, points, bodies,
+// coordinateLabels) and returns false for other calls. points is 3 x
+// numPoints and bodies holds zero-based body set indices. The outputs are
+// frames x 3 x points positions and velocities.
+inline bool mexServerPointKinematicsCommand(
+        ModelServerConnection& connection, mxArray *plhs[], int nrhs,
+        const mxArray *prhs[]) {
+    if (!mexArgumentIsCommand(prhs[0], "serverPointKinematics")) {
+        return false;
+    }
+    if (nrhs != 8) {
+        mexErrMsgTxt("serverPointKinematics takes 8 arguments.\n");
+    }
+    mexCheckModelServerHandle(connection, prhs[1]);
+    ModelServerPointKinematicsRequest request;
+    request.handle = (int) mxGetScalar(prhs[1]);
+    request.labels = mexCellToStrings(prhs[7]);
+    const int numPts = (int) mxGetM(prhs[2]);
+    const int numLabels = (int) request.labels.size();
+    const int numPoints = (int) mxGetN(prhs[5]);
+    for (int j = 3; j <= 4; j++) {
+        checkInputRows(mexArrayToView(prhs[j]), numPts, numLabels,
+            "Coordinate inputs");
+    }
+    if (mxGetM(prhs[5]) != 3 ||
+            (int) mxGetNumberOfElements(prhs[6]) != numPoints ||
+            !mxIsDouble(prhs[6])) {
+        mexErrMsgTxt("Point locations must be 3 x numPoints with one body index per point.\n");
+    }
+    request.numPts = numPts;
+    request.numPoints = numPoints;
+    request.bodies = mxGetPr(prhs[6]);
+    request.stations = mxGetPr(prhs[5]);
+    request.time = mxGetPr(prhs[2]);
+    request.q = mxGetPr(prhs[3]);
+    request.qp = mxGetPr(prhs[4]);
+    mexCallModelServer([&]() {
+        connection.client.call(requestPointKinematics, request);
+    });
+    const mwSize dims[3] = {(mwSize) numPts, 3, (mwSize) numPoints};
+    double* outputs[2] = {request.positions, request.velocities};
+    for (int k = 0; k < 2; k++) {
+        plhs[k] = mxCreateUninitNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+        std::memcpy(mxGetPr(plhs[k]), outputs[k],
+            sizeof(double) * 3 * numPts * numPoints);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,334 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Layout of the local model server's shared memory and of the requests
+// its clients send. The server's control segment holds a fixed number of
+// request slots. A client writes a request into its own payload segment,
+// names the segment in a free slot and marks the slot ready; the server
+// reads the request in place, writes the outputs after it and marks the
+// slot done. Each request is described once by a transfer function that
+// both writes it on the client and reads it on the server, so the two
+// sides cannot disagree on the layout.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_SERVER_PROTOCOL_H
+#define NMSM_MODEL_SERVER_PROTOCOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+const std::uint32_t modelServerMagic = 0x4e4d534d;
+// Changes whenever the layout or a request changes
+const int modelServerProtocol = 1;
+const int numModelServerSlots = 64;
+// Seconds without a heartbeat after which clients stop waiting
+const double modelServerTimeout = 10.0;
+
+// The macros are checked rather than is_always_lock_free, which needs
+// C++17, since MSVC compiles the MEX files as C++14
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2 &&
+    sizeof(long long) == sizeof(std::uint64_t),
+    "The model server needs lock-free atomics in shared memory.");
+
+enum ModelServerSlotState {
+    slotFree,
+    // Being filled by a client
+    slotClaimed,
+    slotReady,
+    slotRunning,
+    // The outputs or error are in the payload
+    slotDone
+};
+
+enum ModelServerRequestKind {
+    requestLoadModel,
+    requestReleaseModel,
+    requestInverseDynamics,
+    requestPointKinematics
+};
+
+struct ModelServerSlot {
+    std::atomic<int> state;
+    int kind;
+    // Set by the client after it claims the slot and cleared before it
+    // frees it, so 0 means a claimed slot's owner is not known yet
+    std::atomic<int> clientProcess;
+    // Requests run in ticket order across all clients
+    std::uint64_t ticket;
+    std::uint64_t payloadSize;
+    char payloadName[96];
+};
+
+struct ModelServerControl {
+    std::uint32_t magic;
+    int protocol;
+    int serverProcess;
+    int numThreads;
+    // Advanced by the server several times a second while it runs
+    std::atomic<std::uint64_t> heartbeat;
+    std::atomic<std::uint64_t> nextTicket;
+    ModelServerSlot slots[numModelServerSlots];
+};
+
+// Start of each payload. A status other than 0 means the server could not
+// run the request, with the reason in error.
+struct ModelServerPayloadHeader {
+    std::int32_t status;
+    char error[1020];
+};
+
+inline std::string getModelServerControlName(const std::string& serverName) {
+    return "server_" + serverName;
+}
+
+// Writes a request after the payload header. Without data it only counts
+// the bytes the request needs. Output pointers are set to their place in
+// the payload, where the server writes them.
+class ModelServerPayloadWriter {
+public:
+    ModelServerPayloadWriter(char* data, std::size_t size)
+        : data(data), size(size) {}
+
+    std::size_t getPosition() const { return position; }
+
+    void value(int& value) { copy(&value, sizeof(int)); }
+
+    void text(std::string& value) {
+        int length = (int) value.size();
+        this->value(length);
+        copy(value.data(), value.size());
+    }
+
+    void texts(std::vector<std::string>& values) {
+        int count = (int) values.size();
+        value(count);
+        for (std::string& text : values) {
+            this->text(text);
+        }
+    }
+
+    void inputs(const double*& values, std::size_t count) {
+        align();
+        copy(values, count * sizeof(double));
+    }
+
+    void outputs(double*& values, std::size_t count) {
+        align();
+        values = data != nullptr ? (double*) (data + position) : nullptr;
+        reserve(count * sizeof(double));
+    }
+
+private:
+    void align() { reserve((8 - position % 8) % 8); }
+
+    void reserve(std::size_t bytes) {
+        if (data != nullptr && position + bytes > size) {
+            throw std::runtime_error(
+                "Model server request is larger than its payload.");
+        }
+        position += bytes;
+    }
+
+    void copy(const void* source, std::size_t bytes) {
+        const std::size_t start = position;
+        reserve(bytes);
+        if (data != nullptr && bytes > 0) {
+            std::memcpy(data + start, source, bytes);
+        }
+    }
+
+    char* data;
+    std::size_t size;
+    std::size_t position = sizeof(ModelServerPayloadHeader);
+};
+
+// Reads a request written by ModelServerPayloadWriter. Inputs and outputs
+// point into the payload, and every read is checked against its size.
+class ModelServerPayloadReader {
+public:
+    ModelServerPayloadReader(char* data, std::size_t size)
+        : data(data), size(size) {}
+
+    void value(int& value) {
+        std::memcpy(&value, take(sizeof(int)), sizeof(int));
+    }
+
+    void text(std::string& value) {
+        int length = 0;
+        this->value(length);
+        if (length < 0) {
+            throw std::runtime_error("Model server request is malformed.");
+        }
+        const char* characters = take((std::size_t) length);
+        value.assign(characters, (std::size_t) length);
+    }
+
+    void texts(std::vector<std::string>& values) {
+        int count = 0;
+        value(count);
+        if (count < 0) {
+            throw std::runtime_error("Model server request is malformed.");
+        }
+        values.resize(count);
+        for (std::string& text : values) {
+            this->text(text);
+        }
+    }
+
+    void inputs(const double*& values, std::size_t count) {
+        align();
+        values = (const double*) take(count * sizeof(double));
+    }
+
+    void outputs(double*& values, std::size_t count) {
+        align();
+        values = (double*) take(count * sizeof(double));
+    }
+
+private:
+    void align() { take((8 - position % 8) % 8); }
+
+    char* take(std::size_t bytes) {
+        if (bytes > size || position > size - bytes) {
+            throw std::runtime_error(
+                "Model server request is larger than its payload.");
+        }
+        char* start = data + position;
+        position += bytes;
+        return start;
+    }
+
+    char* data;
+    std::size_t size;
+    std::size_t position = sizeof(ModelServerPayloadHeader);
+};
+
+// Throws unless a count read from a request is nonnegative
+inline std::size_t getModelServerCount(int count) {
+    if (count < 0) {
+        throw std::runtime_error("Model server request is malformed.");
+    }
+    return (std::size_t) count;
+}
+
+// Loads a model, or shares the session of a model file another client
+// loaded. The outputs are the handle and the number of state coordinates.
+struct ModelServerLoadRequest {
+    std::string modelFile;
+    double* result = nullptr;
+};
+
+template <class Stream>
+inline void transferModelServerRequest(Stream& stream,
+        ModelServerLoadRequest& request) {
+    stream.text(request.modelFile);
+    stream.outputs(request.result, 2);
+}
+
+struct ModelServerReleaseRequest {
+    int handle = 0;
+};
+
+template <class Stream>
+inline void transferModelServerRequest(Stream& stream,
+        ModelServerReleaseRequest& request) {
+    stream.value(request.handle);
+}
+
+// Matrices are frames x columns in column-major order, as in MATLAB
+struct ModelServerInverseDynamicsRequest {
+    int handle = 0;
+    std::vector<std::string> labels;
+    int numPts = 0;
+    int numControls = 0;
+    int numCoordinates = 0;
+    const double* time = nullptr;
+    const double* q = nullptr;
+    const double* qp = nullptr;
+    const double* qpp = nullptr;
+    const double* controls = nullptr;
+    double* idLoads = nullptr;
+};
+
+template <class Stream>
+inline void transferModelServerRequest(Stream& stream,
+        ModelServerInverseDynamicsRequest& request) {
+    stream.value(request.handle);
+    stream.texts(request.labels);
+    stream.value(request.numPts);
+    stream.value(request.numControls);
+    stream.value(request.numCoordinates);
+    const std::size_t numPts = getModelServerCount(request.numPts);
+    const std::size_t numValues = numPts * request.labels.size();
+    stream.inputs(request.time, numPts);
+    stream.inputs(request.q, numValues);
+    stream.inputs(request.qp, numValues);
+    stream.inputs(request.qpp, numValues);
+    stream.inputs(request.controls,
+        numPts * getModelServerCount(request.numControls));
+    stream.outputs(request.idLoads,
+        numPts * getModelServerCount(request.numCoordinates));
+}
+
+// Points are stations on bodies given by zero-based body set indices, with
+// the stations as the columns of a 3 x points matrix. Outputs are frames x
+// 3 x points.
+struct ModelServerPointKinematicsRequest {
+    int handle = 0;
+    std::vector<std::string> labels;
+    int numPts = 0;
+    int numPoints = 0;
+    const double* bodies = nullptr;
+    const double* stations = nullptr;
+    const double* time = nullptr;
+    const double* q = nullptr;
+    const double* qp = nullptr;
+    double* positions = nullptr;
+    double* velocities = nullptr;
+};
+
+template <class Stream>
+inline void transferModelServerRequest(Stream& stream,
+        ModelServerPointKinematicsRequest& request) {
+    stream.value(request.handle);
+    stream.texts(request.labels);
+    stream.value(request.numPts);
+    stream.value(request.numPoints);
+    const std::size_t numPts = getModelServerCount(request.numPts);
+    const std::size_t numPoints = getModelServerCount(request.numPoints);
+    const std::size_t numValues = numPts * request.labels.size();
+    stream.inputs(request.bodies, numPoints);
+    stream.inputs(request.stations, 3 * numPoints);
+    stream.inputs(request.time, numPts);
+    stream.inputs(request.q, numValues);
+    stream.inputs(request.qp, numValues);
+    stream.outputs(request.positions, 3 * numPts * numPoints);
+    stream.outputs(request.velocities, 3 * numPts * numPoints);
+}
+
+#endif
@@ -0,0 +1,350 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// A loaded model and everything the batched kernels keep between calls:
+// the per-thread replicas, the coordinate binding of the last labels, the
+// frame result cache, the stage timers and the retained frame States. The
+// session only reads and writes plain arrays through matrix views and
+// reports errors as exceptions, so the same code runs behind the MEX
+// functions and in C++ programs without MATLAB.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_SESSION_H
+#define NMSM_MODEL_SESSION_H
+
+#include <OpenSim/OpenSim.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "CoordinateBinding.h"
+#include "FrameResultCache.h"
+#include "InverseDynamicsKernel.h"
+#include "KernelProfiler.h"
+#include "KernelTaskQueue.h"
+#include "MatrixView.h"
+#include "ModelParameters.h"
+#include "ModelReplicaPool.h"
+#include "PointKinematicsKernel.h"
+
+// Throws unless the input has the given rows and at least the given
+// columns
+inline void checkKernelInputSize(const MatrixView& input, int rows,
+        int columns, const std::string& name) {
+    if (input.rows != rows || input.columns < columns) {
+        throw OpenSim::Exception(name + " must have " +
+            std::to_string(rows) + " rows and at least " +
+            std::to_string(columns) + " columns.");
+    }
+}
+
+// Throws the error returned by a kernel, if any
+inline void throwKernelError(const std::string& error) {
+    if (!error.empty()) {
+        throw OpenSim::Exception(error);
+    }
+}
+
+// Sessions are used by one caller at a time; the parallelism is inside
+// each call. Callers that want the profiler's call count call
+// getProfiler().beginCall() before marshalling their inputs. Calls may
+// also be submitted to the session's task queue, which runs them on its
+// worker while the caller marshals the next call. The caller drains the
+// queue before using the session in any other way; clear() and a change
+// of coordinate labels drain it themselves.
+class ModelSession {
+public:
+    // Parses the model file and prepares numThreads replicas, cloned on
+    // first use. A thread count of zero or less uses omp_get_max_threads().
+    void load(const std::string& modelFile, int numThreads) {
+        clear();
+        this->modelFile = modelFile;
+        requestedThreads = numThreads;
+        parameterUpdates.clear();
+        try {
+            pool.load(modelFile, numThreads);
+        }
+        catch (...) {
+            pool.clear();
+            throw;
+        }
+    }
+
+    // Loads the last model file again and sets each parameter updated
+    // since it was loaded to its latest values
+    void reload() {
+        if (modelFile.empty()) {
+            throw OpenSim::Exception("No OpenSim model has been loaded.");
+        }
+        const std::vector<ModelParameterUpdate> updates = parameterUpdates;
+        load(modelFile, requestedThreads);
+        if (!updates.empty()) {
+            updateParameters(updates);
+        }
+    }
+
+    // Finishes the submitted calls, stops the task queue's worker and
+    // releases the model and everything derived from it. The cache
+    // capacity, profiler settings, model file and parameter updates are
+    // kept for reload().
+    void clear() {
+        tasks.stop();
+        pool.clear();
+        resultCache.clear();
+        retained.clear();
+        isBound = false;
+    }
+
+    bool isLoaded() const { return pool.isLoaded(); }
+    int getNumThreads() const { return pool.getNumThreads(); }
+    // Memory of the model replicas made so far
+    std::size_t getMemoryEstimate() const { return pool.getMemoryEstimate(); }
+    ModelReplicaPool& getPool() { return pool; }
+    FrameResultCache& getResultCache() { return resultCache; }
+    KernelProfiler& getProfiler() { return profiler; }
+    KernelTaskQueue& getTaskQueue() { return tasks; }
+    const RetainedFrameKinematics& getRetainedKinematics() const {
+        return retained;
+    }
+
+    // The parsed model, for serial lookups between calls
+    OpenSim::Model& getModel() {
+        checkLoaded();
+        return *pool.getBase().model;
+    }
+
+    // Labels are resolved once and reused until a call changes them
+    const CoordinateBinding& bindCoordinates(
+            const std::vector<std::string>& labels) {
+        checkLoaded();
+        if (!isBound || labels != binding.labels) {
+            // Submitted calls use the binding of their labels
+            tasks.drain();
+            ModelReplica& base = pool.getBase();
+            binding = ::bindCoordinates(*base.model, *base.state, labels);
+            isBound = true;
+        }
+        return binding;
+    }
+
+    const CoordinateBinding& getBinding() const { return binding; }
+
+    // Mobilized body of a zero-based body set index. The name describes
+    // the index in the error.
+    SimTK::MobilizedBodyIndex getBody(int bodySetIndex,
+            const std::string& name) {
+        const OpenSim::BodySet& bodySet = getModel().getBodySet();
+        if (bodySetIndex < 0 || bodySetIndex >= bodySet.getSize()) {
+            throw OpenSim::Exception(name +
+                " body index is not in the model body set.");
+        }
+        return bodySet.get(bodySetIndex).getMobilizedBodyIndex();
+    }
+
+    // Solves every frame of the inputs with the bound coordinates and
+    // fills the requested output channels. Frames are looked up in and
+    // added to the result cache when it is enabled.
+    void calcInverseDynamics(const InverseDynamicsInputs& inputs,
+            const InverseDynamicsOutputs& outputs) {
+        checkInverseDynamicsInputs(inputs, true);
+        checkFrameChannels(inputs, outputs);
+        throwKernelError(::calcInverseDynamics(pool, binding, inputs,
+            outputs, &resultCache, &profiler));
+    }
+
+    // Solves every frame and writes the per-frame Jacobian blocks
+    void calcInverseDynamicsJacobian(const InverseDynamicsInputs& inputs,
+            const InverseDynamicsOutputs& outputs,
+            const InverseDynamicsJacobian& jacobian) {
+        checkInverseDynamicsInputs(inputs, true);
+        throwKernelError(::calcInverseDynamicsJacobian(pool, binding,
+            inputs, outputs, jacobian));
+    }
+
+    // Realizes and keeps the frame States of the inputs' time, values and
+    // speeds for calcRetainedInverseDynamics
+    void retainFrameKinematics(const InverseDynamicsInputs& inputs) {
+        checkInverseDynamicsInputs(inputs, false);
+        throwKernelError(::retainFrameKinematics(pool, binding, inputs,
+            retained));
+    }
+
+    // Solves the retained frames with the accelerations, controls,
+    // contact surfaces, body forces and muscle setting of the inputs
+    void calcRetainedInverseDynamics(const InverseDynamicsInputs& inputs,
+            const InverseDynamicsOutputs& outputs) {
+        if (!isLoaded() || retained.isEmpty()) {
+            throw OpenSim::Exception(
+                "No frame kinematics have been retained.");
+        }
+        const int numPts = retained.getNumFrames();
+        checkKernelInputSize(inputs.qpp, numPts,
+            (int) retained.binding.labels.size(), "Joint accelerations");
+        if (inputs.controls.columns > 0) {
+            checkKernelInputSize(inputs.controls, numPts, 0,
+                "Applied loads");
+        }
+        checkFrameBodyForces(inputs.bodyForces, numPts);
+        throwKernelError(::calcRetainedInverseDynamics(pool, retained,
+            inputs, outputs, &profiler));
+    }
+
+    void releaseFrameKinematics() { retained.clear(); }
+
+    // Sets the named properties of the model and every replica and
+    // rebuilds their Systems without parsing the model file. Retained
+    // frames are realized again with the new parameters, and cached frames
+    // are dropped. The updates are checked before any is applied. If a
+    // replica fails to rebuild, the model is loaded again with the earlier
+    // updates and the error is thrown.
+    void updateParameters(const std::vector<ModelParameterUpdate>& updates) {
+        checkLoaded();
+        for (const ModelParameterUpdate& update : updates) {
+            checkModelParameterUpdate(getModel(), update);
+        }
+        resultCache.clear();
+        std::string error = ::updateModelParameters(pool, updates);
+        if (!error.empty()) {
+            retained.clear();
+            reload();
+            throwKernelError(error);
+        }
+        mergeModelParameterUpdates(parameterUpdates, updates);
+        if (!retained.isEmpty()) {
+            throwKernelError(::refreshRetainedFrameKinematics(pool,
+                retained));
+        }
+    }
+
+    // Positions and velocities of the inputs' points for every frame
+    void calcPointKinematics(const PointKinematicsInputs& inputs,
+            const PointKinematicsOutputs& outputs) {
+        checkLoaded();
+        const int numPts = inputs.q.rows;
+        const int numLabels = (int) binding.labels.size();
+        checkKernelInputSize(inputs.q, numPts, numLabels, "Joint angles");
+        checkKernelInputSize(inputs.qp, numPts, numLabels,
+            "Joint velocities");
+        if (inputs.bodies.size() != inputs.stations.size()) {
+            throw OpenSim::Exception(
+                "Point kinematics needs one body per station.");
+        }
+        throwKernelError(::calcPointKinematics(pool, binding, inputs,
+            outputs, &resultCache, &profiler));
+    }
+
+private:
+    void checkLoaded() const {
+        if (!isLoaded()) {
+            throw OpenSim::Exception("No OpenSim model has been loaded.");
+        }
+    }
+
+    // Checks the sizes of the frame inputs against the binding and the
+    // model so the kernels' parallel regions only make OpenSim and Simbody
+    // calls
+    void checkInverseDynamicsInputs(const InverseDynamicsInputs& inputs,
+            bool needsAccelerations) {
+        checkLoaded();
+        const int numPts = inputs.q.rows;
+        const int numLabels = (int) binding.labels.size();
+        if (inputs.time == nullptr) {
+            throw OpenSim::Exception("Inverse dynamics needs frame times.");
+        }
+        checkKernelInputSize(inputs.q, numPts, numLabels, "Joint angles");
+        checkKernelInputSize(inputs.qp, numPts, numLabels,
+            "Joint velocities");
+        if (needsAccelerations) {
+            checkKernelInputSize(inputs.qpp, numPts, numLabels,
+                "Joint accelerations");
+        }
+        if (inputs.controls.columns > 0) {
+            checkKernelInputSize(inputs.controls, numPts, 0, "Applied loads");
+        }
+        checkFrameBodyForces(inputs.bodyForces, numPts);
+        if (inputs.computeMetabolicCost) {
+            ModelReplica& base = pool.getBase();
+            checkKernelInputSize(inputs.muscleActivations, numPts, 0,
+                "Muscle activations");
+            if (inputs.muscleActivations.columns >
+                    (int) base.muscles.size()) {
+                throw OpenSim::Exception("More muscle activations were "
+                    "given than the model has muscles.");
+            }
+            if (base.model->getProbeSet().getSize() == 0) {
+                throw OpenSim::Exception(
+                    "Metabolic cost requires a probe in the model.");
+            }
+        }
+    }
+
+    void checkFrameBodyForces(const FrameBodyForces& bodyForces,
+            int numPts) const {
+        if (bodyForces.isEmpty()) {
+            return;
+        }
+        const int numBodies = (int) bodyForces.bodies.size();
+        if ((int) bodyForces.stations.size() != numBodies) {
+            throw OpenSim::Exception("Body forces need one station per body.");
+        }
+        checkKernelInputSize(bodyForces.values, numPts, 6 * numBodies,
+            "Body forces");
+    }
+
+    void checkFrameChannels(const InverseDynamicsInputs& inputs,
+            const InverseDynamicsOutputs& outputs) const {
+        if (outputs.channels.size() != inputs.channels.size()) {
+            throw OpenSim::Exception(
+                "Each output channel request needs one output.");
+        }
+        for (size_t c = 0; c < inputs.channels.size(); c++) {
+            const FrameChannel& channel = inputs.channels[c];
+            const bool isStation = channel.kind == channelStationPosition ||
+                channel.kind == channelStationVelocity;
+            if (isStation && channel.stations.size() != channel.bodies.size()) {
+                throw OpenSim::Exception(
+                    "Station channels need one station per body.");
+            }
+            const OutputMatrixView& output = outputs.channels[c];
+            if (output.rows != inputs.q.rows ||
+                    output.columns < channel.getNumColumns()) {
+                throw OpenSim::Exception(std::string("The output of the ") +
+                    getFrameChannelName(channel.kind) +
+                    " channel is smaller than its frames and columns.");
+            }
+        }
+    }
+
+    ModelReplicaPool pool;
+    CoordinateBinding binding;
+    bool isBound = false;
+    FrameResultCache resultCache;
+    KernelProfiler profiler;
+    RetainedFrameKinematics retained;
+    std::string modelFile;
+    int requestedThreads = 0;
+    std::vector<ModelParameterUpdate> parameterUpdates;
+    // Last, so its worker finishes before the rest of the session is freed
+    KernelTaskQueue tasks;
+};
+
+#endif
@@ -0,0 +1,475 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Argument handling shared by the MEX functions that keep a ModelSession.
+// These functions turn MATLAB arguments into session calls and session
+// exceptions into MATLAB errors; the model work itself is in the session.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_SESSION_MEX_H
+#define NMSM_MODEL_SESSION_MEX_H
+
+#include "mex.h"
+#include <chrono>
+#include <future>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "MexArrayHelpers.h"
+#include "ModelSession.h"
+#include "ModelSessionRegistry.h"
+
+// Runs a session call and reports its exception as a MATLAB error
+template <class Call>
+inline void mexCallSession(Call call) {
+    std::string error;
+    try {
+        call();
+    }
+    catch (const std::exception& ex) {
+        error = ex.what();
+    }
+    // The error is raised after the handler so no exception object is live
+    // when MATLAB unwinds the call
+    if (!error.empty()) {
+        mexErrMsgTxt(error.c_str());
+    }
+}
+
+inline void mexCheckModelSession(const ModelSession& session) {
+    if (!session.isLoaded()) {
+        mexErrMsgTxt("!!!No OpenSim model has been loaded!!!\n");
+    }
+}
+
+// Runs a session call that may parse a model, discarding OpenSim's
+// console output while parsing, and reports its exception as a MATLAB
+// error
+template <class Call>
+inline void mexCallSessionQuietly(Call call) {
+    std::streambuf* oldCoutStreamBuf = std::cout.rdbuf();
+    std::ostringstream strCout;
+    std::cout.rdbuf(strCout.rdbuf());
+    std::string error;
+    try {
+        call();
+    }
+    catch (const std::exception& ex) {
+        error = ex.what();
+    }
+    std::cout.rdbuf(oldCoutStreamBuf);
+    if (!error.empty()) {
+        mexErrMsgTxt(error.c_str());
+    }
+}
+
+inline std::string mexReadModelFile(const mxArray *input) {
+    char* cArray = mxArrayToString(input);
+    if (cArray == NULL) {
+        mexErrMsgTxt("The model file must be a char array.\n");
+    }
+    const std::string modelFile = cArray;
+    mxFree(cArray);
+    return modelFile;
+}
+
+// Loads the model file of args[0] with the optional thread count of
+// args[1], which defaults to OMP_NUM_THREADS or the number of cores
+inline void mexLoadModelSession(ModelSession& session, int nrhs,
+        const mxArray *args[]) {
+    const std::string modelFile = mexReadModelFile(args[0]);
+    const int requestedThreads = nrhs > 1 ? (int) mxGetScalar(args[1]) : 0;
+    mexCallSessionQuietly([&]() {
+        session.load(modelFile, requestedThreads);
+    });
+}
+
+// Handles the session handle commands and returns false for other calls:
+// ('loadSession', modelFile[, numThreads]) loads a model into a new session
+// and returns its handle.
+// ('releaseSession', handle) frees a session and its model.
+// ('configureSessionMemory', budgetBytes) sets the estimated memory above
+// which the least recently used sessions release their models until their
+// next use. A budget of 0 never releases them.
+// ('sessionStatistics') returns a struct with the sessions, the sessions
+// with a loaded model, the memory estimate and budget, and the evictions.
+inline bool mexSessionRegistryCommand(ModelSessionRegistry& registry,
+        mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    if (mexArgumentIsCommand(prhs[0], "loadSession")) {
+        if (nrhs != 2 && nrhs != 3) {
+            mexErrMsgTxt("loadSession takes a model file and thread count.\n");
+        }
+        const std::string modelFile = mexReadModelFile(prhs[1]);
+        const int requestedThreads = nrhs > 2 ? (int) mxGetScalar(prhs[2]) : 0;
+        int handle = 0;
+        mexCallSessionQuietly([&]() {
+            handle = registry.load(modelFile, requestedThreads);
+        });
+        plhs[0] = mxCreateDoubleScalar(handle);
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "releaseSession")) {
+        if (nrhs != 2) {
+            mexErrMsgTxt("releaseSession takes a session handle.\n");
+        }
+        mexCallSession([&]() { registry.release((int) mxGetScalar(prhs[1])); });
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "configureSessionMemory")) {
+        if (nrhs != 2 || mxGetScalar(prhs[1]) < 0) {
+            mexErrMsgTxt("configureSessionMemory takes a nonnegative budget in bytes.\n");
+        }
+        registry.setMemoryBudget((std::size_t) mxGetScalar(prhs[1]));
+        return true;
+    }
+    if (mexArgumentIsCommand(prhs[0], "sessionStatistics")) {
+        const ModelSessionStatistics statistics = registry.getStatistics();
+        const char* fields[5] = {"sessions", "resident", "memoryEstimate",
+            "memoryBudget", "evictions"};
+        plhs[0] = mxCreateStructMatrix(1, 1, 5, fields);
+        mxSetField(plhs[0], 0, "sessions",
+            mxCreateDoubleScalar((double) statistics.sessions));
+        mxSetField(plhs[0], 0, "resident",
+            mxCreateDoubleScalar((double) statistics.resident));
+        mxSetField(plhs[0], 0, "memoryEstimate",
+            mxCreateDoubleScalar((double) statistics.memoryEstimate));
+        mxSetField(plhs[0], 0, "memoryBudget",
+            mxCreateDoubleScalar((double) statistics.memoryBudget));
+        mxSetField(plhs[0], 0, "evictions",
+            mxCreateDoubleScalar((double) statistics.evictions));
+        return true;
+    }
+    return false;
+}
+
+// Returns the session that a call uses. Calls of the form ('session',
+// handle, <call arguments>) use the session of the handle and have their
+// first two arguments removed; other calls use the default session, which
+// is loaded with (modelFile[, numThreads]). Sessions of handles are only
+// loaded with loadSession. An evicted session is loaded again here.
+inline ModelSession& mexSelectSession(ModelSessionRegistry& registry,
+        ModelSession& defaultSession, int& nrhs, const mxArray **&prhs) {
+    if (!mexArgumentIsCommand(prhs[0], "session")) {
+        return defaultSession;
+    }
+    if (nrhs < 3 || !mxIsDouble(prhs[1])) {
+        mexErrMsgTxt("Session calls take a handle and the arguments of a call.\n");
+    }
+    ModelSession* session = nullptr;
+    const int handle = (int) mxGetScalar(prhs[1]);
+    mexCallSessionQuietly([&]() { session = &registry.get(handle); });
+    nrhs -= 2;
+    prhs += 2;
+    return *session;
+}
+
+// Binds a cell array of coordinate labels
+inline const CoordinateBinding& mexBindCoordinates(ModelSession& session,
+        const mxArray *labels) {
+    const std::vector<std::string> coordinateLabels =
+        mexCellToStrings(labels);
+    mexCallSession([&]() { session.bindCoordinates(coordinateLabels); });
+    return session.getBinding();
+}
+
+// Mobilized bodies of an array of zero-based body set indices
+inline std::vector<SimTK::MobilizedBodyIndex> mexGetBodies(
+        ModelSession& session, const mxArray *indices,
+        const std::string& name) {
+    const double* bodyIndices = mxGetPr(indices);
+    std::vector<SimTK::MobilizedBodyIndex> bodies(
+        mxGetNumberOfElements(indices));
+    mexCallSession([&]() {
+        for (size_t j = 0; j < bodies.size(); j++) {
+            bodies[j] = session.getBody((int) bodyIndices[j], name);
+        }
+    });
+    return bodies;
+}
+
+// Handles ('configureSchedule', kind[, grain[, pinThreads]]) and returns
+// false for other calls. kind is 'automatic', 'static', 'dynamic' or
+// 'guided', and a grain of 0 chooses the frames per chunk from the frames
+// and threads of each call.
+inline bool mexScheduleCommand(ModelSession& session, int nrhs,
+        const mxArray *prhs[]) {
+    if (!mexArgumentIsCommand(prhs[0], "configureSchedule")) {
+        return false;
+    }
+    if (nrhs < 2 || nrhs > 4 || !mxIsChar(prhs[1])) {
+        mexErrMsgTxt("configureSchedule takes a kind, grain and pinThreads.\n");
+    }
+    FrameScheduleOptions options;
+    char* cArray = mxArrayToString(prhs[1]);
+    const bool isKind = getFrameScheduleKind(cArray, options.kind);
+    mxFree(cArray);
+    if (!isKind) {
+        mexErrMsgTxt("Schedule kind must be 'automatic', 'static', 'dynamic' or 'guided'.\n");
+    }
+    if (nrhs > 2) {
+        if (mxGetScalar(prhs[2]) < 0) {
+            mexErrMsgTxt("Schedule grain must be nonnegative.\n");
+        }
+        options.grain = (int) mxGetScalar(prhs[2]);
+    }
+    options.pinThreads = nrhs > 3 && mxGetScalar(prhs[3]) > 0.5;
+    session.getPool().setScheduleOptions(options);
+    return true;
+}
+
+// Handles ('updateParameters', updates) and returns false for other calls.
+// updates is a struct array with the fields component (a component path),
+// property (a double or Vec3 property name) and values.
+inline bool mexParameterCommand(ModelSession& session, int nrhs,
+        const mxArray *prhs[]) {
+    if (!mexArgumentIsCommand(prhs[0], "updateParameters")) {
+        return false;
+    }
+    if (nrhs != 2 || !mxIsStruct(prhs[1])) {
+        mexErrMsgTxt("updateParameters takes a struct array of updates.\n");
+    }
+    mexCheckModelSession(session);
+    std::vector<ModelParameterUpdate> updates(mxGetNumberOfElements(prhs[1]));
+    for (size_t j = 0; j < updates.size(); j++) {
+        const mxArray* component = mxGetField(prhs[1], j, "component");
+        const mxArray* property = mxGetField(prhs[1], j, "property");
+        const mxArray* values = mxGetField(prhs[1], j, "values");
+        if (component == NULL || property == NULL || values == NULL ||
+                !mxIsChar(component) || !mxIsChar(property) ||
+                !mxIsDouble(values)) {
+            mexErrMsgTxt("Parameter updates need a component, property and values.\n");
+        }
+        char* cArray = mxArrayToString(component);
+        updates[j].component = cArray;
+        mxFree(cArray);
+        cArray = mxArrayToString(property);
+        updates[j].property = cArray;
+        mxFree(cArray);
+        const double* valueArray = mxGetPr(values);
+        updates[j].values.assign(valueArray,
+            valueArray + mxGetNumberOfElements(values));
+    }
+    mexCallSessionQuietly([&]() { session.updateParameters(updates); });
+    return true;
+}
+
+// A call made with ('submit', <call arguments>). Its arguments are
+// persistent copies, so MATLAB may change or clear the originals while the
+// call runs, and its outputs stay persistent until they are collected.
+struct MexSubmittedCall {
+    std::vector<mxArray*> arguments;
+    std::vector<mxArray*> outputs;
+    std::future<void> result;
+};
+
+// The submitted calls of a MEX function, named by tickets that start at 1
+// and are not reused. A submission is marshalled like the same call made
+// directly and then queued on its session instead of run:
+//     submissions.prepare(session, nrhs, prhs, plhs, commands);
+//     <read the arguments and create the outputs as usual>
+//     submissions.run(session, call);
+//     submissions.finish();
+class MexSubmittedCalls {
+public:
+    // Handles the ticket commands and returns false for other calls:
+    // ('waitTicket', ticket) waits for a submitted call and returns its
+    // outputs, or raises its error.
+    // ('isTicketDone', ticket) returns true if the call has finished.
+    bool command(mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+        const bool isWait = mexArgumentIsCommand(prhs[0], "waitTicket");
+        if (!isWait && !mexArgumentIsCommand(prhs[0], "isTicketDone")) {
+            return false;
+        }
+        if (nrhs != 2 || !mxIsDouble(prhs[1])) {
+            mexErrMsgTxt("Ticket commands take a ticket.\n");
+        }
+        auto found = calls.find((int) mxGetScalar(prhs[1]));
+        if (found == calls.end()) {
+            mexErrMsgTxt("The ticket is not a call submitted to this MEX function or was already collected.\n");
+        }
+        if (!isWait) {
+            plhs[0] = mxCreateLogicalScalar(found->second->result.wait_for(
+                std::chrono::seconds(0)) == std::future_status::ready);
+            return true;
+        }
+        std::unique_ptr<MexSubmittedCall> call = std::move(found->second);
+        calls.erase(found);
+        std::string error;
+        try {
+            call->result.get();
+        }
+        catch (const std::exception& ex) {
+            error = ex.what();
+        }
+        // Persistent arrays are copied into arrays that MATLAB owns
+        for (size_t k = 0; k < call->outputs.size(); k++) {
+            if (error.empty()) {
+                plhs[k] = mxDuplicateArray(call->outputs[k]);
+            }
+            mxDestroyArray(call->outputs[k]);
+        }
+        call->outputs.clear();
+        destroyArguments(*call);
+        call.reset();
+        if (!error.empty()) {
+            mexErrMsgTxt(error.c_str());
+        }
+        return true;
+    }
+
+    // Starts a submission if the call is ('submit', <call arguments>) and
+    // otherwise drains the session's queue, so other calls see the session
+    // as the submitted calls left it. Submissions may be of the named
+    // commands or of a kernel call without a command. Their arguments are
+    // replaced by persistent copies without 'submit', and plhs is pointed
+    // at outputs that finish() keeps. Submissions drain the queue too when
+    // the session's profiler is enabled, because its call counters are set
+    // up while marshalling.
+    void prepare(ModelSession& session, int& nrhs, const mxArray **&prhs,
+            mxArray **&plhs, std::initializer_list<const char*> commands) {
+        discardSubmission();
+        if (!mexArgumentIsCommand(prhs[0], "submit")) {
+            session.getTaskQueue().drain();
+            return;
+        }
+        bool isSubmittable = nrhs > 3 && !mxIsChar(prhs[1]);
+        for (const char* name : commands) {
+            isSubmittable = isSubmittable || mexArgumentIsCommand(prhs[1], name);
+        }
+        if (!isSubmittable) {
+            mexErrMsgTxt("Only kernel calls can be submitted.\n");
+        }
+        if (session.getProfiler().isEnabled()) {
+            session.getTaskQueue().drain();
+        }
+        submitted.reset(new MexSubmittedCall());
+        callerOutputs = plhs;
+        for (int j = 1; j < nrhs; j++) {
+            mxArray* copy = mxDuplicateArray(prhs[j]);
+            mexMakeArrayPersistent(copy);
+            submitted->arguments.push_back(copy);
+        }
+        arguments.assign(submitted->arguments.begin(),
+            submitted->arguments.end());
+        for (mxArray*& output : outputs) {
+            output = NULL;
+        }
+        nrhs--;
+        prhs = arguments.data();
+        plhs = outputs;
+    }
+
+    // Runs a session call now, or queues it when the call is a submission.
+    // A queued call must hold copies of its inputs and outputs.
+    template <class Call>
+    void run(ModelSession& session, Call call) {
+        if (!submitted) {
+            mexCallSession(call);
+            return;
+        }
+        submitted->result = session.getTaskQueue().submit(call);
+    }
+
+    // Ends a submission: keeps its outputs and returns its ticket
+    void finish() {
+        if (!submitted) {
+            return;
+        }
+        if (!submitted->result.valid()) {
+            discardSubmission();
+            mexErrMsgTxt("The submitted call did not run a kernel.\n");
+        }
+        for (mxArray* output : outputs) {
+            if (output != NULL) {
+                mexMakeArrayPersistent(output);
+                submitted->outputs.push_back(output);
+            }
+        }
+        const int ticket = nextTicket++;
+        calls[ticket] = std::move(submitted);
+        callerOutputs[0] = mxCreateDoubleScalar(ticket);
+    }
+
+    // Frees the calls that were not collected. The sessions' queues must
+    // be stopped first.
+    void clear() {
+        discardSubmission();
+        for (auto& entry : calls) {
+            for (mxArray* output : entry.second->outputs) {
+                mxDestroyArray(output);
+            }
+            destroyArguments(*entry.second);
+        }
+        calls.clear();
+    }
+
+private:
+    static void destroyArguments(MexSubmittedCall& call) {
+        for (mxArray* argument : call.arguments) {
+            mxDestroyArray(argument);
+        }
+        call.arguments.clear();
+    }
+
+    // Frees the arguments of a submission that raised an error before it
+    // was queued. Its outputs were not made persistent, so MATLAB frees
+    // them with the call.
+    void discardSubmission() {
+        if (submitted) {
+            if (submitted->result.valid()) {
+                submitted->result.wait();
+            }
+            destroyArguments(*submitted);
+            submitted.reset();
+        }
+    }
+
+    std::map<int, std::unique_ptr<MexSubmittedCall>> calls;
+    std::unique_ptr<MexSubmittedCall> submitted;
+    std::vector<const mxArray*> arguments;
+    mxArray* outputs[16];
+    mxArray** callerOutputs = nullptr;
+    int nextTicket = 1;
+};
+
+// Reads (time, q, qp, qpp, coordinateLabels, appliedLoads) starting at
+// args[0] and binds the labels. The views read the MATLAB buffers in
+// place.
+inline InverseDynamicsInputs mexReadInverseDynamicsInputs(
+        ModelSession& session, const mxArray *args[]) {
+    InverseDynamicsInputs inputs;
+    inputs.time = mxGetPr(args[0]);
+    inputs.q = mexArrayToView(args[1]);
+    inputs.qp = mexArrayToView(args[2]);
+    inputs.qpp = mexArrayToView(args[3]);
+    inputs.controls = mexArrayToView(args[5]);
+    checkInputRows(inputs.q, (int) mxGetM(args[0]), 0, "Joint angles");
+    mexBindCoordinates(session, args[4]);
+    return inputs;
+}
+
+#endif
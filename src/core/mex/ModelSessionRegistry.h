@@ -0,0 +1,168 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Model sessions kept side by side and named by handles, so callers that
+// alternate between models, such as the feet of Ground Contact
+// Personalization or the subjects of a batch job, do not parse a model
+// again each time they switch. When the estimated memory of the sessions
+// exceeds a budget, the least recently used sessions release their models
+// and load them again from their model files on their next use.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MODEL_SESSION_REGISTRY_H
+#define NMSM_MODEL_SESSION_REGISTRY_H
+
+#include <OpenSim/OpenSim.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include "ModelSession.h"
+
+struct ModelSessionStatistics {
+    std::size_t sessions = 0;
+    // Sessions whose model is loaded
+    std::size_t resident = 0;
+    std::size_t memoryEstimate = 0;
+    std::size_t memoryBudget = 0;
+    std::size_t evictions = 0;
+};
+
+// Handles start at 1 and are not reused, so a released handle is never
+// mistaken for a newer session. Like ModelSession, the registry is used by
+// one caller at a time.
+class ModelSessionRegistry {
+public:
+    // Loads the model file into a new session and returns its handle. A
+    // thread count of zero or less uses omp_get_max_threads().
+    int load(const std::string& modelFile, int numThreads) {
+        Entry entry;
+        entry.session.reset(new ModelSession());
+        entry.session->load(modelFile, numThreads);
+        entry.lastUse = ++useCount;
+        const int handle = nextHandle++;
+        entries[handle] = std::move(entry);
+        evictOthers(handle);
+        return handle;
+    }
+
+    // The session of a handle, with its model and parameter updates loaded
+    // again if it was evicted. Other sessions may be evicted to stay within
+    // the budget.
+    ModelSession& get(int handle) {
+        Entry& entry = find(handle);
+        if (!entry.session->isLoaded()) {
+            entry.session->reload();
+        }
+        entry.lastUse = ++useCount;
+        evictOthers(handle);
+        return *entry.session;
+    }
+
+    void release(int handle) {
+        find(handle);
+        entries.erase(handle);
+    }
+
+    void clear() { entries.clear(); }
+
+    // A budget of 0, the default, never evicts. The session in use is kept
+    // even if it alone exceeds the budget.
+    void setMemoryBudget(std::size_t bytes) {
+        memoryBudget = bytes;
+        evictOthers(0);
+    }
+
+    ModelSessionStatistics getStatistics() const {
+        ModelSessionStatistics statistics;
+        statistics.sessions = entries.size();
+        for (const auto& entry : entries) {
+            if (entry.second.session->isLoaded()) {
+                statistics.resident++;
+            }
+        }
+        statistics.memoryEstimate = getMemoryEstimate();
+        statistics.memoryBudget = memoryBudget;
+        statistics.evictions = evictions;
+        return statistics;
+    }
+
+private:
+    struct Entry {
+        std::unique_ptr<ModelSession> session;
+        std::uint64_t lastUse = 0;
+    };
+
+    Entry& find(int handle) {
+        auto entry = entries.find(handle);
+        if (entry == entries.end()) {
+            throw OpenSim::Exception("Model session " +
+                std::to_string(handle) + " is not loaded.");
+        }
+        return entry->second;
+    }
+
+    std::size_t getMemoryEstimate() const {
+        std::size_t bytes = 0;
+        for (const auto& entry : entries) {
+            bytes += entry.second.session->getMemoryEstimate();
+        }
+        return bytes;
+    }
+
+    // Evicts the least recently used sessions other than keepHandle until
+    // the estimate is within the budget. Eviction keeps each session's
+    // cache capacity, profiler and schedule settings.
+    void evictOthers(int keepHandle) {
+        if (memoryBudget == 0) {
+            return;
+        }
+        std::size_t bytes = getMemoryEstimate();
+        while (bytes > memoryBudget) {
+            Entry* oldest = nullptr;
+            for (auto& entry : entries) {
+                if (entry.first != keepHandle &&
+                        entry.second.session->isLoaded() &&
+                        (oldest == nullptr ||
+                        entry.second.lastUse < oldest->lastUse)) {
+                    oldest = &entry.second;
+                }
+            }
+            if (oldest == nullptr) {
+                return;
+            }
+            bytes -= oldest->session->getMemoryEstimate();
+            oldest->session->clear();
+            evictions++;
+        }
+    }
+
+    std::map<int, Entry> entries;
+    int nextHandle = 1;
+    std::uint64_t useCount = 0;
+    std::size_t memoryBudget = 0;
+    std::size_t evictions = 0;
+};
+
+#endif
@@ -0,0 +1,325 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Native version of the Muscle Tendon Personalization muscle model chain in
+// calcMtpModeledValues.m. EMG splines are evaluated with the
+// electromechanical delay, filtered into neural activations, passed through
+// the activation nonlinearity and combined with the Hill-type force curves
+// to give muscle joint moments. Each muscle of each trial is processed in
+// one pass over its frames and its force is summed into the joint moments
+// directly, so none of the expanded arrays of calcMuscleJointMoments.m are
+// created. This header does not depend on MATLAB.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_MUSCLE_TENDON_MODEL_H
+#define NMSM_MUSCLE_TENDON_MODEL_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// activeForceLengthCurve.m
+inline double calcActiveForceLength(double length) {
+    const double b11 = 0.8174335195120225;
+    const double b21 = 1.054348561163096;
+    const double b31 = 0.16194288662761705;
+    const double b41 = 0.06381565266097716;
+    const double b12 = 0.43130780147182907;
+    const double b22 = 0.7163004817144202;
+    const double b32 = -0.029060905806803296;
+    const double b42 = 0.19835014521987723;
+    const double b13 = 0.1;
+    const double b23 = 1.0;
+    const double b33 = 0.353553390593274;
+    const double b43 = 0.0;
+    const double width1 = b31 + b41 * length;
+    const double width2 = b32 + b42 * length;
+    const double width3 = b33 + b43 * length;
+    return b11 * std::exp(-0.5 * (length - b21) * (length - b21) /
+        (width1 * width1)) + b12 * std::exp(-0.5 * (length - b22) *
+        (length - b22) / (width2 * width2)) + b13 * std::exp(-0.5 *
+        (length - b23) * (length - b23) / (width3 * width3));
+}
+
+// forceVelocityCurve.m
+inline double calcForceVelocity(double velocity) {
+    const double d1 = -32.51401019139919;
+    const double d2 = 22.160392466960214;
+    const double d3 = 18.7932134796918;
+    const double d4 = 6.320952269683997;
+    const double d5 = -0.27671677680513945;
+    const double d6 = 8.053304562566995;
+    return d1 + d2 * std::atan(d3 + d4 * std::atan(d5 + d6 * velocity));
+}
+
+// passiveForceLengthCurve.m, written as a softplus that cannot overflow
+inline double calcPassiveForceLength(double length) {
+    const double e1 = 0.232000797810576;
+    const double e2 = 12.438535493526128;
+    const double e3 = 1.329470475731338;
+    const double x = 0.5 * e2 * (length - e3);
+    const double magnitude = std::fabs(x);
+    return e1 * (x + magnitude + std::log1p(std::exp(-2.0 * magnitude)));
+}
+
+// calcMuscleActivations.m, see Meyer 2017 equation 8
+inline double calcMuscleActivation(double neuralActivation,
+        double nonlinearity) {
+    const double g1 = 29.280183270562596;
+    const double g2 = 4.107869238218326;
+    const double g3 = 1.000004740962477;
+    const double g4 = -7.623282868703527;
+    const double g5 = 17.227022969058535;
+    const double g6 = 0.884220539986325;
+    const double bracketed = g4 / (g1 * std::pow(neuralActivation + g6, g5) +
+        g2) + g3;
+    return (1.0 - nonlinearity) * neuralActivation + nonlinearity * bracketed;
+}
+
+// Per-muscle values given either once for all muscles or once per muscle
+struct MuscleParameter {
+    const double* data = nullptr;
+    int size = 0;
+
+    double operator[](int muscle) const {
+        return size == 1 ? data[0] : data[muscle];
+    }
+    bool isValid(int numMuscles) const {
+        return data != nullptr && (size == 1 || size == numMuscles);
+    }
+};
+
+// Experimental data of calcMtpModeledValues.m in MATLAB memory order. The
+// EMG spline of each trial and muscle is a cubic piecewise polynomial with
+// the breaks of its trial. Breaks are (pieces + 1) x trials and
+// coefficients are 4 x pieces x muscles x trials. Muscle tendon lengths and
+// velocities are trials x muscles x frames and moment arms are
+// trials x coordinates x muscles x frames.
+struct MtpExperimentalData {
+    int numTrials = 0;
+    int numMuscles = 0;
+    int numCoordinates = 0;
+    int numEmgFrames = 0;
+    int numPaddingFrames = 0;
+    int numPieces = 0;
+    const double* emgTime = nullptr;
+    const double* splineBreaks = nullptr;
+    const double* splineCoefficients = nullptr;
+    const double* muscleTendonLength = nullptr;
+    const double* muscleTendonVelocity = nullptr;
+    const double* momentArms = nullptr;
+    MuscleParameter maxIsometricForce;
+    MuscleParameter pennationAngle;
+    MuscleParameter optimalFiberLength;
+    MuscleParameter tendonSlackLength;
+    MuscleParameter vMaxFactor;
+
+    int numFrames() const { return numEmgFrames - 2 * numPaddingFrames; }
+};
+
+// Design variables of makeMtpValuesAsStruct.m
+struct MtpDesignValues {
+    MuscleParameter electromechanicalDelays;
+    MuscleParameter activationTimeConstants;
+    MuscleParameter activationNonlinearityConstants;
+    MuscleParameter emgScaleFactors;
+    MuscleParameter optimalFiberLengthScaleFactors;
+    MuscleParameter tendonSlackLengthScaleFactors;
+};
+
+// Outputs of calcMtpModeledValues.m. Excitations are
+// trials x muscles x EMG frames, joint moments are
+// trials x coordinates x frames and the rest are trials x muscles x frames.
+struct MtpModeledValues {
+    double* muscleExcitations = nullptr;
+    double* muscleActivations = nullptr;
+    double* normalizedFiberLength = nullptr;
+    double* normalizedFiberVelocity = nullptr;
+    double* passiveForce = nullptr;
+    double* muscleJointMoments = nullptr;
+};
+
+// Evaluates the piecewise cubic at increasing times like ppval, using the
+// end pieces outside the breaks
+inline void evaluateCubicSpline(const double* breaks,
+        const double* coefficients, int numPieces, const double* times,
+        int numTimes, double* values) {
+    int piece = 0;
+    for (int j = 0; j < numTimes; j++) {
+        const double time = times[j];
+        while (piece > 0 && time < breaks[piece]) piece--;
+        while (piece < numPieces - 1 && time >= breaks[piece + 1]) piece++;
+        const double* c = coefficients + 4 * piece;
+        const double s = time - breaks[piece];
+        values[j] = ((c[0] * s + c[1]) * s + c[2]) * s + c[3];
+    }
+}
+
+// Runs the whole chain for every trial. Muscles of all trials are split
+// across threads, then the joint moments of each trial and frame are summed
+// over muscles. Returns false if the design values do not match the data.
+inline bool calcMtpModeledValuesBatch(const MtpExperimentalData& data,
+        const MtpDesignValues& values, const MtpModeledValues& outputs,
+        int numThreads) {
+    const int numTrials = data.numTrials;
+    const int numMuscles = data.numMuscles;
+    const int numEmgFrames = data.numEmgFrames;
+    const int numFrames = data.numFrames();
+    if (numFrames < 1 || numEmgFrames < 3 || !values.electromechanicalDelays.isValid(numMuscles)
+            || !values.activationTimeConstants.isValid(numMuscles)
+            || !values.activationNonlinearityConstants.isValid(numMuscles)
+            || !values.emgScaleFactors.isValid(numMuscles)
+            || !values.optimalFiberLengthScaleFactors.isValid(numMuscles)
+            || !values.tendonSlackLengthScaleFactors.isValid(numMuscles)) {
+        return false;
+    }
+    const std::ptrdiff_t muscleStride = (std::ptrdiff_t) numTrials *
+        numMuscles;
+    // Muscle forces along the tendon before the moment arms are applied
+    std::vector<double> muscleForces((std::size_t) muscleStride * numFrames);
+
+    #pragma omp parallel num_threads(numThreads)
+    {
+        std::vector<double> times(numEmgFrames);
+        std::vector<double> excitations(numEmgFrames);
+        std::vector<double> neuralActivations(numEmgFrames);
+        #pragma omp for schedule(dynamic)
+        for (int n = 0; n < numTrials * numMuscles; n++) {
+            const int trial = n % numTrials;
+            const int muscle = n / numTrials;
+            const std::ptrdiff_t offset = trial + (std::ptrdiff_t) numTrials *
+                muscle;
+
+            // calcMuscleExcitations.m with the delay in tenths of a second
+            const double firstTime = data.emgTime[trial];
+            const double lastTime = data.emgTime[trial + (std::ptrdiff_t)
+                numTrials * (numEmgFrames - 1)];
+            const double delay = values.electromechanicalDelays[muscle] / 10;
+            for (int j = 0; j < numEmgFrames; j++) {
+                const double fraction = numEmgFrames > 1 ?
+                    (double) j / (numEmgFrames - 1) : 0.0;
+                times[j] = (lastTime - firstTime) * fraction + firstTime -
+                    delay;
+            }
+            evaluateCubicSpline(data.splineBreaks + (std::ptrdiff_t)
+                (data.numPieces + 1) * trial, data.splineCoefficients +
+                4 * (std::ptrdiff_t) data.numPieces * (muscle +
+                (std::ptrdiff_t) numMuscles * trial), data.numPieces,
+                times.data(), numEmgFrames, excitations.data());
+            const double scaleFactor = values.emgScaleFactors[muscle];
+            for (int j = 0; j < numEmgFrames; j++) {
+                excitations[j] *= scaleFactor;
+                outputs.muscleExcitations[offset + muscleStride * j] =
+                    excitations[j];
+            }
+
+            // calcNeuralActivations.m, equations 5 to 7 from Meyer 2017
+            const double activationTimeConstant =
+                values.activationTimeConstants[muscle] / 100;
+            const double inverseDeactivationTimeConstant = 1.0 /
+                (4 * activationTimeConstant);
+            const double differenceOfTimeConstants = 1.0 /
+                activationTimeConstant - inverseDeactivationTimeConstant;
+            double timeIntervalSum = 0.0;
+            for (int j = 1; j < numEmgFrames; j++)
+                timeIntervalSum += data.emgTime[trial + (std::ptrdiff_t)
+                    numTrials * j] - data.emgTime[trial + (std::ptrdiff_t)
+                    numTrials * (j - 1)];
+            const double timeInterval = timeIntervalSum / (numEmgFrames - 1);
+            neuralActivations[0] = 0.0;
+            neuralActivations[1] = 0.0;
+            for (int j = 2; j < numEmgFrames; j++) {
+                const double timeConstants = 2 * timeInterval *
+                    (differenceOfTimeConstants * excitations[j] +
+                    inverseDeactivationTimeConstant);
+                neuralActivations[j] = (timeConstants * excitations[j] +
+                    4 * neuralActivations[j - 1] - neuralActivations[j - 2]) /
+                    (timeConstants + 3);
+            }
+
+            // Fiber kinematics, equations 2 and 3 from Meyer 2017, and the
+            // force along the tendon
+            const double cosPennation = std::cos(data.pennationAngle[muscle]);
+            const double optimalFiberLength =
+                data.optimalFiberLength[muscle] *
+                values.optimalFiberLengthScaleFactors[muscle];
+            const double tendonSlackLength = data.tendonSlackLength[muscle] *
+                values.tendonSlackLengthScaleFactors[muscle];
+            const double maxIsometricForce = data.maxIsometricForce[muscle];
+            const double lengthScale = 1.0 / (optimalFiberLength *
+                cosPennation);
+            const double velocityScale = 1.0 / (data.vMaxFactor[muscle] *
+                optimalFiberLength * cosPennation);
+            const double nonlinearity =
+                values.activationNonlinearityConstants[muscle];
+            for (int i = 0; i < numFrames; i++) {
+                const std::ptrdiff_t index = offset + muscleStride * i;
+                double neuralActivation =
+                    neuralActivations[i + data.numPaddingFrames];
+                neuralActivation = neuralActivation < 0 ? 0 :
+                    neuralActivation;
+                const double activation = calcMuscleActivation(
+                    neuralActivation, nonlinearity);
+                const double fiberLength = (data.muscleTendonLength[index] -
+                    tendonSlackLength) * lengthScale;
+                const double fiberVelocity =
+                    data.muscleTendonVelocity[index] * velocityScale;
+                const double passiveForce = calcPassiveForceLength(
+                    fiberLength);
+                outputs.muscleActivations[index] = activation;
+                outputs.normalizedFiberLength[index] = fiberLength;
+                outputs.normalizedFiberVelocity[index] = fiberVelocity;
+                outputs.passiveForce[index] = maxIsometricForce *
+                    cosPennation * passiveForce;
+                muscleForces[index] = maxIsometricForce * cosPennation *
+                    (activation * calcActiveForceLength(fiberLength) *
+                    calcForceVelocity(fiberVelocity) + passiveForce);
+            }
+        }
+
+        // calcMuscleJointMoments.m
+        const int numCoordinates = data.numCoordinates;
+        #pragma omp for schedule(static)
+        for (int n = 0; n < numTrials * numFrames; n++) {
+            const int trial = n % numTrials;
+            const int frame = n / numTrials;
+            double* moments = outputs.muscleJointMoments + trial +
+                (std::ptrdiff_t) numTrials * numCoordinates * frame;
+            for (int k = 0; k < numCoordinates; k++)
+                moments[(std::ptrdiff_t) numTrials * k] = 0.0;
+            for (int muscle = 0; muscle < numMuscles; muscle++) {
+                const double force = muscleForces[trial + (std::ptrdiff_t)
+                    numTrials * muscle + muscleStride * frame];
+                const double* momentArms = data.momentArms + trial +
+                    (std::ptrdiff_t) numTrials * numCoordinates *
+                    (muscle + (std::ptrdiff_t) numMuscles * frame);
+                for (int k = 0; k < numCoordinates; k++)
+                    moments[(std::ptrdiff_t) numTrials * k] +=
+                        momentArms[(std::ptrdiff_t) numTrials * k] * force;
+            }
+        }
+    }
+    return true;
+}
+
+#endif
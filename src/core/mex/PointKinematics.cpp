@@ -4,24 +4,36 @@
 #include <stdlib.h>
 #include <OpenSim/OpenSim.h>
 #include <omp.h>
+#include "MexArrayHelpers.h"
+#include "ModelSession.h"
+#include "ModelSessionMex.h"
+#include "ModelSessionRegistry.h"
+#include "ModelServerMex.h"
+#include "PointKinematicsKernel.h"
 
 using namespace OpenSim;
 using namespace SimTK;
 using namespace std;
-#define NTHREADS 20
 
 //______________________________________________________________________________
 
 
-static Model *osimModel[NTHREADS];
-static State *osimState[NTHREADS];
-static bool modelIsLoaded = false;
+// Replicas, coordinate binding, opt-in result cache and stage timers of the
+// model loaded without a handle
+static ModelSession defaultSession;
+// Sessions loaded with loadSession and used with ('session', handle, ...)
+static ModelSessionRegistry sessions;
+// Connection to a local model server, used by the server commands
+static ModelServerConnection serverConnection;
+// Calls made with ('submit', ...) until they are collected by ticket
+static MexSubmittedCalls submissions;
 
 void ClearMemory(void)
 {
-	for (int i = 0; i<NTHREADS; ++i)
-		delete osimModel[i];
-	modelIsLoaded = false;
+	defaultSession.clear();
+	sessions.clear();
+	submissions.clear();
+	serverConnection.client.disconnect();
 	mexPrintf("Cleared memory from opensimPointKin mex file.\n");
 }
 
@@ -30,112 +42,93 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 
 	mexAtExit(ClearMemory); // exit function to clear memory allocated in heap
 
-	if (nrhs == 1) // Load model if only one right hand side argument
-	{
-		if (modelIsLoaded == true) {
-			ClearMemory();
-		}
-		string model_name = mxArrayToString(prhs[0]);
-
-		std::streambuf* oldCoutStreamBuf = std::cout.rdbuf();
-		std::ostringstream strCout;
-		std::cout.rdbuf(strCout.rdbuf());
+	if (nrhs == 0) {
+		plhs[0] = mxCreateDoubleScalar(NMSM_MEX_INTERFACE_VERSION);
+		return;
+	}
+	if (mexSessionRegistryCommand(sessions, plhs, nrhs, prhs)) {
+		return;
+	}
+	if (mexModelServerCommand(serverConnection, plhs, nrhs, prhs) ||
+		mexServerPointKinematicsCommand(serverConnection, plhs, nrhs, prhs)) {
+		return;
+	}
+	if (submissions.command(plhs, nrhs, prhs)) {
+		return;
+	}
+	ModelSession& session = mexSelectSession(sessions, defaultSession, nrhs, prhs);
+	// ('submit', <point kinematics arguments>) returns a ticket at once and
+	// runs the call on the session's worker thread
+	submissions.prepare(session, nrhs, prhs, plhs, {});
+	if (mexFrameCacheCommand(session.getResultCache(), plhs, nrhs, prhs)) {
+		return;
+	}
+	if (mexProfilerCommand(session.getProfiler(), "pointKinematics", plhs, nrhs, prhs)) {
+		return;
+	}
+	if (mexScheduleCommand(session, nrhs, prhs)) {
+		return;
+	}
+	if (mexParameterCommand(session, nrhs, prhs)) {
+		return;
+	}
 
-		for (int i = 0; i < NTHREADS; ++i)
+	// Load model with an optional thread count, which defaults to
+	// OMP_NUM_THREADS or the number of cores
+	if (nrhs == 1 || nrhs == 2)
+	{
+		if (&session != &defaultSession)
 		{
-			osimModel[i] = new Model(model_name);
-			osimState[i] = &osimModel[i]->initSystem();
+			mexErrMsgTxt("Sessions with handles are loaded with loadSession.\n");
 		}
-
-		std::cout.rdbuf(oldCoutStreamBuf);
-		modelIsLoaded = true;
+		mexLoadModelSession(session, nrhs, prhs);
 	}
 	else if (nrhs == 6)
 	{
-		if (modelIsLoaded == false)
-		{
-			mexErrMsgTxt("!!!No OpenSim model has been loaded!!!\n");
-		}
+		mexCheckModelSession(session);
+		KernelProfiler& profiler = session.getProfiler();
+		profiler.beginCall(session.getNumThreads());
+		ProfileScope marshallingScope(&profiler, 0, profileInputMarshalling);
 
 		const int numPts = mxGetM(prhs[0]); // get number of rows of time vector
 		const int numSprings = mxGetN(prhs[3]); // get number of bodies springs are located on
-		const int numLabels = mxGetN(prhs[5]);
 
-		double *time = mxGetPr(prhs[0]); // time vector
-		double *q = mxGetPr(prhs[1]); // joint angles matrix
-		double *qp = mxGetPr(prhs[2]); // joint velocities matrix
+		// Inputs are read in place from the MATLAB buffers
+		PointKinematicsInputs inputs;
+		inputs.time = mxGetPr(prhs[0]); // time vector
+		inputs.q = mexArrayToView(prhs[1]); // joint angles matrix
+		inputs.qp = mexArrayToView(prhs[2]); // joint velocities matrix
 		double *SpringMat = mxGetPr(prhs[3]); // spring locations within body
-		double *SpringBodyMat = mxGetPr(prhs[4]); // body number index for springs
+		checkInputRows(inputs.q, numPts, 0, "Joint angles");
+		if (mxGetM(prhs[3]) != 3 || (int) mxGetNumberOfElements(prhs[4]) != numSprings)
+		{
+			mexErrMsgTxt("Point locations must be 3 x numPoints with one body index per point.\n");
+		}
+		mexBindCoordinates(session, prhs[5]);
 
-		OpenSim::BodySet *refBodySet[NTHREADS];
-		for (int i = 0; i<NTHREADS; ++i)
+		// Resolve spring bodies serially so the parallel region of the
+		// kernel only makes Simbody calls
+		inputs.bodies = mexGetBodies(session, prhs[4], "Point kinematics");
+		for (int j = 0; j < numSprings; j++)
 		{
-			refBodySet[i] = &osimModel[i]->updBodySet();
+			inputs.stations.push_back(Vec3(SpringMat[j * 3], SpringMat[j * 3 + 1], SpringMat[j * 3 + 2]));
 		}
 
+		// Every element is written by the kernel, so the outputs are not zeroed
 		mwSize dims[3];
 		dims[0] = numPts;
 		dims[1] = 3;
 		dims[2] = numSprings;
-		plhs[0] = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
-		plhs[1] = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
-		//plhs[0] = mxCreateDoubleMatrix(numPts * numSprings, 3, mxREAL);
-		//plhs[1] = mxCreateDoubleMatrix(numPts * numSprings, 3, mxREAL);
-		double *sp_pos = mxGetPr(plhs[0]);
-		double *sp_vel = mxGetPr(plhs[1]);
-		
-        mwIndex k;
-		mwSize buflen;
-
-		#pragma omp parallel for num_threads(NTHREADS)
-		for (int i = 0; i<numPts; ++i)
-		{
-			int thread_id = omp_get_thread_num();
-            osimState[thread_id]->setTime(time[i]);
-
-            for (int k = 0; k < numLabels; k++){
-				const mxArray *cell_element_ptr;
-                cell_element_ptr = mxGetCell(prhs[5], k);
-				buflen = mxGetN(cell_element_ptr) * sizeof(mxChar) + 1;
-        		char* c_array;
-				c_array = (char *)mxCalloc(buflen, sizeof(char));
-				mxGetString(cell_element_ptr, c_array, buflen);
-				string c_string(c_array);
-
-				if (!osimModel[thread_id]->getCoordinateSet().get(c_array).get_locked())
-				{
-                    //
-					osimModel[thread_id]->getCoordinateSet().get(c_array).setValue(*osimState[thread_id], q[k*numPts + i], false);
-					osimModel[thread_id]->getCoordinateSet().get(c_array).setSpeedValue(*osimState[thread_id], qp[k*numPts + i]);
-				}
-				mxFree(c_array);
-            }
-			
-            osimModel[thread_id]->realizeVelocity(*osimState[thread_id]);
-
-			for (int j = 0; j<numSprings; j++)
-			{
-				OpenSim::Body& tempRefParentBody = refBodySet[thread_id]->get(SpringBodyMat[j]);
-				Vec3 tempLocalPos;
-				tempLocalPos.set(0, SpringMat[j * 3]);
-				tempLocalPos.set(1, SpringMat[j * 3 + 1]);
-				tempLocalPos.set(2, SpringMat[j * 3 + 2]);
-
-				Vec3 tempGlobalPos;
-				Vec3 tempGlobalVel;
-
-				osimModel[thread_id]->getSimbodyEngine().getPosition(*osimState[thread_id], tempRefParentBody, tempLocalPos, tempGlobalPos);
-				osimModel[thread_id]->getSimbodyEngine().getVelocity(*osimState[thread_id], tempRefParentBody, tempLocalPos, tempGlobalVel);
-				
-				sp_pos[i + j * numPts * 3 + numPts * 0] = tempGlobalPos(0);
-				sp_pos[i + j * numPts * 3 + numPts * 1] = tempGlobalPos(1);
-				sp_pos[i + j * numPts * 3 + numPts * 2] = tempGlobalPos(2);
-
-				sp_vel[i + j * numPts * 3 + numPts * 0] = tempGlobalVel(0);
-				sp_vel[i + j * numPts * 3 + numPts * 1] = tempGlobalVel(1);
-				sp_vel[i + j * numPts * 3 + numPts * 2] = tempGlobalVel(2);
-				
-			}
-		}
+		plhs[0] = mxCreateUninitNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+		plhs[1] = mxCreateUninitNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+		PointKinematicsOutputs outputs;
+		outputs.positions = OutputMatrixView(mxGetPr(plhs[0]), numPts, 3 * numSprings);
+		outputs.velocities = OutputMatrixView(mxGetPr(plhs[1]), numPts, 3 * numSprings);
+		marshallingScope.stop();
+
+		submissions.run(session, [&session, inputs, outputs]() {
+			session.calcPointKinematics(inputs, outputs);
+		});
 	}
+	submissions.finish();
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Ground frame positions and velocities of body-fixed points for every
+// frame of a trajectory. The kernel only reads and writes matrix views, so
+// it is shared by the point kinematics MEX function and callers without
+// MATLAB.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_POINT_KINEMATICS_KERNEL_H
+#define NMSM_POINT_KINEMATICS_KERNEL_H
+
+#include <OpenSim/OpenSim.h>
+#include <omp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CoordinateBinding.h"
+#include "FrameResultCache.h"
+#include "FrameSchedule.h"
+#include "KernelProfiler.h"
+#include "MatrixView.h"
+#include "ModelReplicaPool.h"
+
+// Inputs are frames x columns with q and qp columns following the
+// coordinate binding. Points are given by their body and station.
+struct PointKinematicsInputs {
+    const double* time = nullptr;
+    MatrixView q;
+    MatrixView qp;
+    std::vector<SimTK::MobilizedBodyIndex> bodies;
+    std::vector<SimTK::Vec3> stations;
+};
+
+// Outputs are frames x (3 * points), which is the frames x 3 x points
+// layout of pointKinematics.m
+struct PointKinematicsOutputs {
+    OutputMatrixView positions;
+    OutputMatrixView velocities;
+};
+
+// Evaluates every frame of the inputs. The binding must come from a
+// replica of the pool. Locked coordinates keep both their value and speed.
+// Frames found in an enabled cache are copied instead of evaluated, and
+// stages are timed per thread if a profiler is given. Returns an empty
+// string or the first error raised by a frame.
+inline std::string calcPointKinematics(ModelReplicaPool& modelPool,
+        const CoordinateBinding& binding, const PointKinematicsInputs& inputs,
+        const PointKinematicsOutputs& outputs,
+        FrameResultCache* cache = nullptr,
+        KernelProfiler* profiler = nullptr) {
+    const int numPts = inputs.q.rows;
+    const int numPoints = (int) inputs.stations.size();
+    const int numLabels = (int) binding.labels.size();
+    const int numThreads = modelPool.getNumThreads();
+    const int* stateIndex = binding.stateIndex.data();
+    const char* isLocked = binding.isLocked.data();
+
+    // Cached frames depend on the binding and the points as well as the
+    // frame's time, values and speeds
+    const bool useCache = cache != nullptr && cache->isEnabled();
+    std::uint64_t cacheRequest = hashCoordinateBinding(0x504bu, binding);
+    for (int j = 0; j < numPoints; j++) {
+        cacheRequest = mixFrameCacheHash(cacheRequest,
+            (int) inputs.bodies[j]);
+        for (int k = 0; k < 3; k++) {
+            cacheRequest = mixFrameCacheHash(cacheRequest,
+                getFrameCacheBits(inputs.stations[j][k]));
+        }
+    }
+    if (profiler != nullptr) {
+        profiler->prepare(numThreads);
+    }
+
+    // Cache hits cost almost nothing, so cached calls take chunks of frames
+    // on demand
+    const FrameSchedule schedule = modelPool.planSchedule(numPts, useCache);
+    std::string parallelError;
+    runFrameSchedule(schedule, numPts, [&](int thread_id, int i) {
+        try {
+            if (profiler != nullptr) {
+                profiler->addFrame(thread_id);
+            }
+            ModelReplica& replica = modelPool.acquire(thread_id);
+            FrameCacheKey& cacheKey = replica.workspace.cacheKey;
+            std::vector<double>& cachedRow = replica.workspace.cachedRow;
+            if (useCache) {
+                ProfileScope scope(profiler, thread_id, profileOutputWrites);
+                cacheKey.reset(cacheRequest);
+                cacheKey.append(inputs.time[i]);
+                cacheKey.appendRow(inputs.q, i, numLabels);
+                cacheKey.appendRow(inputs.qp, i, numLabels);
+                cacheKey.finish();
+                cachedRow.resize(6 * numPoints);
+                if (cache->find(cacheKey, cachedRow.data(),
+                        cachedRow.size())) {
+                    for (int j = 0; j < 3 * numPoints; j++) {
+                        outputs.positions(i, j) = cachedRow[j];
+                        outputs.velocities(i, j) =
+                            cachedRow[3 * numPoints + j];
+                    }
+                    return;
+                }
+            }
+
+            SimTK::State& state = *replica.state;
+            const SimTK::SimbodyMatterSubsystem& matter =
+                replica.model->getMatterSubsystem();
+            {
+                ProfileScope scope(profiler, thread_id,
+                    profileCoordinateSetting);
+                state.setTime(inputs.time[i]);
+                SimTK::Vector& stateQ = state.updQ();
+                SimTK::Vector& stateU = state.updU();
+                for (int k = 0; k < numLabels; k++) {
+                    if (!isLocked[k]) {
+                        stateQ[stateIndex[k]] = inputs.q(i, k);
+                        stateU[stateIndex[k]] = inputs.qp(i, k);
+                    }
+                }
+            }
+            {
+                ProfileScope scope(profiler, thread_id,
+                    profileRealizeVelocity);
+                replica.model->realizeVelocity(state);
+            }
+
+            // Station kinematics are timed with the writes
+            ProfileScope scope(profiler, thread_id, profileOutputWrites);
+            for (int j = 0; j < numPoints; j++) {
+                const SimTK::MobilizedBody& body =
+                    matter.getMobilizedBody(inputs.bodies[j]);
+                const SimTK::Vec3 position = body.findStationLocationInGround(
+                    state, inputs.stations[j]);
+                const SimTK::Vec3 velocity = body.findStationVelocityInGround(
+                    state, inputs.stations[j]);
+                for (int k = 0; k < 3; k++) {
+                    outputs.positions(i, j * 3 + k) = position[k];
+                    outputs.velocities(i, j * 3 + k) = velocity[k];
+                }
+            }
+
+            if (useCache) {
+                for (int j = 0; j < 3 * numPoints; j++) {
+                    cachedRow[j] = outputs.positions(i, j);
+                    cachedRow[3 * numPoints + j] = outputs.velocities(i, j);
+                }
+                cache->insert(cacheKey, cachedRow.data(), cachedRow.size());
+            }
+        }
+        catch (const std::exception& ex) {
+            #pragma omp critical(pointKinematicsError)
+            if (parallelError.empty()) {
+                parallelError = ex.what();
+            }
+        }
+    });
+    return parallelError;
+}
+
+#endif
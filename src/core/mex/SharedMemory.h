@@ -0,0 +1,207 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Named shared memory segments and process checks for the local model
+// server. Segments are POSIX shared memory on Linux and file mappings
+// backed by the page file on Windows, and are only visible on the machine
+// that made them.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_SHARED_MEMORY_H
+#define NMSM_SHARED_MEMORY_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+inline int getCurrentProcessNumber() {
+#if defined(_WIN32)
+    return (int) GetCurrentProcessId();
+#else
+    return (int) getpid();
+#endif
+}
+
+// False once the process has exited
+inline bool isProcessRunning(int processNumber) {
+#if defined(_WIN32)
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE,
+        (DWORD) processNumber);
+    if (process == NULL) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    DWORD exitCode = 0;
+    const bool isRunning = GetExitCodeProcess(process, &exitCode) &&
+        exitCode == STILL_ACTIVE;
+    CloseHandle(process);
+    return isRunning;
+#else
+    return kill((pid_t) processNumber, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+// A mapping of a named segment. The process that creates a segment
+// removes its name when the mapping is closed; processes that open it
+// only unmap it.
+class SharedMemorySegment {
+public:
+    SharedMemorySegment() {}
+    SharedMemorySegment(const SharedMemorySegment&) = delete;
+    SharedMemorySegment& operator=(const SharedMemorySegment&) = delete;
+    ~SharedMemorySegment() { close(); }
+
+    // Creates the segment. On Linux a segment left with the same name by a
+    // process that exited is replaced.
+    void create(const std::string& name, std::size_t size) {
+        map(name, size, true);
+    }
+
+    void open(const std::string& name, std::size_t size) {
+        map(name, size, false);
+    }
+
+    void close() {
+        if (address == nullptr) {
+            return;
+        }
+#if defined(_WIN32)
+        UnmapViewOfFile(address);
+        CloseHandle(mapping);
+        mapping = NULL;
+#else
+        munmap(address, mappedSize);
+        if (isOwner) {
+            shm_unlink(getSystemName(segmentName).c_str());
+        }
+#endif
+        address = nullptr;
+        mappedSize = 0;
+        isOwner = false;
+        segmentName.clear();
+    }
+
+    bool isOpen() const { return address != nullptr; }
+    char* getData() const { return (char*) address; }
+    std::size_t getSize() const { return mappedSize; }
+    const std::string& getName() const { return segmentName; }
+
+private:
+    static std::string getSystemName(const std::string& name) {
+#if defined(_WIN32)
+        return "Local\\nmsm_" + name;
+#else
+        return "/nmsm_" + name;
+#endif
+    }
+
+    void map(const std::string& name, std::size_t size, bool create) {
+        close();
+        const std::string systemName = getSystemName(name);
+#if defined(_WIN32)
+        if (create) {
+            mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+                PAGE_READWRITE, (DWORD) ((unsigned long long) size >> 32),
+                (DWORD) (size & 0xffffffffu), systemName.c_str());
+        } else {
+            mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE,
+                systemName.c_str());
+        }
+        if (mapping == NULL) {
+            throw std::runtime_error("Shared memory " + name +
+                " could not be " + (create ? "created." : "opened."));
+        }
+        if (create && GetLastError() == ERROR_ALREADY_EXISTS) {
+            CloseHandle(mapping);
+            mapping = NULL;
+            throw std::runtime_error("Shared memory " + name +
+                " is already in use.");
+        }
+        address = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (address == NULL) {
+            CloseHandle(mapping);
+            mapping = NULL;
+            address = nullptr;
+            throw std::runtime_error("Shared memory " + name +
+                " could not be mapped.");
+        }
+#else
+        if (create) {
+            shm_unlink(systemName.c_str());
+        }
+        const int descriptor = shm_open(systemName.c_str(),
+            create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+        if (descriptor < 0) {
+            throw std::runtime_error("Shared memory " + name +
+                " could not be " + (create ? "created." : "opened."));
+        }
+        struct stat status;
+        if ((create && ftruncate(descriptor, (off_t) size) != 0) ||
+                (!create && (fstat(descriptor, &status) != 0 ||
+                (std::size_t) status.st_size < size))) {
+            ::close(descriptor);
+            if (create) {
+                shm_unlink(systemName.c_str());
+            }
+            throw std::runtime_error("Shared memory " + name +
+                " does not have the expected size.");
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, descriptor, 0);
+        ::close(descriptor);
+        if (mapped == MAP_FAILED) {
+            if (create) {
+                shm_unlink(systemName.c_str());
+            }
+            throw std::runtime_error("Shared memory " + name +
+                " could not be mapped.");
+        }
+        address = mapped;
+#endif
+        mappedSize = size;
+        isOwner = create;
+        segmentName = name;
+    }
+
+    void* address = nullptr;
+    std::size_t mappedSize = 0;
+    bool isOwner = false;
+    std::string segmentName;
+#if defined(_WIN32)
+    HANDLE mapping = NULL;
+#endif
+};
+
+#endif
@@ -0,0 +1,291 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Native version of the polynomial surrogate muscle model built by
+// createSurrogateModel.m. Each muscle tendon length is a linear combination
+// of monomials of the muscle's coordinates. The monomials of all muscles are
+// merged into one basis over the model coordinates, and the derivative of
+// every monomial is another monomial of the basis, so lengths and moment
+// arms are rows of one sparse matrix applied to the basis. Velocities
+// follow from the moment arms. This header does not depend on MATLAB.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#ifndef NMSM_SURROGATE_MUSCLE_MODEL_H
+#define NMSM_SURROGATE_MUSCLE_MODEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MatrixView.h"
+
+// Surrogate model of one muscle as fit by createMuscleSpecificSurrogateModel.
+// exponents is terms x coordinates in column-major order, and coordinates
+// holds the zero-based model coordinate of each muscle coordinate.
+struct SurrogateMuscle {
+    std::vector<int> coordinates;
+    std::vector<int> exponents;
+    std::vector<double> coefficients;
+};
+
+// Flat description of a compiled surrogate model. Monomial 0 is the
+// constant 1 and every other monomial is its parent times one coordinate,
+// with parents stored before their children. Rows are the sparse linear
+// combinations of monomials. The first row of each muscle is its length and
+// the remaining rows are its moment arms about rowCoordinates.
+struct SurrogateModelLayout {
+    int numCoordinates = 0;
+    int numMuscles = 0;
+    int numMonomials = 0;
+    const int* monomialParents = nullptr;
+    const int* monomialCoordinates = nullptr;
+    const int* muscleRowStarts = nullptr;
+    const int* rowCoordinates = nullptr;
+    const int* rowTermStarts = nullptr;
+    const int* termMonomials = nullptr;
+    const double* termCoefficients = nullptr;
+};
+
+struct CompiledSurrogateModel {
+    int numCoordinates = 0;
+    std::vector<int> monomialParents;
+    std::vector<int> monomialCoordinates;
+    std::vector<int> muscleRowStarts;
+    std::vector<int> rowCoordinates;
+    std::vector<int> rowTermStarts;
+    std::vector<int> termMonomials;
+    std::vector<double> termCoefficients;
+
+    SurrogateModelLayout layout() const {
+        SurrogateModelLayout result;
+        result.numCoordinates = numCoordinates;
+        result.numMuscles = (int) muscleRowStarts.size() - 1;
+        result.numMonomials = (int) monomialParents.size();
+        result.monomialParents = monomialParents.data();
+        result.monomialCoordinates = monomialCoordinates.data();
+        result.muscleRowStarts = muscleRowStarts.data();
+        result.rowCoordinates = rowCoordinates.data();
+        result.rowTermStarts = rowTermStarts.data();
+        result.termMonomials = termMonomials.data();
+        result.termCoefficients = termCoefficients.data();
+        return result;
+    }
+};
+
+// Sorted (coordinate, exponent) pairs with positive exponents
+typedef std::vector<std::pair<int, int>> MonomialFactors;
+
+class SurrogateModelCompiler {
+public:
+    explicit SurrogateModelCompiler(int numCoordinates) {
+        model.numCoordinates = numCoordinates;
+        model.muscleRowStarts.push_back(0);
+        model.rowTermStarts.push_back(0);
+        addMonomial(MonomialFactors());
+    }
+
+    // Returns an empty string on success or a description of the problem
+    std::string addMuscle(const SurrogateMuscle& muscle) {
+        const int numMuscleCoordinates = (int) muscle.coordinates.size();
+        const int numTerms = (int) muscle.coefficients.size();
+        if ((int) muscle.exponents.size() != numTerms * numMuscleCoordinates) {
+            return "Exponents must be terms x muscle coordinates.";
+        }
+        for (int k = 0; k < numMuscleCoordinates; k++) {
+            const int coordinate = muscle.coordinates[k];
+            if (coordinate < 0 || coordinate >= model.numCoordinates) {
+                return "Muscle coordinate index out of range.";
+            }
+            for (int l = 0; l < k; l++) {
+                if (muscle.coordinates[l] == coordinate) {
+                    return "Muscle coordinates must be unique.";
+                }
+            }
+        }
+
+        // Length row followed by one moment arm row per coordinate, each
+        // collected as monomial -> coefficient
+        std::vector<std::map<int, double>> rows(numMuscleCoordinates + 1);
+        for (int j = 0; j < numTerms; j++) {
+            MonomialFactors factors;
+            for (int k = 0; k < numMuscleCoordinates; k++) {
+                const int exponent = muscle.exponents[j + k * numTerms];
+                if (exponent < 0) {
+                    return "Exponents must be nonnegative integers.";
+                }
+                if (exponent > 0) {
+                    factors.push_back(std::make_pair(
+                        muscle.coordinates[k], exponent));
+                }
+            }
+            std::sort(factors.begin(), factors.end());
+            const double coefficient = muscle.coefficients[j];
+            rows[0][addMonomial(factors)] += coefficient;
+            // The moment arm is the negative derivative of the length
+            for (int k = 0; k < numMuscleCoordinates; k++) {
+                const int exponent = muscle.exponents[j + k * numTerms];
+                if (exponent == 0) {
+                    continue;
+                }
+                MonomialFactors derivative = factors;
+                for (std::size_t l = 0; l < derivative.size(); l++) {
+                    if (derivative[l].first == muscle.coordinates[k]) {
+                        if (--derivative[l].second == 0) {
+                            derivative.erase(derivative.begin() + l);
+                        }
+                        break;
+                    }
+                }
+                rows[k + 1][addMonomial(derivative)] -= exponent *
+                    coefficient;
+            }
+        }
+
+        for (int k = 0; k <= numMuscleCoordinates; k++) {
+            model.rowCoordinates.push_back(k == 0 ? -1 :
+                muscle.coordinates[k - 1]);
+            for (const auto& term : rows[k]) {
+                model.termMonomials.push_back(term.first);
+                model.termCoefficients.push_back(term.second);
+            }
+            model.rowTermStarts.push_back(
+                (int) model.termMonomials.size());
+        }
+        model.muscleRowStarts.push_back((int) model.rowCoordinates.size());
+        return "";
+    }
+
+    const CompiledSurrogateModel& getModel() const { return model; }
+
+private:
+    // Index of the monomial, adding it and its parents if needed
+    int addMonomial(const MonomialFactors& factors) {
+        const auto found = indices.find(factors);
+        if (found != indices.end()) {
+            return found->second;
+        }
+        int parent = -1;
+        int coordinate = -1;
+        if (!factors.empty()) {
+            MonomialFactors parentFactors = factors;
+            coordinate = parentFactors.back().first;
+            if (--parentFactors.back().second == 0) {
+                parentFactors.pop_back();
+            }
+            parent = addMonomial(parentFactors);
+        }
+        const int index = (int) model.monomialParents.size();
+        model.monomialParents.push_back(parent);
+        model.monomialCoordinates.push_back(coordinate);
+        indices[factors] = index;
+        return index;
+    }
+
+    CompiledSurrogateModel model;
+    std::map<MonomialFactors, int> indices;
+};
+
+// Frames evaluated together by one thread. The monomial values of a block
+// stay in cache while every row is applied to them.
+const int surrogateFrameBlockSize = 256;
+
+// Evaluates every muscle of the model for all frames. positions and
+// velocities are frames x model coordinates, and velocities may be empty.
+// lengths and muscleVelocities are frames x muscles and momentArms is
+// frames x coordinates x muscles in column-major order, all zero filled by
+// the caller. Blocks of frames are split across threads and the loops over
+// frames within a block are unit stride.
+inline void evaluateSurrogateModelBatch(const SurrogateModelLayout& model,
+        const MatrixView& positions, const MatrixView& velocities,
+        double* lengths, double* muscleVelocities, double* momentArms,
+        int numThreads) {
+    const int numFrames = positions.rows;
+    const std::ptrdiff_t stride = numFrames;
+    const bool hasVelocities = !velocities.isEmpty();
+    int blockSize = (numFrames + numThreads - 1) / std::max(numThreads, 1);
+    blockSize = std::max(16, std::min(blockSize, surrogateFrameBlockSize));
+    const int numBlocks = (numFrames + blockSize - 1) / blockSize;
+
+    #pragma omp parallel num_threads(numThreads)
+    {
+        std::vector<double> monomials((std::size_t) model.numMonomials *
+            blockSize);
+        #pragma omp for schedule(static)
+        for (int block = 0; block < numBlocks; block++) {
+            const int firstFrame = block * blockSize;
+            const int size = std::min(blockSize, numFrames - firstFrame);
+            double* basis = monomials.data();
+            for (int f = 0; f < size; f++) {
+                basis[f] = 1.0;
+            }
+            for (int m = 1; m < model.numMonomials; m++) {
+                const double* parent = basis +
+                    (std::ptrdiff_t) model.monomialParents[m] * blockSize;
+                const double* coordinate = &positions(firstFrame,
+                    model.monomialCoordinates[m]);
+                double* value = basis + (std::ptrdiff_t) m * blockSize;
+                #pragma omp simd
+                for (int f = 0; f < size; f++) {
+                    value[f] = parent[f] * coordinate[f];
+                }
+            }
+
+            for (int i = 0; i < model.numMuscles; i++) {
+                double* velocity = muscleVelocities + i * stride + firstFrame;
+                for (int r = model.muscleRowStarts[i];
+                        r < model.muscleRowStarts[i + 1]; r++) {
+                    const int coordinate = model.rowCoordinates[r];
+                    double* output = coordinate < 0 ?
+                        lengths + i * stride + firstFrame :
+                        momentArms + (coordinate + (std::ptrdiff_t) i *
+                        model.numCoordinates) * stride + firstFrame;
+                    for (int t = model.rowTermStarts[r];
+                            t < model.rowTermStarts[r + 1]; t++) {
+                        const double coefficient = model.termCoefficients[t];
+                        const double* value = basis +
+                            (std::ptrdiff_t) model.termMonomials[t] *
+                            blockSize;
+                        #pragma omp simd
+                        for (int f = 0; f < size; f++) {
+                            output[f] += coefficient * value[f];
+                        }
+                    }
+                    // The length rate is the negative moment arm weighted
+                    // sum of the coordinate speeds
+                    if (coordinate >= 0 && hasVelocities) {
+                        const double* speed = &velocities(firstFrame,
+                            coordinate);
+                        #pragma omp simd
+                        for (int f = 0; f < size; f++) {
+                            velocity[f] -= output[f] * speed[f];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif
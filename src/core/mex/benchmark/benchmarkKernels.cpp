@@ -0,0 +1,447 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Benchmarks the native kernels without MATLAB. A synthetic gait cycle is
+// generated for every coordinate of the model and the inverse dynamics,
+// point kinematics and GCV spline kernels are timed for each thread count.
+// Results are written as JSON with one record per kernel, output set and
+// thread count, including the heap allocations per frame of the timed
+// calls.
+//
+// benchmarkKernels [--model file.osim] [--frames N] [--repeats N]
+//     [--threads 1,2,4] [--output results.json]
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#include <OpenSim/OpenSim.h>
+#include <omp.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../GcvSplineKernel.h"
+#include "../InverseDynamicsKernel.h"
+#include "../ModelSession.h"
+#include "../PointKinematicsKernel.h"
+
+#ifndef NMSM_BENCHMARK_MODEL
+#define NMSM_BENCHMARK_MODEL "RCNL2024.osim"
+#endif
+
+// Allocations made through operator new, which SimTK vectors and standard
+// containers use. Where shared libraries bind to the program's operator
+// new, as on Linux, allocations inside OpenSim and Simbody are counted too.
+static std::atomic<long long> allocationCount(0);
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* memory = std::malloc(size > 0 ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+struct BenchmarkOptions {
+    std::string modelFile = NMSM_BENCHMARK_MODEL;
+    int numFrames = 101;
+    int numRepeats = 5;
+    std::vector<int> threadCounts;
+    std::string outputFile;
+};
+
+// Column-major frames x coordinates trajectories of one gait cycle
+struct GaitTrajectory {
+    std::vector<std::string> labels;
+    std::vector<double> time;
+    std::vector<double> q;
+    std::vector<double> qp;
+    std::vector<double> qpp;
+};
+
+struct BenchmarkResult {
+    std::string kernel;
+    std::string outputs;
+    int threads = 0;
+    double medianSeconds = 0.0;
+    double minSeconds = 0.0;
+    double framesPerSecond = 0.0;
+    // Heap allocations of the timed calls divided by their frames
+    double allocationsPerFrame = 0.0;
+};
+
+BenchmarkOptions parseOptions(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Option " + option + " needs a value.");
+        }
+        const std::string value = argv[++i];
+        if (option == "--model") {
+            options.modelFile = value;
+        } else if (option == "--frames") {
+            options.numFrames = std::atoi(value.c_str());
+        } else if (option == "--repeats") {
+            options.numRepeats = std::atoi(value.c_str());
+        } else if (option == "--threads") {
+            std::stringstream list(value);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                options.threadCounts.push_back(std::atoi(item.c_str()));
+            }
+        } else if (option == "--output") {
+            options.outputFile = value;
+        } else {
+            throw std::runtime_error("Unknown option " + option + ".");
+        }
+    }
+    if (options.numFrames < 8 || options.numRepeats < 1) {
+        throw std::runtime_error("At least 8 frames and 1 repeat are "
+            "needed.");
+    }
+    if (options.threadCounts.empty()) {
+        const int maxThreads = omp_get_max_threads();
+        for (int threads = 1; threads < maxThreads; threads *= 2) {
+            options.threadCounts.push_back(threads);
+        }
+        options.threadCounts.push_back(maxThreads);
+    }
+    return options;
+}
+
+// Each rotational coordinate follows two harmonics of a 1.1 s stride about
+// its default value, moved inside its range. The pelvis moves forward at a
+// walking speed and other translations oscillate by a few centimeters.
+GaitTrajectory makeGaitTrajectory(const OpenSim::Model& model,
+        int numFrames) {
+    const double strideTime = 1.1;
+    const double omega = 2.0 * SimTK::Pi / strideTime;
+    const std::vector<SimTK::ReferencePtr<const OpenSim::Coordinate>>
+        coordinates = model.getCoordinatesInMultibodyTreeOrder();
+    const int numCoordinates = (int) coordinates.size();
+    GaitTrajectory gait;
+    gait.time.resize(numFrames);
+    gait.q.resize((size_t) numFrames * numCoordinates);
+    gait.qp.resize(gait.q.size());
+    gait.qpp.resize(gait.q.size());
+    for (int i = 0; i < numFrames; i++) {
+        gait.time[i] = strideTime * i / (numFrames - 1);
+    }
+    for (int k = 0; k < numCoordinates; k++) {
+        const OpenSim::Coordinate& coordinate = *coordinates[k];
+        gait.labels.push_back(coordinate.getName());
+        const std::string& name = coordinate.getName();
+        const double range = coordinate.getRangeMax() -
+            coordinate.getRangeMin();
+        double center = coordinate.getDefaultValue();
+        double amplitude = 0.0;
+        double speed = 0.0;
+        if (coordinate.get_locked()) {
+            // Locked coordinates keep their default value
+        } else if (coordinate.getMotionType() ==
+                OpenSim::Coordinate::Translational) {
+            if (name.size() > 3 &&
+                    name.compare(name.size() - 3, 3, "_tx") == 0) {
+                speed = 1.3;
+            } else {
+                amplitude = 0.02;
+            }
+        } else if (range > 0.0) {
+            // Centers 30% of the range from the limits keep the peak of
+            // both harmonics, 1.3 times the amplitude, inside the range
+            center = std::min(std::max(center, coordinate.getRangeMin() +
+                0.3 * range), coordinate.getRangeMax() - 0.3 * range);
+            amplitude = std::min(0.35, 0.2 * range);
+        }
+        const double phase = 0.7 * k;
+        for (int i = 0; i < numFrames; i++) {
+            const double t = gait.time[i];
+            const double first = omega * t + phase;
+            const double second = 2.0 * first;
+            const size_t index = (size_t) k * numFrames + i;
+            gait.q[index] = center + speed * t + amplitude *
+                (std::sin(first) + 0.3 * std::sin(second));
+            gait.qp[index] = speed + amplitude * omega *
+                (std::cos(first) + 0.6 * std::cos(second));
+            gait.qpp[index] = -amplitude * omega * omega *
+                (std::sin(first) + 1.2 * std::sin(second));
+        }
+    }
+    return gait;
+}
+
+// Runs the call once to clone the replicas and size the workspaces, and
+// then times it and counts its allocations. Throws the first error returned
+// by the kernel.
+BenchmarkResult timeKernel(const std::string& kernel,
+        const std::string& outputs, int threads, int numFrames,
+        int numRepeats, const std::function<std::string()>& call) {
+    std::string error = call();
+    std::vector<double> seconds(numRepeats);
+    long long allocations = 0;
+    for (int r = 0; r < numRepeats && error.empty(); r++) {
+        const long long allocationsBefore = allocationCount.load();
+        const double start = omp_get_wtime();
+        error = call();
+        seconds[r] = omp_get_wtime() - start;
+        allocations += allocationCount.load() - allocationsBefore;
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(kernel + ": " + error);
+    }
+    std::sort(seconds.begin(), seconds.end());
+    BenchmarkResult result;
+    result.kernel = kernel;
+    result.outputs = outputs;
+    result.threads = threads;
+    result.medianSeconds = seconds[numRepeats / 2];
+    result.minSeconds = seconds[0];
+    result.framesPerSecond = numFrames / result.medianSeconds;
+    result.allocationsPerFrame = (double) allocations /
+        ((double) numFrames * numRepeats);
+    return result;
+}
+
+// Quotes text as a JSON string, so Windows paths and messages stay valid
+std::string quoteJson(const std::string& text) {
+    std::string quoted = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if ((unsigned char) c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", (int) c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+void writeResults(std::ostream& output, const BenchmarkOptions& options,
+        const GaitTrajectory& gait, const std::vector<BenchmarkResult>& results,
+        const std::vector<std::string>& skipped) {
+    output.precision(9);
+    output << "{\n  \"model\": " << quoteJson(options.modelFile) << ",\n"
+        << "  \"frames\": " << options.numFrames << ",\n"
+        << "  \"coordinates\": " << gait.labels.size() << ",\n"
+        << "  \"repeats\": " << options.numRepeats << ",\n"
+        << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        output << (i == 0 ? "\n" : ",\n")
+            << "    {\"kernel\": " << quoteJson(result.kernel) << ", "
+            << "\"outputs\": " << quoteJson(result.outputs) << ", "
+            << "\"threads\": " << result.threads << ", "
+            << "\"medianSeconds\": " << result.medianSeconds << ", "
+            << "\"minSeconds\": " << result.minSeconds << ", "
+            << "\"framesPerSecond\": " << result.framesPerSecond << ", "
+            << "\"allocationsPerFrame\": " << result.allocationsPerFrame
+            << "}";
+    }
+    output << "\n  ],\n  \"skipped\": [";
+    for (size_t i = 0; i < skipped.size(); i++) {
+        output << (i == 0 ? "" : ", ") << quoteJson(skipped[i]);
+    }
+    output << "]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        const BenchmarkOptions options = parseOptions(argc, argv);
+        const int numFrames = options.numFrames;
+        // Results may be written to stdout, which the OpenSim log shares
+        OpenSim::Logger::setLevel(OpenSim::Logger::Level::Off);
+        ModelSession session;
+        session.load(options.modelFile, 1);
+        ModelReplica& base = session.getPool().getBase();
+        const GaitTrajectory gait = makeGaitTrajectory(*base.model,
+            numFrames);
+        const CoordinateBinding binding = session.bindCoordinates(
+            gait.labels);
+        const int numCoordinates = (int) gait.labels.size();
+        const OpenSim::BodySet& bodySet = base.model->getBodySet();
+        const int numBodies = bodySet.getSize();
+        const bool hasMetabolicProbe = base.model->getProbeSet().getSize() >
+            0 && !base.muscles.empty();
+
+        // Inverse dynamics with and without the optional outputs
+        InverseDynamicsInputs idInputs;
+        idInputs.time = gait.time.data();
+        idInputs.q = MatrixView(gait.q.data(), numFrames, numCoordinates);
+        idInputs.qp = MatrixView(gait.qp.data(), numFrames, numCoordinates);
+        idInputs.qpp = MatrixView(gait.qpp.data(), numFrames,
+            numCoordinates);
+        for (int j = 0; j < numBodies; j++) {
+            idInputs.orientationBodies.push_back(
+                bodySet.get(j).getMobilizedBodyIndex());
+        }
+        const std::vector<double> activations(
+            (size_t) numFrames * base.muscles.size(), 0.2);
+        idInputs.muscleActivations = MatrixView(activations.data(),
+            numFrames, (int) base.muscles.size());
+        std::vector<double> idLoads((size_t) numFrames *
+            binding.numStateCoordinates);
+        std::vector<double> angularMomentum((size_t) numFrames * 3);
+        std::vector<double> metabolicCost(numFrames);
+        std::vector<double> orientations((size_t) numFrames * 3 * numBodies);
+        double massCenterVelocity[2];
+        InverseDynamicsOutputs idOutputs;
+        idOutputs.idLoads = OutputMatrixView(idLoads.data(), numFrames,
+            binding.numStateCoordinates);
+        idOutputs.angularMomentum = OutputMatrixView(angularMomentum.data(),
+            numFrames, 3);
+        idOutputs.metabolicCost = OutputMatrixView(metabolicCost.data(),
+            numFrames, 1);
+        idOutputs.bodyOrientations = OutputMatrixView(orientations.data(),
+            numFrames, 3 * numBodies);
+        idOutputs.massCenterVelocity = massCenterVelocity;
+
+        // One point on each body, as for contact springs and markers
+        PointKinematicsInputs pkInputs;
+        pkInputs.time = idInputs.time;
+        pkInputs.q = idInputs.q;
+        pkInputs.qp = idInputs.qp;
+        for (int j = 0; j < numBodies; j++) {
+            pkInputs.bodies.push_back(bodySet.get(j).getMobilizedBodyIndex());
+            pkInputs.stations.push_back(SimTK::Vec3(0.05, -0.02, 0.01));
+        }
+        std::vector<double> positions((size_t) numFrames * 3 * numBodies);
+        std::vector<double> velocities(positions.size());
+        PointKinematicsOutputs pkOutputs;
+        pkOutputs.positions = OutputMatrixView(positions.data(), numFrames,
+            3 * numBodies);
+        pkOutputs.velocities = OutputMatrixView(velocities.data(), numFrames,
+            3 * numBodies);
+
+        std::vector<int> splineColumns(numCoordinates);
+        for (int j = 0; j < numCoordinates; j++) {
+            splineColumns[j] = j;
+        }
+        std::vector<SimTK::Spline> splines;
+        std::vector<double> splineValues((size_t) numFrames * numCoordinates);
+        const OutputMatrixView splineOutput(splineValues.data(), numFrames,
+            numCoordinates);
+
+        std::vector<BenchmarkResult> results;
+        std::vector<std::string> skipped;
+        if (!hasMetabolicProbe) {
+            skipped.push_back("inverseDynamics metabolicCost: the model has "
+                "no muscles or no probe");
+        }
+        for (int threads : options.threadCounts) {
+            session.load(options.modelFile, threads);
+            session.bindCoordinates(gait.labels);
+            omp_set_num_threads(threads);
+            auto inverseDynamics = [&](bool momentum, bool orientation,
+                    bool metabolic) {
+                idInputs.computeAngularMomentum = momentum;
+                idInputs.computeBodyOrientation = orientation;
+                idInputs.computeMetabolicCost = metabolic;
+                session.calcInverseDynamics(idInputs, idOutputs);
+                return std::string();
+            };
+            results.push_back(timeKernel("inverseDynamics", "loads",
+                threads, numFrames, options.numRepeats,
+                [&]() { return inverseDynamics(false, false, false); }));
+            results.push_back(timeKernel("inverseDynamics",
+                "loads,angularMomentum,bodyOrientation", threads, numFrames,
+                options.numRepeats,
+                [&]() { return inverseDynamics(true, true, false); }));
+            if (hasMetabolicProbe) {
+                results.push_back(timeKernel("inverseDynamics",
+                    "loads,angularMomentum,bodyOrientation,metabolicCost",
+                    threads, numFrames, options.numRepeats,
+                    [&]() { return inverseDynamics(true, true, true); }));
+            }
+            results.push_back(timeKernel("pointKinematics",
+                "positions,velocities", threads, numFrames,
+                options.numRepeats, [&]() {
+                    session.calcPointKinematics(pkInputs, pkOutputs);
+                    return std::string();
+                }));
+            results.push_back(timeKernel("gcvSplines", "fit", threads,
+                numFrames, options.numRepeats, [&]() {
+                    return fitGcvSplines(gait.time.data(), numFrames,
+                        idInputs.q, 5, splines);
+                }));
+            for (int derivative = 0; derivative <= 2; derivative++) {
+                results.push_back(timeKernel("gcvSplines",
+                    "derivative" + std::to_string(derivative), threads,
+                    numFrames, options.numRepeats, [&]() {
+                        evaluateGcvSplines(splines, splineColumns,
+                            gait.time.data(), numFrames, derivative,
+                            splineOutput);
+                        return std::string();
+                    }));
+            }
+        }
+
+        if (options.outputFile.empty()) {
+            writeResults(std::cout, options, gait, results, skipped);
+        } else {
+            std::ofstream file(options.outputFile);
+            writeResults(file, options, gait, results, skipped);
+            if (!file) {
+                throw std::runtime_error("Could not write " +
+                    options.outputFile + ".");
+            }
+        }
+    }
+    catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
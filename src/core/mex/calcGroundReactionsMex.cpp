@@ -0,0 +1,126 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Evaluates the ground contact model for all springs and frames of a
+// contact surface in one call. Used by Ground Contact Personalization and
+// Treatment Optimization through calcSpringGroundReactions.m.
+//
+// [forces, moments] = calcGroundReactionsMex(springPositions,
+//     springVelocities, springConstants, midfootSuperiorPositions,
+//     contactSurface)
+//
+// Spring positions and velocities are frames x 3 x springs, as returned by
+// pointKinematics. Midfoot superior positions are frames x 3 and may be
+// empty if moments are not needed. The contact surface struct provides
+// dampingFactor, restingSpringLength, dynamicFrictionCoefficient,
+// viscousFrictionCoefficient, beltSpeed and latchingVelocity. Forces and
+// moments are frames x 3 in the lab frame.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#include "mex.h"
+#include <omp.h>
+#include <vector>
+#include "GroundContactModel.h"
+#include "MexArrayHelpers.h"
+
+double getParameter(const mxArray* surface, const char* name){
+    const mxArray* field = mxGetField(surface, 0, name);
+    if (field == NULL || mxIsEmpty(field) || !mxIsDouble(field)) {
+        mexErrMsgIdAndTxt("NMSM:contactSurface",
+            "Contact surface field %s is missing or not numeric.", name);
+    }
+    return mxGetScalar(field);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
+    if (nrhs != 5) {
+        mexErrMsgTxt("calcGroundReactionsMex takes 5 arguments.\n");
+    }
+    const mxArray* positionArray = prhs[0];
+    const mxArray* velocityArray = prhs[1];
+    if (!mxIsDouble(positionArray) || !mxIsDouble(velocityArray) ||
+            mxIsComplex(positionArray) || mxIsComplex(velocityArray)) {
+        mexErrMsgTxt("Spring kinematics must be real double arrays.\n");
+    }
+    const int numFrames = (int) mxGetM(positionArray);
+    const mwSize numDims = mxGetNumberOfDimensions(positionArray);
+    const mwSize* dims = mxGetDimensions(positionArray);
+    const int numSprings = numDims > 2 ? (int) dims[2] : 1;
+    if (dims[1] != 3 || mxGetNumberOfElements(velocityArray) !=
+            mxGetNumberOfElements(positionArray) ||
+            mxGetM(velocityArray) != mxGetM(positionArray)) {
+        mexErrMsgTxt("Spring positions and velocities must be frames x 3 x springs.\n");
+    }
+    if ((int) mxGetNumberOfElements(prhs[2]) != numSprings || !mxIsDouble(prhs[2])) {
+        mexErrMsgTxt("One spring constant is required per spring.\n");
+    }
+    const MatrixView midfootSuperior = mexArrayToView(prhs[3]);
+    if (!midfootSuperior.isEmpty()) {
+        checkInputRows(midfootSuperior, numFrames, 3, "Midfoot superior positions");
+    }
+    if (!mxIsStruct(prhs[4])) {
+        mexErrMsgTxt("Contact surface must be a struct.\n");
+    }
+    ContactSurfaceParameters parameters;
+    parameters.dampingFactor = getParameter(prhs[4], "dampingFactor");
+    parameters.restingSpringLength = getParameter(prhs[4], "restingSpringLength");
+    parameters.dynamicFrictionCoefficient = getParameter(prhs[4], "dynamicFrictionCoefficient");
+    parameters.viscousFrictionCoefficient = getParameter(prhs[4], "viscousFrictionCoefficient");
+    parameters.beltSpeed = getParameter(prhs[4], "beltSpeed");
+    parameters.latchingVelocity = getParameter(prhs[4], "latchingVelocity");
+
+    const OutputMatrixView forces = createOutputMatrix(&plhs[0], numFrames, 3, true);
+    const OutputMatrixView moments = createOutputMatrix(&plhs[1], numFrames, 3, !midfootSuperior.isEmpty());
+
+    // Regroup the frames x 3 x springs input so the springs of each frame
+    // are contiguous for each component
+    const int numThreads = omp_get_max_threads();
+    const std::size_t size = (std::size_t) numFrames * numSprings;
+    std::vector<double> soa(6 * size);
+    const double* positions = mxGetPr(positionArray);
+    const double* velocities = mxGetPr(velocityArray);
+    #pragma omp parallel for num_threads(numThreads) schedule(static)
+    for (int i = 0; i < numFrames; i++) {
+        for (int k = 0; k < 3; k++) {
+            double* positionComponent = soa.data() + k * size + (std::size_t) i * numSprings;
+            double* velocityComponent = soa.data() + (k + 3) * size + (std::size_t) i * numSprings;
+            for (int j = 0; j < numSprings; j++) {
+                const std::size_t index = i + (std::size_t) numFrames * (k + 3 * j);
+                positionComponent[j] = positions[index];
+                velocityComponent[j] = velocities[index];
+            }
+        }
+    }
+    ContactSpringKinematics springs;
+    springs.numFrames = numFrames;
+    springs.numSprings = numSprings;
+    springs.x = soa.data();
+    springs.y = soa.data() + size;
+    springs.z = soa.data() + 2 * size;
+    springs.xVelocity = soa.data() + 3 * size;
+    springs.yVelocity = soa.data() + 4 * size;
+    springs.zVelocity = soa.data() + 5 * size;
+
+    calcGroundReactionsBatch(springs, mxGetPr(prhs[2]), parameters,
+        midfootSuperior, forces, moments, numThreads);
+}
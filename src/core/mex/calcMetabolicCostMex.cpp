@@ -0,0 +1,102 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Evaluates whole body metabolic power for all frames in one call without
+// equilibrating the muscles of an OpenSim model. Used by
+// calcBhargavaMetabolicCost.m and calcUmbergerMetabolicCost.m.
+//
+// [metabolicPower, activationDerivatives] = calcMetabolicCostMex(model,
+//     mass, muscleActivations, normalizedFiberLengths,
+//     normalizedFiberVelocities, maxIsometricForce, optimalFiberLength,
+//     vMaxFactor, pennationAngle)
+//
+// model is 'bhargava' or 'umberger'. Activations and normalized fiber
+// kinematics are frames x muscles and the muscle properties have one value
+// per muscle or one value for all muscles. Metabolic power is frames x 1
+// and the derivatives with respect to each muscle activation are
+// frames x muscles. Derivatives are only computed if requested.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#include "mex.h"
+#include <omp.h>
+#include "MetabolicCostModel.h"
+#include "MexArrayHelpers.h"
+
+MuscleParameter getMuscleParameter(const mxArray* input, int numMuscles,
+        const char* name) {
+    MuscleParameter parameter;
+    if (mxIsDouble(input) && !mxIsComplex(input)) {
+        parameter.data = mxGetPr(input);
+        parameter.size = (int) mxGetNumberOfElements(input);
+    }
+    if (!parameter.isValid(numMuscles)) {
+        mexErrMsgIdAndTxt("NMSM:metabolicCost",
+            "%s must have one value per muscle.", name);
+    }
+    return parameter;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
+    if (nrhs != 9) {
+        mexErrMsgTxt("calcMetabolicCostMex takes 9 arguments.\n");
+    }
+    MetabolicModel model = bhargavaMetabolicModel;
+    if (mexArgumentIsCommand(prhs[0], "bhargava")) {
+        model = bhargavaMetabolicModel;
+    } else if (mexArgumentIsCommand(prhs[0], "umberger")) {
+        model = umbergerMetabolicModel;
+    } else {
+        mexErrMsgTxt("Metabolic model must be 'bhargava' or 'umberger'.\n");
+    }
+    const double mass = mxGetScalar(prhs[1]);
+    const MatrixView activations = mexArrayToView(prhs[2]);
+    const MatrixView fiberLengths = mexArrayToView(prhs[3]);
+    const MatrixView fiberVelocities = mexArrayToView(prhs[4]);
+    const int numFrames = activations.rows;
+    const int numMuscles = activations.columns;
+    checkInputRows(fiberLengths, numFrames, numMuscles,
+        "Normalized fiber lengths");
+    checkInputRows(fiberVelocities, numFrames, numMuscles,
+        "Normalized fiber velocities");
+
+    MetabolicMuscleParameters parameters;
+    parameters.maxIsometricForce = getMuscleParameter(prhs[5], numMuscles,
+        "Max isometric force");
+    parameters.optimalFiberLength = getMuscleParameter(prhs[6], numMuscles,
+        "Optimal fiber length");
+    parameters.vMaxFactor = getMuscleParameter(prhs[7], numMuscles,
+        "vMaxFactor");
+    parameters.pennationAngle = getMuscleParameter(prhs[8], numMuscles,
+        "Pennation angle");
+
+    plhs[0] = mxCreateUninitNumericMatrix(numFrames, 1, mxDOUBLE_CLASS,
+        mxREAL);
+    OutputMatrixView derivatives;
+    if (nlhs > 1) {
+        derivatives = createOutputMatrix(&plhs[1], numFrames, numMuscles,
+            true);
+    }
+    calcMetabolicPowerBatch(model, mass, activations, fiberLengths,
+        fiberVelocities, parameters, mxGetPr(plhs[0]), derivatives,
+        omp_get_max_threads());
+}
@@ -0,0 +1,176 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Evaluates the Muscle Tendon Personalization muscle model from EMG
+// splines to muscle joint moments in one call. Used by
+// calcMtpModeledValues.m when makeNativeEmgSplines.m has packed the EMG
+// splines of the inputs.
+//
+// [muscleExcitations, muscleActivations, normalizedFiberLength,
+//     normalizedFiberVelocity, passiveForce, muscleJointMoments] =
+//     calcMtpModeledValuesMex(experimentalData, values)
+//
+// experimentalData is the Muscle Tendon Personalization inputs struct with
+// the nativeEmgSplines field, and values is the struct made by
+// makeMtpValuesAsStruct.m. The outputs have the sizes of the matching
+// fields made by calcMtpModeledValues.m.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#include "mex.h"
+#include <omp.h>
+#include "MuscleTendonModel.h"
+
+const mxArray* getDoubleField(const mxArray* input, const char* name) {
+    const mxArray* field = mxGetField(input, 0, name);
+    if (field == NULL || mxIsEmpty(field) || !mxIsDouble(field) ||
+            mxIsComplex(field)) {
+        mexErrMsgIdAndTxt("NMSM:mtpModel",
+            "Field %s is missing or not a real double array.", name);
+    }
+    return field;
+}
+
+MuscleParameter getMuscleParameter(const mxArray* input, const char* name) {
+    const mxArray* field = getDoubleField(input, name);
+    MuscleParameter parameter;
+    parameter.data = mxGetPr(field);
+    parameter.size = (int) mxGetNumberOfElements(field);
+    return parameter;
+}
+
+// Size of a dimension, counting the trailing singletons MATLAB drops
+int getDimension(const mxArray* input, mwSize dimension) {
+    return dimension < mxGetNumberOfDimensions(input) ?
+        (int) mxGetDimensions(input)[dimension] : 1;
+}
+
+mxArray* createArray(int rows, int columns, int pages) {
+    const mwSize dims[3] = {(mwSize) rows, (mwSize) columns, (mwSize) pages};
+    return mxCreateUninitNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
+    if (nrhs != 2 || !mxIsStruct(prhs[0]) || !mxIsStruct(prhs[1])) {
+        mexErrMsgTxt("calcMtpModeledValuesMex takes the experimental data and values structs.\n");
+    }
+    const mxArray* inputs = prhs[0];
+    const mxArray* splines = mxGetField(inputs, 0, "nativeEmgSplines");
+    if (splines == NULL || !mxIsStruct(splines)) {
+        mexErrMsgTxt("EMG splines must be packed with makeNativeEmgSplines.\n");
+    }
+
+    MtpExperimentalData data;
+    const mxArray* emgTime = getDoubleField(inputs, "emgTime");
+    const mxArray* muscleTendonLength = getDoubleField(inputs,
+        "muscleTendonLength");
+    const mxArray* momentArms = getDoubleField(inputs, "momentArms");
+    const mxArray* breaks = getDoubleField(splines, "breaks");
+    const mxArray* coefficients = getDoubleField(splines, "coefficients");
+    data.numTrials = (int) mxGetM(emgTime);
+    data.numEmgFrames = (int) mxGetN(emgTime);
+    data.numMuscles = getDimension(muscleTendonLength, 1);
+    data.numCoordinates = getDimension(momentArms, 1);
+    data.numPaddingFrames = (int) mxGetScalar(getDoubleField(inputs,
+        "numPaddingFrames"));
+    data.numPieces = (int) mxGetM(breaks) - 1;
+    const int numFrames = data.numFrames();
+    if (getDimension(muscleTendonLength, 0) != data.numTrials ||
+            getDimension(muscleTendonLength, 2) != numFrames ||
+            getDimension(momentArms, 0) != data.numTrials ||
+            getDimension(momentArms, 2) != data.numMuscles ||
+            getDimension(momentArms, 3) != numFrames) {
+        mexErrMsgTxt("Muscle tendon lengths and moment arms do not match the EMG frames.\n");
+    }
+    if (data.numPieces < 1 || (int) mxGetN(breaks) != data.numTrials ||
+            mxGetNumberOfElements(coefficients) != (std::size_t) 4 *
+            data.numPieces * data.numMuscles * data.numTrials) {
+        mexErrMsgTxt("Packed EMG splines do not match the EMG data.\n");
+    }
+    const mxArray* muscleTendonVelocity = getDoubleField(inputs,
+        "muscleTendonVelocity");
+    if (mxGetNumberOfElements(muscleTendonVelocity) !=
+            mxGetNumberOfElements(muscleTendonLength)) {
+        mexErrMsgTxt("Muscle tendon velocities must match the lengths.\n");
+    }
+    data.emgTime = mxGetPr(emgTime);
+    data.splineBreaks = mxGetPr(breaks);
+    data.splineCoefficients = mxGetPr(coefficients);
+    data.muscleTendonLength = mxGetPr(muscleTendonLength);
+    data.muscleTendonVelocity = mxGetPr(muscleTendonVelocity);
+    data.momentArms = mxGetPr(momentArms);
+    data.maxIsometricForce = getMuscleParameter(inputs, "maxIsometricForce");
+    data.pennationAngle = getMuscleParameter(inputs, "pennationAngle");
+    data.optimalFiberLength = getMuscleParameter(inputs,
+        "optimalFiberLength");
+    data.tendonSlackLength = getMuscleParameter(inputs, "tendonSlackLength");
+    data.vMaxFactor = getMuscleParameter(inputs, "vMaxFactor");
+    if (!data.maxIsometricForce.isValid(data.numMuscles) ||
+            !data.pennationAngle.isValid(data.numMuscles) ||
+            !data.optimalFiberLength.isValid(data.numMuscles) ||
+            !data.tendonSlackLength.isValid(data.numMuscles) ||
+            !data.vMaxFactor.isValid(data.numMuscles)) {
+        mexErrMsgTxt("Muscle properties must have one value per muscle.\n");
+    }
+
+    MtpDesignValues values;
+    values.electromechanicalDelays = getMuscleParameter(prhs[1],
+        "electromechanicalDelays");
+    values.activationTimeConstants = getMuscleParameter(prhs[1],
+        "activationTimeConstants");
+    values.activationNonlinearityConstants = getMuscleParameter(prhs[1],
+        "activationNonlinearityConstants");
+    values.emgScaleFactors = getMuscleParameter(prhs[1], "emgScaleFactors");
+    values.optimalFiberLengthScaleFactors = getMuscleParameter(prhs[1],
+        "optimalFiberLengthScaleFactors");
+    values.tendonSlackLengthScaleFactors = getMuscleParameter(prhs[1],
+        "tendonSlackLengthScaleFactors");
+
+    mxArray* results[6];
+    results[0] = createArray(data.numTrials, data.numMuscles,
+        data.numEmgFrames);
+    for (int k = 1; k < 5; k++) {
+        results[k] = createArray(data.numTrials, data.numMuscles, numFrames);
+    }
+    results[5] = createArray(data.numTrials, data.numCoordinates, numFrames);
+    MtpModeledValues outputs;
+    outputs.muscleExcitations = mxGetPr(results[0]);
+    outputs.muscleActivations = mxGetPr(results[1]);
+    outputs.normalizedFiberLength = mxGetPr(results[2]);
+    outputs.normalizedFiberVelocity = mxGetPr(results[3]);
+    outputs.passiveForce = mxGetPr(results[4]);
+    outputs.muscleJointMoments = mxGetPr(results[5]);
+    if (!calcMtpModeledValuesBatch(data, values, outputs,
+            omp_get_max_threads())) {
+        for (int k = 0; k < 6; k++) {
+            mxDestroyArray(results[k]);
+        }
+        mexErrMsgTxt("Design values must have one value per muscle.\n");
+    }
+    for (int k = 0; k < 6; k++) {
+        if (k < nlhs || k == 0) {
+            plhs[k] = results[k];
+        } else {
+            mxDestroyArray(results[k]);
+        }
+    }
+}
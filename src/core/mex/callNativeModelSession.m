@@ -0,0 +1,48 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calls the native inverse dynamics or point kinematics MEX
+% function with the model of a session from loadNativeModelSession. The
+% kernel is "inverseDynamics" or "pointKinematics", and the arguments and
+% outputs are those of a call to the MEX function without a session,
+% including its commands such as 'groundContactInverseDynamics'.
+%
+% (struct, string, ...) -> (...)
+% Returns the outputs of the MEX function call with the session's model
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function varargout = callNativeModelSession(session, kernel, varargin)
+if kernel == "inverseDynamics"
+    mexName = getInverseDynamicsMexName(session.version);
+elseif kernel == "pointKinematics"
+    mexName = getPointKinematicsMexName(session.version);
+else
+    error("Native kernel must be inverseDynamics or pointKinematics.")
+end
+if nargout == 0
+    feval(mexName, 'session', session.(kernel), varargin{:});
+else
+    [varargout{1:nargout}] = feval(mexName, 'session', ...
+        session.(kernel), varargin{:});
+end
+end
@@ -0,0 +1,73 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function fits the same data with OpenSim's GCVSplineSet and with
+% the native GCV spline MEX function, and compares their values and first
+% and second derivatives at points inside and outside the range of the
+% data. It raises an error if a difference, relative to the GCVSplineSet
+% value where that is larger than one, exceeds the tolerance, which
+% defaults to 1e-8. configureNativeGcvSplines runs it before enabling
+% native splines.
+%
+% (double) -> (double)
+% Returns the largest difference between native and Java GCV splines
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function maxDifference = checkNativeGcvSplines(tolerance)
+import org.opensim.modeling.*
+if nargin < 1
+    tolerance = 1e-8;
+end
+[isCompiled, mexName] = hasNativeGcvSplines();
+assert(isCompiled, mexName + " has not been compiled. See " + ...
+    "compileGcvSplinesMex.")
+
+% Unevenly spaced frames and columns of different shapes
+time = linspace(0, 1, 41)' + 0.004 * sin(37 * (1 : 41)');
+data = [sin(2 * pi * time), time .^ 3 - time, ...
+    exp(-4 * time) .* cos(9 * time)];
+labels = ["sine", "cubic", "damped"];
+degree = 5;
+% Both extrapolate the end intervals outside the data
+points = linspace(time(1) - 0.1, time(end) + 0.1, 97)';
+columns = 0 : size(data, 2) - 1;
+
+table = TimeSeriesTable(StdVectorDouble(time), ...
+    Matrix.createFromMat(data), StdVectorString(labels));
+javaSplines = GCVSplineSet(table, StdVectorString(labels), degree);
+nativeHandle = feval(mexName, 'fit', time, data, degree);
+releaser = onCleanup(@() feval(mexName, 'release', nativeHandle));
+
+maxDifference = 0;
+for derivative = 0 : 2
+    expected = evaluateGcvSplines(javaSplines, columns, points, ...
+        derivative);
+    actual = feval(mexName, 'evaluate', nativeHandle, ...
+        double(columns), points, derivative);
+    difference = max(abs(actual - expected) ./ ...
+        max(1, abs(expected)), [], 'all');
+    assert(difference <= tolerance, "Native GCV spline derivative " + ...
+        derivative + " differs from GCVSplineSet by " + difference + ".")
+    maxDifference = max(maxDifference, difference);
+end
+end
@@ -0,0 +1,99 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function compiles an OpenMP MEX source file against an OpenSim
+% installation. The installation directory may use the 'sdk' layout of the
+% Windows and Linux OpenSim distributions or a UNIX FHS layout from a
+% source build. If no directory is given, the OPENSIM_HOME environment
+% variable is used. The compiled MEX file is written to the mex directory
+% with the given output name.
+%
+% (string, string, string) -> (None)
+% Compiles a MEX file linked to the OpenSim API
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function compileMexWithOpenSim(sourceFile, outputName, openSimDirectory)
+if nargin < 3 || isempty(openSimDirectory)
+    openSimDirectory = getenv('OPENSIM_HOME');
+end
+assert(isfolder(openSimDirectory), "OpenSim installation directory " + ...
+    "not found. Pass the directory or set OPENSIM_HOME.")
+mexDirectory = fileparts(mfilename("fullpath"));
+
+if isfolder(fullfile(openSimDirectory, 'sdk'))
+    sdk = fullfile(openSimDirectory, 'sdk');
+    includeDirectories = {fullfile(sdk, 'include'), ...
+        fullfile(sdk, 'include', 'OpenSim'), ...
+        fullfile(sdk, 'include', 'OpenSim', 'Simulation'), ...
+        fullfile(sdk, 'include', 'OpenSim', 'Common'), ...
+        fullfile(sdk, 'Simbody', 'include'), ...
+        fullfile(sdk, 'Simbody', 'include', 'simbody'), ...
+        fullfile(sdk, 'spdlog', 'include')};
+    libraryDirectories = {fullfile(sdk, 'lib'), ...
+        fullfile(sdk, 'Simbody', 'lib'), ...
+        fullfile(sdk, 'Simbody', 'lib64')};
+else
+    includeDirectories = {fullfile(openSimDirectory, 'include'), ...
+        fullfile(openSimDirectory, 'include', 'OpenSim'), ...
+        fullfile(openSimDirectory, 'include', 'OpenSim', 'Simulation'), ...
+        fullfile(openSimDirectory, 'include', 'OpenSim', 'Common'), ...
+        fullfile(openSimDirectory, 'include', 'simbody')};
+    libraryDirectories = {fullfile(openSimDirectory, 'lib'), ...
+        fullfile(openSimDirectory, 'lib64')};
+end
+includeDirectories = includeDirectories(cellfun(@isfolder, ...
+    includeDirectories));
+libraryDirectories = libraryDirectories(cellfun(@isfolder, ...
+    libraryDirectories));
+
+libraries = {'-losimCommon', '-losimSimulation', '-losimAnalyses', ...
+    '-losimActuators', '-losimTools', '-losimLepton', ...
+    '-lSimTKcommon', '-lSimTKmath', '-lSimTKsimbody'};
+if ispc
+    libraries = [libraries, {'-lliblapack', '-llibblas', ...
+        '-losimJavaJNI', '-lspdlog'}];
+    flags = {'COMPFLAGS=/openmp $COMPFLAGS', '-DWIN32', '-D_WINDOWS', ...
+        '-DNDEBUG'};
+    ucrt = dir(fullfile(getenv('ProgramFiles(x86)'), 'Windows Kits', ...
+        '10', 'Include', '*', 'ucrt'));
+    if ~isempty(ucrt)
+        includeDirectories{end + 1} = fullfile(ucrt(end).folder, ...
+            ucrt(end).name);
+    end
+else
+    % The rpath lets MATLAB find the OpenSim libraries without changing
+    % LD_LIBRARY_PATH before MATLAB starts.
+    rpath = strjoin("-Wl,-rpath," + string(libraryDirectories), " ");
+    flags = {'CXXFLAGS=$CXXFLAGS -fopenmp -std=c++17', ...
+        char("LDFLAGS=$LDFLAGS -fopenmp " + rpath), '-DNDEBUG'};
+end
+
+mexArguments = [flags, {fullfile(mexDirectory, sourceFile), '-output', ...
+    outputName, '-outdir', mexDirectory}, ...
+    cellfun(@(directory) ['-I' directory], includeDirectories, ...
+    'UniformOutput', false), ...
+    cellfun(@(directory) ['-L' directory], libraryDirectories, ...
+    'UniformOutput', false), libraries];
+mex(mexArguments{:});
+clear hasCompiledMex getNativeMexInterfaceVersion
+end
@@ -1,24 +1,46 @@
-mex CXXFLAGS="/$CXXFLAGS -fopenmp" LDFLAGS="/$LDFLAGS -fopenmp"...
-    COMPFLAGS="/openmp $COMPFLAGS"...
-    PointKinematics.cpp...
-    -L'C:\opensim-core-4.5.1\sdk\lib'...
-    -L'C:\opensim-core-4.5.1\sdk\Simbody\lib'...
-    -L'C:\opensim-core-4.5.1\sdk\spdlog\lib\spdlog'...
-    -L'C:\opensim-core-4.5.1\sdk\spdlog\include'...
-    -L'C:\opensim-core-4.5.1\sdk\spdlog\include\spdlog'...
-    -losimCommon -losimSimulation...
-    -losimAnalyses -losimActuators -losimTools...
-    -lSimTKcommon -lSimTKmath...
-    -lSimTKsimbody -lliblapack...
-    -llibblas -losimJavaJNI -losimLepton...
-    -lspdlog...
-    -I'C:\opensim-core-4.5.1\sdk\include'...
-    -I'C:\opensim-core-4.5.1\sdk\include\OpenSim'...
-    -I'C:\opensim-core-4.5.1\sdk\Simbody\include'...
-    -I'C:\opensim-core-4.5.1\sdk\include\OpenSim\Simulation'...
-    -I'C:\opensim-core-4.5.1\sdk\spdlog\include'...
-    -I'C:\opensim-core-4.5.1\sdk\spdlog\include\spdlog\details'...
-    -I'C:\Program Files (x86)\Windows Kits\10\Include\10.0.22621.0\ucrt'...
-    -I'C:\opensim-core-4.5.1\sdk\include\OpenSim\Common'...
-    -DWIN32 -D_WINDOWS  -DNDEBUG...
-    ; 
\ No newline at end of file
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function compiles the OpenMP point kinematics MEX function for the
+% current platform and the linked OpenSim API version. The OpenSim
+% installation directory defaults to the OPENSIM_HOME environment
+% variable. See "Compiling MEX files.md" for details.
+%
+% (string) -> (None)
+% Compiles the point kinematics MEX function
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Marleny Vega, Spencer Williams                               %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function compilePointKinematicsMex(openSimDirectory)
+if nargin < 1
+    openSimDirectory = [];
+end
+if ispc
+    platform = "Windows";
+else
+    platform = "Linux";
+end
+compileMexWithOpenSim('PointKinematics.cpp', ...
+    char("pointKinematicsMex" + platform + getOpenSimVersion()), ...
+    openSimDirectory);
+clear hasNativeMexFunctions
+end
@@ -0,0 +1,44 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function compiles an OpenMP MEX source file that does not use the
+% OpenSim API, such as the ground contact, surrogate muscle, Muscle Tendon
+% Personalization and metabolic cost kernels. Only a C++ compiler with
+% OpenMP support is needed. The MEX file is written to the mex directory
+% with the name of the source file.
+%
+% (string) -> (None)
+% Compiles a MEX file that does not link to OpenSim
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function compileStandaloneMex(sourceFile)
+mexDirectory = fileparts(mfilename("fullpath"));
+if ispc
+    flags = {'COMPFLAGS=/openmp /O2 $COMPFLAGS'};
+else
+    flags = {'CXXFLAGS=$CXXFLAGS -fopenmp -std=c++17', ...
+        'CXXOPTIMFLAGS=-O3 -DNDEBUG', 'LDFLAGS=$LDFLAGS -fopenmp'};
+end
+mex(flags{:}, fullfile(mexDirectory, sourceFile), '-outdir', mexDirectory);
+clear hasCompiledMex
+end
@@ -0,0 +1,56 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function sets how the native inverse dynamics and point kinematics
+% MEX functions divide the frames of a call among threads. 'automatic', the
+% default, uses no more threads than frames or processors, gives each
+% thread one block of frames, and hands out chunks of frames on demand
+% when frame costs differ (metabolic cost, ground contact, result cache).
+% 'static', 'dynamic' and 'guided' select one kind for every call. grain is
+% the number of frames per chunk, or 0 to choose it from the frames and
+% threads of each call. pinThreads binds each worker thread to one
+% processor for the length of each call, including the call that makes
+% its model copy, which keeps the copy in that processor's memory on
+% multi-socket machines.
+%
+% (char, double, logical, double) -> (None)
+% Sets the frame schedule of the native MEX functions
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function configureNativeFrameSchedule(kind, grain, pinThreads, version)
+if nargin < 2
+    grain = 0;
+end
+if nargin < 3
+    pinThreads = false;
+end
+if nargin < 4
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 6, "Frame schedules " + ...
+    "require MEX functions compiled from the current sources.")
+feval(getInverseDynamicsMexName(version), 'configureSchedule', char(kind), ...
+    grain, pinThreads);
+feval(getPointKinematicsMexName(version), 'configureSchedule', ...
+    char(kind), grain, pinThreads);
+end
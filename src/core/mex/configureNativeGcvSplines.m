@@ -0,0 +1,48 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function chooses whether makeGcvSplineSet fits splines with the
+% native GCV spline MEX function. GCV splines use OpenSim's GCVSplineSet
+% through the Java API by default. Enabling native splines first runs
+% checkNativeGcvSplines, so they are only used if they match
+% GCVSplineSet. Called without an argument, it returns whether native
+% splines are enabled. Spline sets that have been fit keep their kind.
+%
+% (logical) -> (logical)
+% Enables or disables native GCV splines
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function enabled = configureNativeGcvSplines(enabled)
+persistent isEnabled
+if isempty(isEnabled)
+    isEnabled = false;
+end
+if nargin < 1
+    enabled = isEnabled;
+    return
+end
+if enabled
+    checkNativeGcvSplines();
+end
+isEnabled = logical(enabled);
+end
@@ -0,0 +1,49 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function enables or disables the stage timers of the native inverse
+% dynamics and point kinematics MEX functions and clears their counters.
+% The timers add per-thread time spent in input marshalling, coordinate
+% setting, realizeVelocity, realizeDynamics, the inverse dynamics solve,
+% the optional angular momentum, body orientation and metabolic cost
+% outputs and output writes. If tracing is true, every timed stage is also
+% recorded for writeNativeProfileTrace.
+%
+% (logical, logical, double) -> (None)
+% Enables or disables the native MEX profilers
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function configureNativeProfiler(enabled, tracing, version)
+if nargin < 2
+    tracing = false;
+end
+if nargin < 3
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 5, "Profiling " + ...
+    "requires MEX functions compiled from the current sources.")
+feval(getInverseDynamicsMexName(version), 'configureProfiler', ...
+    enabled, tracing);
+feval(getPointKinematicsMexName(version), 'configureProfiler', ...
+    enabled, tracing);
+end
@@ -0,0 +1,44 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function sets how many solved frames the native inverse dynamics
+% and point kinematics MEX functions keep between calls. Frames whose time,
+% coordinate values, speeds, accelerations and controls match a cached
+% frame of the same request are copied instead of solved, which helps when
+% cost, constraint and finite difference evaluations repeat frames. A
+% capacity of 0 disables the caches. Configuring a cache clears its
+% entries and counters, and loading a model clears its entries.
+%
+% (double, double) -> (None)
+% Sets the capacity of the native MEX result caches
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function configureNativeResultCache(capacity, version)
+if nargin < 2
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 3, "Result caches " + ...
+    "require MEX functions compiled from the current sources.")
+feval(getInverseDynamicsMexName(version), 'configureCache', capacity);
+feval(getPointKinematicsMexName(version), 'configureCache', capacity);
+end
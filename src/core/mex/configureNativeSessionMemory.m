@@ -0,0 +1,46 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function sets the memory, in bytes, that the model sessions of each
+% native MEX function may use. The memory of a session is estimated from
+% the growth of the process while its model was parsed, times its model
+% copies. When the estimate is above the budget, the least recently used
+% sessions free their models and parse them again on their next call, so
+% their handles stay valid. A budget of 0, the default, keeps every
+% session loaded.
+%
+% (double, double) -> (None)
+% Sets the memory budget of the native MEX model sessions
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function configureNativeSessionMemory(budgetBytes, version)
+if nargin < 2
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 8, "Model sessions " + ...
+    "require MEX functions compiled from the current sources.")
+feval(getInverseDynamicsMexName(version), 'configureSessionMemory', ...
+    budgetBytes);
+feval(getPointKinematicsMexName(version), 'configureSessionMemory', ...
+    budgetBytes);
+end
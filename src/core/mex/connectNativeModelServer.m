@@ -0,0 +1,60 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function connects the native inverse dynamics and point kinematics
+% MEX functions to a local model server started with nmsmModelServer and
+% loads a model on it. Processes that load the same model file on one
+% server share its model copies while the file is unchanged, and the
+% server runs the requests of all processes on one set of threads. Use the
+% returned struct with inverseDynamicsOnModelServer and
+% pointKinematicsOnModelServer, and free it with releaseNativeModelServer.
+% Models that a process has not released are freed when it exits.
+%
+% (string, string, double) -> (struct)
+% Returns the server name and model handles of the native MEX functions
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function server = connectNativeModelServer(serverName, modelFile, version)
+if nargin < 3
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 10, "Model servers " + ...
+    "require MEX functions compiled from the current sources.")
+fileInfo = dir(modelFile);
+assert(isscalar(fileInfo) && ~fileInfo.isdir, "The model file " + ...
+    modelFile + " was not found.")
+% The server runs in its own directory, and processes share a model only
+% when they name the same file
+modelFile = fullfile(fileInfo.folder, fileInfo.name);
+server.version = version;
+server.serverName = char(serverName);
+mexNames = [getInverseDynamicsMexName(version), ...
+    getPointKinematicsMexName(version)];
+handles = zeros(1, 2);
+for i = 1 : 2
+    feval(mexNames(i), 'connectServer', server.serverName);
+    handles(i) = feval(mexNames(i), 'serverLoad', char(modelFile));
+end
+server.inverseDynamics = handles(1);
+server.pointKinematics = handles(2);
+end
@@ -1,6 +1,19 @@
 // This function is part of the NMSM Pipeline, see file for full license.
 //
-// performs inverse dynamics with openMP
+// Fits GCV splines to the columns of a data matrix and evaluates them with
+// OpenMP. Fitted spline sets are kept in this MEX file and referred to by a
+// handle, so data is only fit once and each evaluation of any columns,
+// times and derivative order is a single call.
+//
+// handle = mex('fit', time, data, degree)
+// values = mex('evaluate', handle, columns, time, derivative)
+// mex('release', handle)
+//
+// Columns are zero-based, as returned by GCVSplineSet.getIndex. The fit
+// uses the same generalized cross-validation spline (GCVSPL) as OpenSim's
+// GCVSplineSet, with unit weights and zero error variance. Releasing a
+// handle that is no longer valid does nothing, so MATLAB can release its
+// sets when they are cleared, even after this MEX file was cleared.
 
 // ----------------------------------------------------------------------- //
 // The NMSM Pipeline is a toolkit for model personalization and treatment  //
@@ -25,88 +38,115 @@
 // ----------------------------------------------------------------------- //
 
 #include "mex.h"
-#include <math.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <OpenSim/OpenSim.h>
-#include <GCVSplineSet.h>
-#include <string.h>
 #include <omp.h>
-#include <matrix.h>
-#include <iostream> 
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
-#include <io.h>
-#include <process.h>
-#include <windows.h>
+#include "GcvSplineKernel.h"
+#include "MexArrayHelpers.h"
 
-using namespace OpenSim;
 using namespace SimTK;
 using namespace std;
 
 //______________________________________________________________________________
 
-
-void ClearMemory(void){
+struct NativeSplineSet {
+    vector<Spline> splines;
+    int degree = 5;
+};
+
+// Handles start from a value that differs between loads of this MEX
+// file, so a set released from MATLAB after the file was cleared and
+// loaded again does not free a newer set with the same handle
+long long getFirstHandle(){
+    const long long ticks = (long long) chrono::steady_clock::now()
+        .time_since_epoch().count();
+    return ((ticks & 0xFFFFF) << 24) + 1;
 }
 
-vector<vector<double>> mexArrayToVector(const mxArray *input) {
-    const mwSize *dimension;
-    dimension = mxGetDimensions(input);
-    int rows = (int) dimension[0];
-    int columns = (int) dimension[1];
-    double *data = (double *) mxGetData(input);
-    vector<vector<double>> output(rows, vector<double>(columns));
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < columns; j++) {
-            memcpy(&output[i][j], data + i + j * rows, sizeof(double) );
-        }
-    }
-    return output;
-}
+static map<long long, unique_ptr<NativeSplineSet>> splineSets;
+static long long nextHandle = getFirstHandle();
 
-vector<int> mexArrayToVectorInt(const mxArray *input, int numPts) {
-    int *data = (int *) mxGetData(input);
-    vector<int> output(numPts);
-    for (int i = 0; i < numPts; i++) {
-        memcpy(&output[i], data + i, sizeof(int) );
-    }
-    return output;
+void ClearMemory(void){
+    splineSets.clear();
 }
 
-vector<double> mexArrayToVectorDouble(const mxArray *input, int numPts) {
-    double *data = (double *) mxGetData(input);
-    vector<double> output(numPts);
-    for (int i = 0; i < numPts; i++) {
-        memcpy(&output[i], data + i, sizeof(double) );
+NativeSplineSet& getSplineSet(const mxArray* handle){
+    auto found = splineSets.find((long long) mxGetScalar(handle));
+    if (found == splineSets.end()) {
+        mexErrMsgTxt("GCV spline set handle is not valid, it may have been released or cleared.\n");
     }
-    return output;
+    return *found->second;
 }
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
     mexAtExit(ClearMemory);
-    if (nrhs == 4) {
-        const int numColumns = mxGetN(prhs[1]);
-		const int numPts = mxGetN(prhs[2]);
-
-        vector<int> columns = mexArrayToVectorInt(prhs[1], numColumns);
-        vector<double> time = mexArrayToVectorDouble(prhs[2], numPts);
-
-        mexPrintf(typeid(dynamic_cast<GCVSplineSet*>(mxGetPr(prhs[0]))).name());
-
-        GCVSplineSet *splineSet = dynamic_cast<GCVSplineSet*>(mxGetPr(prhs[0]));
-
-        // int derivative = mxGetScalar(prhs[3]);
-
-        // plhs[0] = mxCreateDoubleMatrix(numPts,numColumns,mxREAL);
-		// double *values = mxGetPr(plhs[0]);
-
-        // for (int i = 0; i < numColumns; i++) {
-        //     for (int j = 0; j < numPts; j++) {
-        //         values[j + numPts * i] = splineSet->evaluate(columns[i], 0, time[j]);
-        //     }
-        // }
+    if (nrhs == 0) {
+        plhs[0] = mxCreateDoubleScalar(NMSM_MEX_INTERFACE_VERSION);
+        return;
+    }
+    if (mexArgumentIsCommand(prhs[0], "fit")) {
+        if (nrhs != 4) {
+            mexErrMsgTxt("fit takes a time vector, a data matrix and a degree.\n");
+        }
+        const MatrixView time = mexArrayToView(prhs[1]);
+        const MatrixView data = mexArrayToView(prhs[2]);
+        const int numPts = (int) mxGetNumberOfElements(prhs[1]);
+        const int degree = (int) mxGetScalar(prhs[3]);
+        if (degree < 1 || degree % 2 == 0) {
+            mexErrMsgTxt("GCV spline degree must be odd.\n");
+        }
+        if (numPts <= degree) {
+            mexErrMsgTxt("GCV splines need more frames than the spline degree.\n");
+        }
+        checkInputRows(data, numPts, 0, "Spline data");
+
+        unique_ptr<NativeSplineSet> splineSet(new NativeSplineSet());
+        splineSet->degree = degree;
+        const string error = fitGcvSplines(time.data, numPts, data, degree,
+            splineSet->splines);
+        if (!error.empty()) {
+            mexErrMsgTxt(error.c_str());
+        }
+        const long long handle = nextHandle++;
+        splineSets[handle].reset(splineSet.release());
+        plhs[0] = mxCreateDoubleScalar((double) handle);
+    }
+    else if (mexArgumentIsCommand(prhs[0], "evaluate")) {
+        if (nrhs != 5) {
+            mexErrMsgTxt("evaluate takes a handle, columns, times and a derivative order.\n");
+        }
+        const NativeSplineSet& splineSet = getSplineSet(prhs[1]);
+        const int numColumns = (int) mxGetNumberOfElements(prhs[2]);
+        const int numPts = (int) mxGetNumberOfElements(prhs[3]);
+        const double* columnData = mxGetPr(prhs[2]);
+        const double* time = mxGetPr(prhs[3]);
+        const int derivative = (int) mxGetScalar(prhs[4]);
+        if (derivative < 0 || derivative > splineSet.degree) {
+            mexErrMsgTxt("Derivative order must be between zero and the spline degree.\n");
+        }
+        vector<int> columns(numColumns);
+        for (int i = 0; i < numColumns; i++) {
+            columns[i] = (int) columnData[i];
+            if (columns[i] < 0 || columns[i] >= (int) splineSet.splines.size()) {
+                mexErrMsgTxt("Spline column is not in the spline set.\n");
+            }
+        }
+        const OutputMatrixView values = createOutputMatrix(&plhs[0], numPts, numColumns, true);
 
-		// columns.clear();
-		// time.clear();
-    }   
-}
\ No newline at end of file
+        evaluateGcvSplines(splineSet.splines, columns, time, numPts,
+            derivative, values);
+    }
+    else if (mexArgumentIsCommand(prhs[0], "release")) {
+        if (nrhs != 2) {
+            mexErrMsgTxt("release takes a handle.\n");
+        }
+        splineSets.erase((long long) mxGetScalar(prhs[1]));
+    }
+    else {
+        mexErrMsgTxt("Unknown command, use fit, evaluate or release.\n");
+    }
+}
@@ -0,0 +1,211 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Evaluates the polynomial surrogate muscle model of every muscle for all
+// frames in one call. Used by Treatment Optimization through
+// makeNativeSurrogateModel.m and calcSurrogateModel.m.
+//
+// model = evaluateSurrogateModelMex('compile', numCoordinates,
+//     muscleCoordinates, exponents, coefficients)
+// [lengths, momentArms, velocities] = evaluateSurrogateModelMex(model,
+//     positions, velocities)
+//
+// For compile, muscleCoordinates, exponents and coefficients are cell
+// arrays with one entry per muscle holding the zero-based model coordinate
+// of each muscle coordinate, the terms x muscle coordinates monomial
+// exponents and the term coefficients. The compiled model is a struct of
+// plain arrays, so it can be saved with the other inputs. Positions and
+// velocities are frames x model coordinates, and velocities may be empty.
+// Lengths and velocities are frames x muscles and moment arms are
+// frames x model coordinates x muscles.
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#include "mex.h"
+#include <omp.h>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "MexArrayHelpers.h"
+#include "SurrogateMuscleModel.h"
+
+const char* modelFields[] = {"numCoordinates", "monomialParents",
+    "monomialCoordinates", "muscleRowStarts", "rowCoordinates",
+    "rowTermStarts", "termMonomials", "termCoefficients"};
+const int numModelFields = 8;
+
+mxArray* createIntArray(const std::vector<int>& values) {
+    mxArray* output = mxCreateNumericMatrix(values.size(), 1, mxINT32_CLASS,
+        mxREAL);
+    if (!values.empty()) {
+        std::memcpy(mxGetData(output), values.data(),
+            values.size() * sizeof(int));
+    }
+    return output;
+}
+
+std::vector<int> getIntegers(const mxArray* input, const char* name) {
+    if (!mxIsDouble(input) || mxIsComplex(input)) {
+        mexErrMsgIdAndTxt("NMSM:surrogateModel",
+            "%s must be real double arrays.", name);
+    }
+    const double* data = mxGetPr(input);
+    std::vector<int> output(mxGetNumberOfElements(input));
+    for (std::size_t k = 0; k < output.size(); k++) {
+        output[k] = (int) std::lround(data[k]);
+        if (output[k] != data[k]) {
+            mexErrMsgIdAndTxt("NMSM:surrogateModel",
+                "%s must hold integers.", name);
+        }
+    }
+    return output;
+}
+
+void compileModel(mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    if (nrhs != 5 || !mxIsCell(prhs[2]) || !mxIsCell(prhs[3]) ||
+            !mxIsCell(prhs[4])) {
+        mexErrMsgTxt("compile takes the coordinate count and three cell arrays.\n");
+    }
+    const int numMuscles = (int) mxGetNumberOfElements(prhs[2]);
+    if ((int) mxGetNumberOfElements(prhs[3]) != numMuscles ||
+            (int) mxGetNumberOfElements(prhs[4]) != numMuscles) {
+        mexErrMsgTxt("One coordinate, exponent and coefficient entry is required per muscle.\n");
+    }
+    const int numCoordinates = (int) mxGetScalar(prhs[1]);
+    SurrogateModelCompiler compiler(numCoordinates);
+    for (int i = 0; i < numMuscles; i++) {
+        SurrogateMuscle muscle;
+        muscle.coordinates = getIntegers(mxGetCell(prhs[2], i),
+            "Muscle coordinates");
+        muscle.exponents = getIntegers(mxGetCell(prhs[3], i), "Exponents");
+        const mxArray* coefficients = mxGetCell(prhs[4], i);
+        if (!mxIsDouble(coefficients) || mxIsComplex(coefficients)) {
+            mexErrMsgTxt("Coefficients must be real double arrays.\n");
+        }
+        muscle.coefficients.assign(mxGetPr(coefficients),
+            mxGetPr(coefficients) + mxGetNumberOfElements(coefficients));
+        const std::string error = compiler.addMuscle(muscle);
+        if (!error.empty()) {
+            mexErrMsgIdAndTxt("NMSM:surrogateModel", "Muscle %d: %s",
+                i + 1, error.c_str());
+        }
+    }
+
+    const CompiledSurrogateModel& model = compiler.getModel();
+    plhs[0] = mxCreateStructMatrix(1, 1, numModelFields, modelFields);
+    mxSetField(plhs[0], 0, "numCoordinates",
+        mxCreateDoubleScalar(numCoordinates));
+    mxSetField(plhs[0], 0, "monomialParents",
+        createIntArray(model.monomialParents));
+    mxSetField(plhs[0], 0, "monomialCoordinates",
+        createIntArray(model.monomialCoordinates));
+    mxSetField(plhs[0], 0, "muscleRowStarts",
+        createIntArray(model.muscleRowStarts));
+    mxSetField(plhs[0], 0, "rowCoordinates",
+        createIntArray(model.rowCoordinates));
+    mxSetField(plhs[0], 0, "rowTermStarts",
+        createIntArray(model.rowTermStarts));
+    mxSetField(plhs[0], 0, "termMonomials",
+        createIntArray(model.termMonomials));
+    mxArray* coefficients = mxCreateDoubleMatrix(
+        model.termCoefficients.size(), 1, mxREAL);
+    if (!model.termCoefficients.empty()) {
+        std::memcpy(mxGetPr(coefficients), model.termCoefficients.data(),
+            model.termCoefficients.size() * sizeof(double));
+    }
+    mxSetField(plhs[0], 0, "termCoefficients", coefficients);
+}
+
+const mxArray* getModelField(const mxArray* model, const char* name,
+        mxClassID classId) {
+    const mxArray* field = mxGetField(model, 0, name);
+    if (field == NULL || mxGetClassID(field) != classId) {
+        mexErrMsgIdAndTxt("NMSM:surrogateModel",
+            "Compiled surrogate model field %s is missing or has the wrong type.",
+            name);
+    }
+    return field;
+}
+
+const int* getModelIntegers(const mxArray* model, const char* name) {
+    return (const int*) mxGetData(getModelField(model, name, mxINT32_CLASS));
+}
+
+// Views the compiled model arrays without copying
+SurrogateModelLayout readModel(const mxArray* model) {
+    SurrogateModelLayout layout;
+    layout.numCoordinates = (int) mxGetScalar(getModelField(model,
+        "numCoordinates", mxDOUBLE_CLASS));
+    const mxArray* parents = getModelField(model, "monomialParents",
+        mxINT32_CLASS);
+    layout.numMonomials = (int) mxGetNumberOfElements(parents);
+    layout.numMuscles = (int) mxGetNumberOfElements(getModelField(model,
+        "muscleRowStarts", mxINT32_CLASS)) - 1;
+    layout.monomialParents = (const int*) mxGetData(parents);
+    layout.monomialCoordinates = getModelIntegers(model,
+        "monomialCoordinates");
+    layout.muscleRowStarts = getModelIntegers(model, "muscleRowStarts");
+    layout.rowCoordinates = getModelIntegers(model, "rowCoordinates");
+    layout.rowTermStarts = getModelIntegers(model, "rowTermStarts");
+    layout.termMonomials = getModelIntegers(model, "termMonomials");
+    layout.termCoefficients = mxGetPr(getModelField(model,
+        "termCoefficients", mxDOUBLE_CLASS));
+    if (layout.numMonomials < 1 || layout.numMuscles < 0) {
+        mexErrMsgTxt("Compiled surrogate model is empty.\n");
+    }
+    return layout;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
+    if (nrhs > 0 && mexArgumentIsCommand(prhs[0], "compile")) {
+        compileModel(plhs, nrhs, prhs);
+        return;
+    }
+    if (nrhs != 3 || !mxIsStruct(prhs[0])) {
+        mexErrMsgTxt("evaluateSurrogateModelMex takes a compiled model, positions and velocities.\n");
+    }
+    const SurrogateModelLayout model = readModel(prhs[0]);
+    const MatrixView positions = mexArrayToView(prhs[1]);
+    const MatrixView velocities = mexArrayToView(prhs[2]);
+    const int numFrames = positions.rows;
+    checkInputRows(positions, numFrames, model.numCoordinates, "Positions");
+    if (!velocities.isEmpty()) {
+        checkInputRows(velocities, numFrames, model.numCoordinates,
+            "Velocities");
+    }
+
+    plhs[0] = mxCreateDoubleMatrix(numFrames, model.numMuscles, mxREAL);
+    const mwSize dims[3] = {(mwSize) numFrames,
+        (mwSize) model.numCoordinates, (mwSize) model.numMuscles};
+    plhs[1] = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+    mxArray* muscleVelocities = mxCreateDoubleMatrix(numFrames,
+        model.numMuscles, mxREAL);
+    evaluateSurrogateModelBatch(model, positions, velocities,
+        mxGetPr(plhs[0]), mxGetPr(muscleVelocities), mxGetPr(plhs[1]),
+        omp_get_max_threads());
+    if (nlhs > 2) {
+        plhs[2] = muscleVelocities;
+    } else {
+        mxDestroyArray(muscleVelocities);
+    }
+}
@@ -0,0 +1,54 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function returns the interface version of the native inverse
+% dynamics MEX function, or 0 if native MEX functions are not available or
+% were compiled before interface versions were added. MATLAB code checks
+% this version before using entry points that older compiled MEX functions
+% do not provide. Calling the MEX function without arguments is safe for
+% every compiled version because older versions ignore the call.
+%
+% (double) -> (double)
+% Returns the interface version of the native MEX functions
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function interfaceVersion = getNativeMexInterfaceVersion(version)
+persistent checkedVersions interfaceVersions
+if nargin < 1
+    version = getOpenSimVersion();
+end
+index = find(checkedVersions == version, 1);
+if isempty(index)
+    checkedVersions(end + 1) = version;
+    interfaceVersions(end + 1) = 0;
+    if hasNativeMexFunctions(version)
+        try
+            interfaceVersions(end) = feval( ...
+                getInverseDynamicsMexName(version));
+        catch
+        end
+    end
+    index = length(checkedVersions);
+end
+interfaceVersion = interfaceVersions(index);
+end
@@ -0,0 +1,42 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function returns the hits, misses, entries and capacity of the
+% result caches of the native inverse dynamics and point kinematics MEX
+% functions, set with configureNativeResultCache.
+%
+% (double) -> (struct)
+% Returns the inverseDynamics and pointKinematics cache statistics
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function statistics = getNativeResultCacheStatistics(version)
+if nargin < 1
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 3, "Result caches " + ...
+    "require MEX functions compiled from the current sources.")
+statistics.inverseDynamics = feval(getInverseDynamicsMexName(version), ...
+    'cacheStatistics');
+statistics.pointKinematics = feval(getPointKinematicsMexName(version), ...
+    'cacheStatistics');
+end
@@ -0,0 +1,45 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function returns true and the MEX function name if the native GCV
+% spline MEX function has been compiled with compileGcvSplinesMex for the
+% linked OpenSim version. makeGcvSplineSet only uses it once it has been
+% enabled with configureNativeGcvSplines.
+%
+% (None) -> (logical, string)
+% Returns true if native GCV splines are available
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [available, mexName] = hasNativeGcvSplines()
+persistent compiledName
+if isempty(compiledName)
+    if ispc
+        platform = "Windows";
+    else
+        platform = "Linux";
+    end
+    compiledName = "evaluateGcvSplinesMex" + platform + getOpenSimVersion();
+end
+available = hasCompiledMex(compiledName);
+mexName = compiledName;
+end
@@ -0,0 +1,62 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function returns true if the OpenMP inverse dynamics and point
+% kinematics MEX functions can be used on this platform. Windows uses the
+% precompiled mexw64 files shipped with the pipeline. Linux uses the
+% mexa64 files built locally with compileInverseDynamicsMex and
+% compilePointKinematicsMex for the linked OpenSim version.
+%
+% (double) -> (logical)
+% Returns true if native MEX functions are available
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function available = hasNativeMexFunctions(version)
+persistent linkedVersion checkedVersions availableVersions
+if isequal(mexext, 'mexw64')
+    available = true;
+    return
+end
+if ~isequal(mexext, 'mexa64')
+    available = false;
+    return
+end
+if nargin < 1
+    if isempty(linkedVersion)
+        linkedVersion = getOpenSimVersion();
+    end
+    version = linkedVersion;
+end
+% exist() searches the path, so the result is cached per version. Run
+% "clear hasNativeMexFunctions" after compiling new MEX functions.
+index = find(checkedVersions == version, 1);
+if isempty(index)
+    checkedVersions(end + 1) = version;
+    availableVersions(end + 1) = exist("pointKinematicsMexLinux" + ...
+        version, 'file') == 3 && exist( ...
+        "inverseDynamicsMomentumMetabolicOrientationMexLinux" + ...
+        version, 'file') == 3;
+    index = length(checkedVersions);
+end
+available = availableVersions(index);
+end
@@ -2,9 +2,11 @@
 %
 % This function initializes the point kinematics and inverse dynamics mex 
 % files if the appropriate mex extention exists. It also clears previous
-% parallel workers 
+% parallel workers. The optional number of threads sets how many model
+% copies the mex files may create. By default the mex files use
+% OMP_NUM_THREADS or the number of cores. 
 %
-% (Array of string) -> (double)
+% (Array of string, double) -> (double)
 % Intializes mex files or clear previous parallel workers 
 
 % ----------------------------------------------------------------------- %
@@ -29,16 +31,27 @@
 % permissions and limitations under the License.                          %
 % ----------------------------------------------------------------------- %
 
-function version = initializeMexOrMatlabParallelFunctions(modelFile)
+function version = initializeMexOrMatlabParallelFunctions(modelFile, ...
+    numThreads)
 version = getOpenSimVersion();
+loadArguments = {modelFile};
+if nargin > 1
+    loadArguments{end + 1} = numThreads;
+end
 if isequal(mexext, 'mexw64')
     if version >= 40501
-        pointKinematicsMexWindows40501(modelFile);
-        inverseDynamicsMomentumMetabolicOrientationMexWindows40501(modelFile);
+        pointKinematicsMexWindows40501(loadArguments{:});
+        inverseDynamicsMomentumMetabolicOrientationMexWindows40501( ...
+            loadArguments{:});
     else
-        pointKinematicsMexWindows40400(modelFile);
-        inverseDynamicsMomentumMetabolicOrientationMexWindows40400(modelFile);
+        pointKinematicsMexWindows40400(loadArguments{:});
+        inverseDynamicsMomentumMetabolicOrientationMexWindows40400( ...
+            loadArguments{:});
     end
+elseif hasNativeMexFunctions(version)
+    feval("pointKinematicsMexLinux" + version, loadArguments{:});
+    feval("inverseDynamicsMomentumMetabolicOrientationMexLinux" + ...
+        version, loadArguments{:});
 end
 clear inverseDynamicsMatlabParallel
 clear pointKinematicsMatlabParallel
@@ -55,6 +55,14 @@ if isequal(mexext, 'mexw64')
             bodyOrientationIndices, computeAngularMomentum, ...
             computeMetabolicCost, computeBodyOrientation);
     end
+elseif hasNativeMexFunctions(version)
+    [inverseDynamicsMoments, angularMomentum, metabolicCost, ...
+        massCenterVelocity, bodyOrientations] = feval( ...
+        "inverseDynamicsMomentumMetabolicOrientationMexLinux" + version, ...
+        time, jointAngles, jointVelocities, jointAccelerations, ...
+        coordinateLabels, appliedLoads, muscleActivations, ...
+        bodyOrientationIndices, computeAngularMomentum, ...
+        computeMetabolicCost, computeBodyOrientation);
 else
     if nargout == 1
         inverseDynamicsMoments = inverseDynamicsMatlabParallel(time, ...
@@ -0,0 +1,59 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calculates inverse dynamics moments and their derivatives
+% with respect to the joint angles, velocities, accelerations and applied
+% loads in one call of the native MEX function. The loads of a frame only
+% depend on the inputs of that frame, so each derivative is returned as
+% per-frame blocks in a (coordinates x columns x frames) array. Columns
+% follow coordinateLabels for the joint derivatives and the columns of
+% appliedLoads for the load derivatives. Derivatives with respect to
+% accelerations are columns of the mass matrix. The others are central
+% differences evaluated inside the MEX function. Use
+% makeBlockDiagonalJacobian to assemble a sparse Jacobian.
+%
+% Contact surfaces, if given, are applied as in
+% inverseDynamicsWithGroundContact, and appliedLoads only holds the muscle
+% and coordinate actuator controls.
+%
+% (Array of number, 2D matrix, 2D matrix, 2D matrix, Cell, 2D matrix,
+% double, Cell) -> (2D matrix, struct)
+% Returns inverse dynamics moments and their per-frame derivatives
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [inverseDynamicsMoments, jacobian] = inverseDynamicsJacobian( ...
+    time, jointAngles, jointVelocities, jointAccelerations, ...
+    coordinateLabels, appliedLoads, version, contactSurfaces)
+assert(getNativeMexInterfaceVersion(version) >= 2, "The inverse " + ...
+    "dynamics Jacobian requires MEX functions compiled from the " + ...
+    "current sources.")
+mexArguments = {time, jointAngles, jointVelocities, jointAccelerations, ...
+    coordinateLabels, appliedLoads};
+if nargin > 7 && ~isempty(contactSurfaces)
+    mexArguments{end + 1} = contactSurfaces;
+end
+[inverseDynamicsMoments, jacobian.positions, jacobian.velocities, ...
+    jacobian.accelerations, jacobian.appliedLoads] = feval( ...
+    getInverseDynamicsMexName(version), 'inverseDynamicsJacobian', ...
+    mexArguments{:});
+end
@@ -35,176 +35,436 @@
 #include <matrix.h>
 #include <iostream> 
 #include <vector>
+#include "GroundContactModel.h"
+#include "InverseDynamicsKernel.h"
+#include "MexArrayHelpers.h"
+#include "ModelSession.h"
+#include "ModelSessionMex.h"
+#include "ModelSessionRegistry.h"
+#include "ModelServerMex.h"
 
 using namespace OpenSim;
 using namespace SimTK;
 using namespace std;
-#define numThreads 20 //
 
 //______________________________________________________________________________
 
-static Model *osimModel[numThreads];
-static State *osimState[numThreads];
-static InverseDynamicsSolver *idSolver[numThreads];
-static bool modelIsLoaded = false;
+// Replicas, coordinate binding, opt-in result cache, retained frame States
+// and stage timers of the model loaded without a handle
+static ModelSession defaultSession;
+// Sessions loaded with loadSession and used with ('session', handle, ...)
+static ModelSessionRegistry sessions;
+// Connection to a local model server, used by the server commands
+static ModelServerConnection serverConnection;
+// Calls made with ('submit', ...) until they are collected by ticket
+static MexSubmittedCalls submissions;
 
 void ClearMemory(void){
-    for (int i = 0; i < numThreads; i++){
-		delete osimModel[i];
-		delete idSolver[i];
-	}
-    modelIsLoaded = false;
+    defaultSession.clear();
+    sessions.clear();
+    submissions.clear();
+    serverConnection.client.disconnect();
     mexPrintf("Cleared memory from inverseDynamics mex file.\n");
 }
 
-vector<vector<double>> mexArrayToVector(const mxArray *input) {
-    const mwSize *dimension;
-    dimension = mxGetDimensions(input);
-    int rows = (int) dimension[0];
-    int columns = (int) dimension[1];
-    double *data = (double *) mxGetData(input);
-    vector<vector<double>> output(rows, vector<double>(columns));
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < columns; j++) {
-            memcpy(&output[i][j], data + i + j * rows, sizeof(double) );
-        }
+// Reads the inverse dynamics arguments (time, q, qp, qpp, coordinate
+// labels, applied loads, muscle activations, orientation bodies and the
+// three calculation flags) starting at args[0]. Bodies are resolved here so
+// the parallel region only makes OpenSim and Simbody calls.
+InverseDynamicsInputs readInverseDynamicsInputs(ModelSession& session,
+        const mxArray *args[]){
+    InverseDynamicsInputs inputs = mexReadInverseDynamicsInputs(session, args);
+    inputs.muscleActivations = mexArrayToView(args[6]);
+    inputs.computeAngularMomentum = mxGetScalar(args[8]) > 0.5;
+    inputs.computeMetabolicCost = mxGetScalar(args[9]) > 0.5;
+    inputs.computeBodyOrientation = mxGetScalar(args[10]) > 0.5;
+    if (inputs.computeBodyOrientation) {
+        inputs.orientationBodies = mexGetBodies(session, args[7], "Orientation");
     }
-    return output;
+    return inputs;
 }
 
-void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
-    mexAtExit(ClearMemory);
-    if (nrhs == 1) {    
-        if (modelIsLoaded == true){
-            ClearMemory();
-        }
-        string modelName = mxArrayToString(prhs[0]);      
-        std::streambuf* oldCoutStreamBuf = std::cout.rdbuf();
-		std::ostringstream strCout;
-		std::cout.rdbuf(strCout.rdbuf());
-        for (int i = 0; i < numThreads; i++){
-			osimModel[i] = new Model(modelName); 
-			osimState[i] = &osimModel[i]->initSystem();
-			idSolver[i] = new InverseDynamicsSolver(*osimModel[i]);
-		}  
-		std::cout.rdbuf(oldCoutStreamBuf);
-        modelIsLoaded = true;
-    }
-    else if (nrhs > 1) {
-        if (modelIsLoaded == false){
-            mexErrMsgTxt("!!!No OpenSim model has been loaded!!!\n");
-        }   
-		const int numPts = mxGetM(prhs[0]);
-        const int numQs = mxGetN(prhs[1]);
-		const int numControls = mxGetN(prhs[5]);
-        const int numMuscles = mxGetN(prhs[6]);
-        const int numCoords = osimState[0]->getNQ();
-
-        double *time = mxGetPr(prhs[0]);
-        vector<vector<double>> q = mexArrayToVector(prhs[1]);
-        vector<vector<double>> qp = mexArrayToVector(prhs[2]);
-        vector<vector<double>> qpp = mexArrayToVector(prhs[3]);
-        vector<vector<double>> u = mexArrayToVector(prhs[5]);
-        vector<vector<double>> muscleActivations = mexArrayToVector(prhs[6]);
-		double* orientationBodies = mxGetPr(prhs[7]); // body number index for orientation
-        const int numBodies = mxGetN(prhs[7]);
-		double* computeAngularMomentum = (double *) mxGetData(prhs[8]);
-		double* computeMetabolicCost = (double *) mxGetData(prhs[9]);
-		double* computeBodyOrientation = (double *) mxGetData(prhs[10]);
-
-        mwIndex k;
-        mwSize numLabels, buflen;
-        numLabels = mxGetNumberOfElements(prhs[4]);
-
-        plhs[0] = mxCreateDoubleMatrix(numPts,numCoords,mxREAL);
-		double *idLoads = mxGetPr(plhs[0]);
- 		plhs[1] = mxCreateDoubleMatrix(numPts, 3, mxREAL);
-        double* angularMomentum = mxGetPr(plhs[1]);
-        plhs[2] = mxCreateDoubleMatrix(numPts, 1, mxREAL);
-		double* metabolicCost = mxGetPr(plhs[2]);
-        plhs[3] = mxCreateDoubleMatrix(2, 1, mxREAL);
-        double* massCenterPositions = mxGetPr(plhs[3]);
-        plhs[4] = mxCreateDoubleMatrix(numPts, 3 * numBodies, mxREAL);
-        double* bodyOrientations = mxGetPr(plhs[4]);
-
-        #pragma omp parallel for num_threads(numThreads)
-        for (int i = 0; i < numPts; ++i){
-            int thread_id = omp_get_thread_num();
-            osimState[thread_id]->setTime(time[i]);
-			
-            for (int k = 0; k < numLabels; k++){
-				const mxArray *cellElementPtr;
-                cellElementPtr = mxGetCell(prhs[4], k);
-                buflen = mxGetN(cellElementPtr)*sizeof(mxChar) + 1;
-                char* c_array;
-                c_array = (char *)  mxCalloc(buflen, sizeof(char));
-                int status = mxGetString(cellElementPtr, c_array, buflen);
-                osimModel[thread_id]->getCoordinateSet().get(c_array).setValue(*osimState[thread_id], q[i][k], false);
-                osimModel[thread_id]->getCoordinateSet().get(c_array).setSpeedValue(*osimState[thread_id], qp[i][k]);
-                mxFree(c_array);
-            }
+// Creates the five outputs of the inverse dynamics call in plhs[0..4].
+// Outputs the loop fills completely skip zero initialization.
+InverseDynamicsOutputs createInverseDynamicsOutputs(ModelSession& session,
+        mxArray *plhs[], const InverseDynamicsInputs& inputs){
+    const int numPts = inputs.q.rows;
+    const int numBodies = (int) inputs.orientationBodies.size();
+    InverseDynamicsOutputs outputs;
+    outputs.idLoads = createOutputMatrix(&plhs[0], numPts, session.getBinding().numStateCoordinates, true);
+    outputs.angularMomentum = createOutputMatrix(&plhs[1], numPts, 3, inputs.computeAngularMomentum);
+    outputs.metabolicCost = createOutputMatrix(&plhs[2], numPts, 1, inputs.computeMetabolicCost);
+    plhs[3] = mxCreateDoubleMatrix(2, 1, mxREAL);
+    outputs.massCenterVelocity = mxGetPr(plhs[3]);
+    outputs.bodyOrientations = createOutputMatrix(&plhs[4], numPts, 3 * numBodies, inputs.computeBodyOrientation);
+    return outputs;
+}
 
-            osimModel[thread_id]->realizeVelocity(*osimState[thread_id]);
-            if (*computeAngularMomentum > 0.5) {
-                SpatialVec momentum = osimModel[thread_id]->getMatterSubsystem().calcSystemCentralMomentum(*osimState[thread_id]);
-                Vec3 angularMomentumPoint = momentum.get(0);
-                for (int j = 0; j <= 2; j++) {
-                    angularMomentum[i + numPts * j] = angularMomentumPoint.get(j);
-                }
-            }
+const mxArray* getContactSurfaceField(const mxArray* surface, const char* name){
+    const mxArray* field = mxGetField(surface, 0, name);
+    if (field == NULL || mxIsEmpty(field) || !mxIsDouble(field)) {
+        mexErrMsgIdAndTxt("NMSM:contactSurface",
+            "Contact surface field %s is missing or not numeric.", name);
+    }
+    return field;
+}
 
-            if (i == 0) {
-                massCenterPositions[0] = osimModel[thread_id]->calcMassCenterVelocity(*osimState[thread_id]).get(0);
-            } else if (i == numPts - 1) {
-                massCenterPositions[1] = osimModel[thread_id]->calcMassCenterVelocity(*osimState[thread_id]).get(0);
-            }
+MobilizedBodyIndex getContactSurfaceBody(const mxArray* surface,
+        const char* name, const BodySet& bodySet){
+    const int bodyIndex = (int) mxGetScalar(getContactSurfaceField(surface, name));
+    if (bodyIndex < 0 || bodyIndex >= bodySet.getSize()) {
+        mexErrMsgIdAndTxt("NMSM:contactSurface",
+            "Contact surface field %s is not in the model body set.", name);
+    }
+    return bodySet.get(bodyIndex).getMobilizedBodyIndex();
+}
+
+ContactSpringBody readContactSprings(const mxArray* surface,
+        const char* bodyField, const char* pointsField,
+        const char* constantsField, const BodySet& bodySet){
+    ContactSpringBody springs;
+    springs.body = getContactSurfaceBody(surface, bodyField, bodySet);
+    const MatrixView points = mexArrayToView(getContactSurfaceField(surface, pointsField));
+    const mxArray* constants = getContactSurfaceField(surface, constantsField);
+    if (points.columns != 3 || (int) mxGetNumberOfElements(constants) != points.rows) {
+        mexErrMsgIdAndTxt("NMSM:contactSurface",
+            "Contact surface field %s must be N x 3 with one value of %s per row.",
+            pointsField, constantsField);
+    }
+    const double* springConstants = mxGetPr(constants);
+    for (int j = 0; j < points.rows; j++) {
+        springs.stations.push_back(Vec3(points(j, 0), points(j, 1), points(j, 2)));
+        springs.springConstants.push_back(springConstants[j]);
+    }
+    return springs;
+}
+
+// Reads a cell array of contact surface structs as prepared by
+// prepareGroundContactSurfaces.m. Body fields are zero-based body set
+// indices.
+vector<ContactSurface> readContactSurfaces(const mxArray* input, const BodySet& bodySet){
+    if (!mxIsCell(input)) {
+        mexErrMsgTxt("Contact surfaces must be a cell array of structs.\n");
+    }
+    vector<ContactSurface> surfaces(mxGetNumberOfElements(input));
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        const mxArray* surface = mxGetCell(input, i);
+        if (surface == NULL || !mxIsStruct(surface)) {
+            mexErrMsgTxt("Contact surfaces must be a cell array of structs.\n");
+        }
+        ContactSurface& contactSurface = surfaces[i];
+        contactSurface.parent = readContactSprings(surface, "parentBody",
+            "parentSpringPointsOnBody", "parentSpringConstants", bodySet);
+        contactSurface.child = readContactSprings(surface, "childBody",
+            "childSpringPointsOnBody", "childSpringConstants", bodySet);
+        contactSurface.midfootSuperiorBody = getContactSurfaceBody(surface,
+            "midfootSuperiorBody", bodySet);
+        const double* midfootSuperior = mxGetPr(getContactSurfaceField(surface,
+            "midfootSuperiorPointOnBody"));
+        contactSurface.midfootSuperiorStation = Vec3(midfootSuperior[0],
+            midfootSuperior[1], midfootSuperior[2]);
+        ContactSurfaceParameters& parameters = contactSurface.parameters;
+        parameters.dampingFactor = mxGetScalar(getContactSurfaceField(surface, "dampingFactor"));
+        parameters.restingSpringLength = mxGetScalar(getContactSurfaceField(surface, "restingSpringLength"));
+        parameters.dynamicFrictionCoefficient = mxGetScalar(getContactSurfaceField(surface, "dynamicFrictionCoefficient"));
+        parameters.viscousFrictionCoefficient = mxGetScalar(getContactSurfaceField(surface, "viscousFrictionCoefficient"));
+        parameters.beltSpeed = mxGetScalar(getContactSurfaceField(surface, "beltSpeed"));
+        parameters.latchingVelocity = mxGetScalar(getContactSurfaceField(surface, "latchingVelocity"));
+    }
+    return surfaces;
+}
 
-            Vector AccelsVec(numCoords, 0.0);
-            for (int j = 0; j < numCoords; j++){
-                double StateQ = osimState[thread_id]->getQ().get(j);
-                for (int k = 0; k < numQs; k++){
-                    if (abs(q[i][k] - StateQ) <= 1e-6){
-                        AccelsVec.set(j, qpp[i][k]);
-                    }
-                }
+// Reads a struct array of output channel requests with the fields kind,
+// bodies (zero-based body set indices) and, for station channels, points
+// (one row of body frame coordinates per body)
+vector<FrameChannel> readFrameChannels(ModelSession& session,
+        const mxArray* input){
+    if (!mxIsStruct(input)) {
+        mexErrMsgTxt("Output channels must be a struct array with a kind field.\n");
+    }
+    vector<FrameChannel> channels(mxGetNumberOfElements(input));
+    for (size_t c = 0; c < channels.size(); c++) {
+        FrameChannel& channel = channels[c];
+        const mxArray* kind = mxGetField(input, c, "kind");
+        char* kindName = kind != NULL ? mxArrayToString(kind) : NULL;
+        const bool isKind = kindName != NULL && getFrameChannelKind(kindName, channel.kind);
+        mxFree(kindName);
+        if (!isKind) {
+            mexErrMsgTxt("Output channel kind is not a known channel.\n");
+        }
+        if (!channel.isPerBody()) {
+            continue;
+        }
+        const mxArray* bodies = mxGetField(input, c, "bodies");
+        if (bodies == NULL || !mxIsDouble(bodies)) {
+            mexErrMsgIdAndTxt("NMSM:outputChannel",
+                "The %s channel needs body indices.", getFrameChannelName(channel.kind));
+        }
+        channel.bodies = mexGetBodies(session, bodies, "Output channel");
+        if (channel.kind == channelStationPosition || channel.kind == channelStationVelocity) {
+            const mxArray* points = mxGetField(input, c, "points");
+            const MatrixView stations = points != NULL ? mexArrayToView(points) : MatrixView();
+            if (stations.columns != 3 || stations.rows != (int) channel.bodies.size()) {
+                mexErrMsgIdAndTxt("NMSM:outputChannel",
+                    "The %s channel needs one point row per body.", getFrameChannelName(channel.kind));
             }
+            for (int j = 0; j < stations.rows; j++) {
+                channel.stations.push_back(Vec3(stations(j, 0), stations(j, 1), stations(j, 2)));
+            }
+        }
+    }
+    return channels;
+}
+
+// Reads forces applied to bodies at stations: bodies are zero-based body
+// set indices, stations has one row of body frame coordinates per body and
+// values has a row per frame with the force then the moment about the
+// station of each body, in ground
+FrameBodyForces readFrameBodyForces(ModelSession& session,
+        const mxArray* bodies, const mxArray* stations, const mxArray* values){
+    FrameBodyForces forces;
+    const MatrixView points = mexArrayToView(stations);
+    if (!mxIsDouble(bodies) || points.columns != 3 ||
+            (int) mxGetNumberOfElements(bodies) != points.rows) {
+        mexErrMsgTxt("Body force stations must be N x 3 with one body index per station.\n");
+    }
+    forces.bodies = mexGetBodies(session, bodies, "Body force");
+    for (int j = 0; j < points.rows; j++) {
+        forces.stations.push_back(Vec3(points(j, 0), points(j, 1), points(j, 2)));
+    }
+    forces.values = mexArrayToView(values);
+    return forces;
+}
 
-            Vector newControls(numControls, 0.0);
-            for (int j = 0; j < numControls; j++){
-                newControls.set(j, u[i][j]);
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
+    mexAtExit(ClearMemory);
+    if (nrhs == 0) {
+        plhs[0] = mxCreateDoubleScalar(NMSM_MEX_INTERFACE_VERSION);
+        return;
+    }
+    if (mexSessionRegistryCommand(sessions, plhs, nrhs, prhs)) {
+        return;
+    }
+    if (mexModelServerCommand(serverConnection, plhs, nrhs, prhs) ||
+            mexServerInverseDynamicsCommand(serverConnection, plhs, nrhs, prhs)) {
+        return;
+    }
+    if (submissions.command(plhs, nrhs, prhs)) {
+        return;
+    }
+    ModelSession& session = mexSelectSession(sessions, defaultSession, nrhs, prhs);
+    // ('submit', <kernel call arguments>) returns a ticket at once and
+    // solves the call on the session's worker thread
+    submissions.prepare(session, nrhs, prhs, plhs,
+        {"groundContactInverseDynamics", "inverseDynamicsWithChannels",
+        "bodyForceInverseDynamics"});
+    if (mexFrameCacheCommand(session.getResultCache(), plhs, nrhs, prhs)) {
+        return;
+    }
+    if (mexProfilerCommand(session.getProfiler(), "inverseDynamics", plhs, nrhs, prhs)) {
+        return;
+    }
+    if (mexScheduleCommand(session, nrhs, prhs)) {
+        return;
+    }
+    if (mexParameterCommand(session, nrhs, prhs)) {
+        return;
+    }
+    KernelProfiler& profiler = session.getProfiler();
+    // Inverse dynamics with ground contact applied in the same pass:
+    // ('groundContactInverseDynamics', <inverse dynamics arguments>,
+    // contactSurfaces[, markerLocations, markerBodies])
+    if (mexArgumentIsCommand(prhs[0], "groundContactInverseDynamics")) {
+        if (nrhs != 13 && nrhs != 15) {
+            mexErrMsgTxt("groundContactInverseDynamics takes 13 or 15 arguments.\n");
+        }
+        mexCheckModelSession(session);
+        profiler.beginCall(session.getNumThreads());
+        ProfileScope marshallingScope(&profiler, 0, profileInputMarshalling);
+        const BodySet& bodySet = session.getModel().getBodySet();
+        InverseDynamicsInputs inputs = readInverseDynamicsInputs(session, prhs + 1);
+        inputs.contactSurfaces = readContactSurfaces(prhs[12], bodySet);
+        if (nrhs == 15 && !mxIsEmpty(prhs[13])) {
+            const MatrixView markerLocations = mexArrayToView(prhs[13]);
+            if (markerLocations.columns != 3 ||
+                    (int) mxGetNumberOfElements(prhs[14]) != markerLocations.rows) {
+                mexErrMsgTxt("Marker locations must be N x 3 with one body index per marker.\n");
             }
-            osimModel[thread_id]->setControls(*osimState[thread_id], newControls);
-            osimModel[thread_id]->markControlsAsValid(*osimState[thread_id]);
-            osimModel[thread_id]->realizeDynamics(*osimState[thread_id]);
-
-            Vector IDLoadsVec;
-            IDLoadsVec = idSolver[thread_id]->solve(*osimState[thread_id], AccelsVec);
-            for (int j = 0; j < numCoords; j++){
-				idLoads[i + numPts * j] = IDLoadsVec[j]; 
-			}
-            
-            if (*computeBodyOrientation > 0.5) {
-                for (int j = 0; j < numBodies; j++) {
-                    Vec3 bodyOrientationVec;
-                    bodyOrientationVec = osimModel[thread_id]->getBodySet().get(orientationBodies[j]).getRotationInGround(*osimState[thread_id]).convertRotationToBodyFixedXYZ();
-                    bodyOrientations[i + numPts * j * 3] = bodyOrientationVec(0);
-                    bodyOrientations[i + numPts * (j * 3 + 1)] = bodyOrientationVec(1);
-                    bodyOrientations[i + numPts * (j * 3 + 2)] = bodyOrientationVec(2);
-                }
+            inputs.markerBodies = mexGetBodies(session, prhs[14], "Marker");
+            for (int j = 0; j < markerLocations.rows; j++) {
+                inputs.markerStations.push_back(Vec3(markerLocations(j, 0),
+                    markerLocations(j, 1), markerLocations(j, 2)));
             }
+        }
+
+        InverseDynamicsOutputs outputs = createInverseDynamicsOutputs(session, plhs, inputs);
+        const int numPts = inputs.q.rows;
+        const int numSurfaces = (int) inputs.contactSurfaces.size();
+        const int numMarkers = (int) inputs.markerStations.size();
+        outputs.groundReactionForces = createOutputMatrix(&plhs[5], numPts, 3 * numSurfaces, true);
+        outputs.groundReactionMoments = createOutputMatrix(&plhs[6], numPts, 3 * numSurfaces, true);
+        outputs.midfootSuperiorPositions = createOutputMatrix(&plhs[7], numPts, 3 * numSurfaces, true);
+        // Marker outputs use the frames x 3 x markers layout of pointKinematics
+        const mwSize markerDims[3] = {(mwSize) numPts, 3, (mwSize) numMarkers};
+        plhs[8] = mxCreateUninitNumericArray(3, markerDims, mxDOUBLE_CLASS, mxREAL);
+        plhs[9] = mxCreateUninitNumericArray(3, markerDims, mxDOUBLE_CLASS, mxREAL);
+        outputs.markerPositions = OutputMatrixView(mxGetPr(plhs[8]), numPts, 3 * numMarkers);
+        outputs.markerVelocities = OutputMatrixView(mxGetPr(plhs[9]), numPts, 3 * numMarkers);
+        marshallingScope.stop();
+
+        submissions.run(session, [&session, inputs, outputs]() {
+            session.calcInverseDynamics(inputs, outputs);
+        });
+    }
+    // Inverse dynamics with the requested output channels filled in the
+    // same pass: ('inverseDynamicsWithChannels', <inverse dynamics
+    // arguments>, channelRequests). The sixth output is a cell array with
+    // a frames x width x items array per request.
+    else if (mexArgumentIsCommand(prhs[0], "inverseDynamicsWithChannels")) {
+        if (nrhs != 13) {
+            mexErrMsgTxt("inverseDynamicsWithChannels takes 13 arguments.\n");
+        }
+        mexCheckModelSession(session);
+        profiler.beginCall(session.getNumThreads());
+        ProfileScope marshallingScope(&profiler, 0, profileInputMarshalling);
+        InverseDynamicsInputs inputs = readInverseDynamicsInputs(session, prhs + 1);
+        inputs.channels = readFrameChannels(session, prhs[12]);
+        InverseDynamicsOutputs outputs = createInverseDynamicsOutputs(session, plhs, inputs);
+        const int numPts = inputs.q.rows;
+        plhs[5] = mxCreateCellMatrix(1, inputs.channels.size());
+        for (size_t c = 0; c < inputs.channels.size(); c++) {
+            const FrameChannel& channel = inputs.channels[c];
+            const mwSize dims[3] = {(mwSize) numPts,
+                (mwSize) channel.getItemWidth(), (mwSize) channel.getNumItems()};
+            mxArray* values = mxCreateUninitNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+            mxSetCell(plhs[5], c, values);
+            outputs.channels.push_back(OutputMatrixView(mxGetPr(values), numPts,
+                channel.getNumColumns()));
+        }
+        marshallingScope.stop();
+        submissions.run(session, [&session, inputs, outputs]() {
+            session.calcInverseDynamics(inputs, outputs);
+        });
+    }
+    // Inverse dynamics with loads given as forces on bodies instead of
+    // model actuators, and with the muscles applying no force:
+    // ('bodyForceInverseDynamics', <inverse dynamics arguments>,
+    // forceBodies, forceStations, bodyForces). Applied loads may be empty.
+    else if (mexArgumentIsCommand(prhs[0], "bodyForceInverseDynamics")) {
+        if (nrhs != 15) {
+            mexErrMsgTxt("bodyForceInverseDynamics takes 15 arguments.\n");
+        }
+        mexCheckModelSession(session);
+        profiler.beginCall(session.getNumThreads());
+        ProfileScope marshallingScope(&profiler, 0, profileInputMarshalling);
+        InverseDynamicsInputs inputs = readInverseDynamicsInputs(session, prhs + 1);
+        inputs.excludeMuscleForces = true;
+        inputs.bodyForces = readFrameBodyForces(session, prhs[12], prhs[13], prhs[14]);
+        InverseDynamicsOutputs outputs = createInverseDynamicsOutputs(session, plhs, inputs);
+        marshallingScope.stop();
+        submissions.run(session, [&session, inputs, outputs]() {
+            session.calcInverseDynamics(inputs, outputs);
+        });
+    }
+    // Inverse dynamics and its per-frame Jacobian blocks:
+    // ('inverseDynamicsJacobian', time, q, qp, qpp, coordinateLabels,
+    // appliedLoads[, contactSurfaces])
+    else if (mexArgumentIsCommand(prhs[0], "inverseDynamicsJacobian")) {
+        if (nrhs != 7 && nrhs != 8) {
+            mexErrMsgTxt("inverseDynamicsJacobian takes 7 or 8 arguments.\n");
+        }
+        mexCheckModelSession(session);
+        InverseDynamicsInputs inputs = mexReadInverseDynamicsInputs(session, prhs + 1);
+        if (nrhs == 8) {
+            inputs.contactSurfaces = readContactSurfaces(prhs[7],
+                session.getModel().getBodySet());
+        }
 
-            if (*computeMetabolicCost > 0.5) {
-                for (int j = 0; j < numMuscles; j++) {
-                    osimModel[thread_id]->getForceSet().getMuscles().get(j).setActivation(*osimState[thread_id], muscleActivations[i][j]);
-                }
-                osimModel[thread_id]->realizeDynamics(*osimState[thread_id]);
-                osimModel[thread_id]->equilibrateMuscles(*osimState[thread_id]);
-				metabolicCost[i] = osimModel[thread_id]->getProbeSet().get(0).getProbeOutputs(*osimState[thread_id]).get(0);
-			}
-        }
-		//q.clear();
-		//qp.clear();
-		//qpp.clear();
-		//u.clear();
-    }   
-}
\ No newline at end of file
+        // Jacobian blocks are coordinates x columns x frames
+        const int numPts = inputs.q.rows;
+        const int numLabels = (int) session.getBinding().labels.size();
+        const int numCoords = session.getBinding().numStateCoordinates;
+        InverseDynamicsOutputs outputs;
+        outputs.idLoads = createOutputMatrix(&plhs[0], numPts, numCoords, true);
+        InverseDynamicsJacobian jacobian;
+        double** blocks[4] = {&jacobian.positions, &jacobian.velocities,
+            &jacobian.accelerations, &jacobian.controls};
+        for (int b = 0; b < 4; b++) {
+            const mwSize dims[3] = {(mwSize) numCoords,
+                (mwSize) (b == 3 ? inputs.controls.columns : numLabels),
+                (mwSize) numPts};
+            plhs[b + 1] = mxCreateUninitNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+            *blocks[b] = mxGetPr(plhs[b + 1]);
+        }
+        mexCallSession([&]() {
+            session.calcInverseDynamicsJacobian(inputs, outputs, jacobian);
+        });
+    }
+    // Realizes and keeps the frame States for retainedInverseDynamics:
+    // ('retainFrameKinematics', time, q, qp, coordinateLabels)
+    else if (mexArgumentIsCommand(prhs[0], "retainFrameKinematics")) {
+        if (nrhs != 5) {
+            mexErrMsgTxt("retainFrameKinematics takes 5 arguments.\n");
+        }
+        mexCheckModelSession(session);
+        InverseDynamicsInputs inputs;
+        inputs.time = mxGetPr(prhs[1]);
+        inputs.q = mexArrayToView(prhs[2]);
+        inputs.qp = mexArrayToView(prhs[3]);
+        checkInputRows(inputs.q, (int) mxGetM(prhs[1]), 0, "Joint angles");
+        mexBindCoordinates(session, prhs[4]);
+        mexCallSession([&]() { session.retainFrameKinematics(inputs); });
+    }
+    // Inverse dynamics of the retained frames with new accelerations and
+    // controls, whose columns follow the retained coordinate labels:
+    // ('retainedInverseDynamics', qpp, appliedLoads[, contactSurfaces])
+    else if (mexArgumentIsCommand(prhs[0], "retainedInverseDynamics")) {
+        if (nrhs != 3 && nrhs != 4) {
+            mexErrMsgTxt("retainedInverseDynamics takes 3 or 4 arguments.\n");
+        }
+        const RetainedFrameKinematics& retained = session.getRetainedKinematics();
+        if (!session.isLoaded() || retained.isEmpty()){
+            mexErrMsgTxt("No frame kinematics have been retained.\n");
+        }
+        profiler.beginCall(session.getNumThreads());
+        ProfileScope marshallingScope(&profiler, 0, profileInputMarshalling);
+        InverseDynamicsInputs inputs;
+        inputs.qpp = mexArrayToView(prhs[1]);
+        inputs.controls = mexArrayToView(prhs[2]);
+        if (nrhs == 4) {
+            inputs.contactSurfaces = readContactSurfaces(prhs[3],
+                session.getModel().getBodySet());
+        }
+        InverseDynamicsOutputs outputs;
+        outputs.idLoads = createOutputMatrix(&plhs[0], retained.getNumFrames(), retained.binding.numStateCoordinates, true);
+        marshallingScope.stop();
+        mexCallSession([&]() { session.calcRetainedInverseDynamics(inputs, outputs); });
+    }
+    // ('releaseFrameKinematics') frees the retained frame States
+    else if (mexArgumentIsCommand(prhs[0], "releaseFrameKinematics")) {
+        session.releaseFrameKinematics();
+    }
+    // Load model with an optional thread count, which defaults to
+    // OMP_NUM_THREADS or the number of cores
+    else if (nrhs == 1 || nrhs == 2) {    
+        if (&session != &defaultSession) {
+            mexErrMsgTxt("Sessions with handles are loaded with loadSession.\n");
+        }
+        mexLoadModelSession(session, nrhs, prhs);
+    }
+    else if (nrhs > 2) {
+        if (nrhs < 11) {
+            mexErrMsgTxt("Inverse dynamics takes 11 arguments.\n");
+        }
+        mexCheckModelSession(session);
+        profiler.beginCall(session.getNumThreads());
+        ProfileScope marshallingScope(&profiler, 0, profileInputMarshalling);
+        const InverseDynamicsInputs inputs = readInverseDynamicsInputs(session, prhs);
+        const InverseDynamicsOutputs outputs = createInverseDynamicsOutputs(session, plhs, inputs);
+        marshallingScope.stop();
+        submissions.run(session, [&session, inputs, outputs]() {
+            session.calcInverseDynamics(inputs, outputs);
+        });
+    }
+    submissions.finish();
+}
@@ -0,0 +1,59 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calculates inverse dynamics with loads applied as forces
+% on bodies rather than through actuators in the model. Each body has a
+% station in its own frame, and bodyForces has a row per frame with the
+% force then the moment about the station of each body, in ground. The
+% forces are added in the solve, so the model needs no actuators for them,
+% and muscles apply no force. The body indices are zero-based body set
+% indices. No applied loads are passed.
+%
+% Requires getNativeMexInterfaceVersion(version) >= 12.
+%
+% (Array of number, 2D matrix, 2D matrix, 2D matrix, Cell, 2D matrix,
+% Array of number, logical, logical, logical, Array of number, 2D matrix,
+% 2D matrix, double) -> (2D matrix, 2D matrix, 2D matrix,
+% Array of number, 2D matrix)
+% Returns inverse dynamics moments with the given body forces applied
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [inverseDynamicsMoments, angularMomentum, metabolicCost, ...
+    massCenterVelocity, bodyOrientations] = ...
+    inverseDynamicsWithBodyForces(time, jointAngles, jointVelocities, ...
+    jointAccelerations, coordinateLabels, muscleActivations, ...
+    bodyOrientationIndices, computeAngularMomentum, ...
+    computeMetabolicCost, computeBodyOrientation, forceBodyIndices, ...
+    forceStations, bodyForces, version)
+assert(getNativeMexInterfaceVersion(version) >= 12, "Inverse dynamics " + ...
+    "with body forces requires MEX functions compiled from the " + ...
+    "current sources.")
+[inverseDynamicsMoments, angularMomentum, metabolicCost, ...
+    massCenterVelocity, bodyOrientations] = ...
+    feval(getInverseDynamicsMexName(version), ...
+    'bodyForceInverseDynamics', time, jointAngles, jointVelocities, ...
+    jointAccelerations, coordinateLabels, [], muscleActivations, ...
+    bodyOrientationIndices, computeAngularMomentum, ...
+    computeMetabolicCost, computeBodyOrientation, forceBodyIndices, ...
+    forceStations, bodyForces);
+end
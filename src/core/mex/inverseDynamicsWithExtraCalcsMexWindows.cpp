@@ -25,171 +25,63 @@
 // ----------------------------------------------------------------------- //
 
 #include "mex.h"
-#include <math.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <OpenSim/OpenSim.h>
-#include <InverseDynamicsSolver.h>
-#include <string.h>
-#include <omp.h> //
-#include <matrix.h>
-#include <iostream> 
-#include <vector>
+#include <string>
+#include "InverseDynamicsKernel.h"
+#include "MexArrayHelpers.h"
+#include "ModelSession.h"
+#include "ModelSessionMex.h"
 
 using namespace OpenSim;
 using namespace SimTK;
 using namespace std;
-#define numThreads 20 //
 
 //______________________________________________________________________________
 
-static Model *osimModel[numThreads];
-static State *osimState[numThreads];
-static InverseDynamicsSolver *idSolver[numThreads];
-static bool modelIsLoaded = false;
+// Replicas and coordinate binding of the loaded model
+static ModelSession session;
 
 void ClearMemory(void){
-    for (int i = 0; i < numThreads; i++){
-		delete osimModel[i];
-		delete idSolver[i];
-	}
-    modelIsLoaded = false;
+    session.clear();
     mexPrintf("Cleared memory from inverseDynamics mex file.\n");
 }
 
-vector<vector<double>> mexArrayToVector(const mxArray *input) {
-    const mwSize *dimension;
-    dimension = mxGetDimensions(input);
-    int rows = (int) dimension[0];
-    int columns = (int) dimension[1];
-    double *data = (double *) mxGetData(input);
-    vector<vector<double>> output(rows, vector<double>(columns));
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < columns; j++) {
-            memcpy(&output[i][j], data + i + j * rows, sizeof(double) );
-        }
-    }
-    return output;
-}
-
+// (modelFile[, numThreads]) loads the model and
+// (time, q, qp, qpp, coordinateLabels, appliedLoads, muscleActivations,
+// computeAngularMomentum, computeMetabolicCost) returns the inverse
+// dynamics loads, angular momentum, metabolic cost and the mass center x
+// velocity of the first and last frames
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]){
     mexAtExit(ClearMemory);
-    if (nrhs == 1) {    
-        if (modelIsLoaded == true){
-            ClearMemory();
-        }
-        string modelName = mxArrayToString(prhs[0]);      
-        std::streambuf* oldCoutStreamBuf = std::cout.rdbuf();
-		std::ostringstream strCout;
-		std::cout.rdbuf(strCout.rdbuf());
-        for (int i = 0; i < numThreads; i++){
-			osimModel[i] = new Model(modelName); 
-			osimState[i] = &osimModel[i]->initSystem();
-			idSolver[i] = new InverseDynamicsSolver(*osimModel[i]);
-		}  
-		std::cout.rdbuf(oldCoutStreamBuf);
-        modelIsLoaded = true;
+    if (nrhs == 1 || nrhs == 2) {    
+        mexLoadModelSession(session, nrhs, prhs);
     }
-    else if (nrhs > 1) {
-        if (modelIsLoaded == false){
-            mexErrMsgTxt("!!!No OpenSim model has been loaded!!!\n");
-        }   
-		const int numPts = mxGetM(prhs[0]);
-        const int numQs = mxGetN(prhs[1]);
-		const int numControls = mxGetN(prhs[5]);
-        const int numMuscles = mxGetN(prhs[6]);
-        const int numCoords = osimState[0]->getNQ();
-
-        double *time = mxGetPr(prhs[0]);
-        vector<vector<double>> q = mexArrayToVector(prhs[1]);
-        vector<vector<double>> qp = mexArrayToVector(prhs[2]);
-        vector<vector<double>> qpp = mexArrayToVector(prhs[3]);
-        vector<vector<double>> u = mexArrayToVector(prhs[5]);
-        vector<vector<double>> muscleActivations = mexArrayToVector(prhs[6]);
-		double* computeAngularMomentum = (double *) mxGetData(prhs[7]);
-		double* computeMetabolicCost = (double *) mxGetData(prhs[8]);
-
-        mwIndex k;
-        mwSize numLabels, buflen;
-        numLabels = mxGetNumberOfElements(prhs[4]);
-
-        plhs[0] = mxCreateDoubleMatrix(numPts,numCoords,mxREAL);
-		double *idLoads = mxGetPr(plhs[0]);
- 		plhs[1] = mxCreateDoubleMatrix(numPts, 3, mxREAL);
-        double* angularMomentum = mxGetPr(plhs[1]);
-        plhs[2] = mxCreateDoubleMatrix(numPts, 1, mxREAL);
-		double* metabolicCost = mxGetPr(plhs[2]);
-        plhs[3] = mxCreateDoubleMatrix(2, 1, mxREAL);
-        double* massCenterPositions = mxGetPr(plhs[3]);
-
-        #pragma omp parallel for num_threads(numThreads)
-        for (int i = 0; i < numPts; ++i){
-            int thread_id = omp_get_thread_num();
-            osimState[thread_id]->setTime(time[i]);
-			
-            for (int k = 0; k < numLabels; k++){
-				const mxArray *cellElementPtr;
-                cellElementPtr = mxGetCell(prhs[4], k);
-                buflen = mxGetN(cellElementPtr)*sizeof(mxChar) + 1;
-                char* c_array;
-                c_array = (char *)  mxCalloc(buflen, sizeof(char));
-                int status = mxGetString(cellElementPtr, c_array, buflen);
-                osimModel[thread_id]->getCoordinateSet().get(c_array).setValue(*osimState[thread_id], q[i][k], false);
-                osimModel[thread_id]->getCoordinateSet().get(c_array).setSpeedValue(*osimState[thread_id], qp[i][k]);
-                mxFree(c_array);
-            }
-
-            osimModel[thread_id]->realizeVelocity(*osimState[thread_id]);
-            if (*computeAngularMomentum > 0.5) {
-                SpatialVec momentum = osimModel[thread_id]->getMatterSubsystem().calcSystemCentralMomentum(*osimState[thread_id]);
-                Vec3 angularMomentumPoint = momentum.get(0);
-                for (int j = 0; j <= 2; j++) {
-                    angularMomentum[i + numPts * j] = angularMomentumPoint.get(j);
-                }
-            }
-
-            if (i == 0) {
-                massCenterPositions[0] = osimModel[thread_id]->calcMassCenterVelocity(*osimState[thread_id]).get(0);
-            } else if (i == numPts - 1) {
-                massCenterPositions[1] = osimModel[thread_id]->calcMassCenterVelocity(*osimState[thread_id]).get(0);
-            }
-
-            Vector AccelsVec(numCoords, 0.0);
-            for (int j = 0; j < numCoords; j++){
-                double StateQ = osimState[thread_id]->getQ().get(j);
-                for (int k = 0; k < numQs; k++){
-                    if (abs(q[i][k] - StateQ) <= 1e-6){
-                        AccelsVec.set(j, qpp[i][k]);
-                    }
-                }
-            }
-
-            Vector newControls(numControls, 0.0);
-            for (int j = 0; j < numControls; j++){
-                newControls.set(j, u[i][j]);
+    else if (nrhs > 2) {
+        if (nrhs != 9) {
+            mexErrMsgTxt("Inverse dynamics takes 9 arguments.\n");
+        }
+        mexCheckModelSession(session);
+        InverseDynamicsInputs inputs = mexReadInverseDynamicsInputs(session, prhs);
+        inputs.muscleActivations = mexArrayToView(prhs[6]);
+        inputs.computeAngularMomentum = mxGetScalar(prhs[7]) > 0.5;
+        inputs.computeMetabolicCost = mxGetScalar(prhs[8]) > 0.5;
+        const int numPts = inputs.q.rows;
+        // All four outputs are created, so they are written through
+        // locals when MATLAB asks for fewer
+        mxArray* outputArrays[4];
+        InverseDynamicsOutputs outputs;
+        outputs.idLoads = createOutputMatrix(&outputArrays[0], numPts, session.getBinding().numStateCoordinates, true);
+        outputs.angularMomentum = createOutputMatrix(&outputArrays[1], numPts, 3, inputs.computeAngularMomentum);
+        outputs.metabolicCost = createOutputMatrix(&outputArrays[2], numPts, 1, inputs.computeMetabolicCost);
+        outputArrays[3] = mxCreateDoubleMatrix(2, 1, mxREAL);
+        outputs.massCenterVelocity = mxGetPr(outputArrays[3]);
+        mexCallSession([&]() { session.calcInverseDynamics(inputs, outputs); });
+        for (int j = 0; j < 4; j++) {
+            if (j < nlhs || j == 0) {
+                plhs[j] = outputArrays[j];
+            } else {
+                mxDestroyArray(outputArrays[j]);
             }
-            osimModel[thread_id]->setControls(*osimState[thread_id], newControls);
-            osimModel[thread_id]->markControlsAsValid(*osimState[thread_id]);
-            osimModel[thread_id]->realizeDynamics(*osimState[thread_id]);
-
-            Vector IDLoadsVec;
-            IDLoadsVec = idSolver[thread_id]->solve(*osimState[thread_id], AccelsVec);
-            for (int j = 0; j < numCoords; j++){
-				idLoads[i + numPts * j] = IDLoadsVec[j]; 
-			}     
-
-            if (*computeMetabolicCost > 0.5) {
-                for (int j = 0; j < numMuscles; j++) {
-                    osimModel[thread_id]->getForceSet().getMuscles().get(j).setActivation(*osimState[thread_id], muscleActivations[i][j]);
-                }
-                osimModel[thread_id]->realizeDynamics(*osimState[thread_id]);
-                osimModel[thread_id]->equilibrateMuscles(*osimState[thread_id]);
-				metabolicCost[i] = osimModel[thread_id]->getProbeSet().get(0).getProbeOutputs(*osimState[thread_id]).get(0);
-			}
         }
-		//q.clear();
-		//qp.clear();
-		//qpp.clear();
-		//u.clear();
-    }   
-}
\ No newline at end of file
+    }
+}
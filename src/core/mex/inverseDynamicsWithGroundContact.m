@@ -0,0 +1,63 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calculates inverse dynamics with the ground contact
+% surfaces applied as loads in one pass of the native MEX function. For
+% each frame, the spring kinematics, the spring forces, the transfer of
+% the contact moments to the parent and child bodies and the inverse
+% dynamics solve use the same model state. The contact surfaces are the
+% structs prepared by prepareGroundContactSurfaces, and appliedLoads only
+% holds the muscle and coordinate actuator controls. Tracked marker
+% positions and velocities are returned in the pointKinematics layout.
+%
+% Requires getNativeMexInterfaceVersion(version) >= 1.
+%
+% (Array of number, 2D matrix, 2D matrix, 2D matrix, Cell, 2D matrix,
+% 2D matrix, Array of number, logical, logical, logical, Cell, 2D matrix,
+% Array of number, double) -> (2D matrix, 2D matrix, 2D matrix,
+% Array of number, 2D matrix, struct, Cell, 3D matrix, 3D matrix)
+% Returns inverse dynamics moments and ground reactions
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [inverseDynamicsMoments, angularMomentum, metabolicCost, ...
+    massCenterVelocity, bodyOrientations, groundReactionsLab, ...
+    midfootSuperior, markerPositions, markerVelocities] = ...
+    inverseDynamicsWithGroundContact(time, jointAngles, ...
+    jointVelocities, jointAccelerations, coordinateLabels, ...
+    appliedLoads, muscleActivations, bodyOrientationIndices, ...
+    computeAngularMomentum, computeMetabolicCost, ...
+    computeBodyOrientation, contactSurfaces, markerLocations, ...
+    markerBodyIndices, version)
+[inverseDynamicsMoments, angularMomentum, metabolicCost, ...
+    massCenterVelocity, bodyOrientations, forces, moments, ...
+    midfootSuperiorPositions, markerPositions, markerVelocities] = ...
+    feval(getInverseDynamicsMexName(version), ...
+    'groundContactInverseDynamics', time, jointAngles, ...
+    jointVelocities, jointAccelerations, coordinateLabels, ...
+    appliedLoads, muscleActivations, bodyOrientationIndices, ...
+    computeAngularMomentum, computeMetabolicCost, ...
+    computeBodyOrientation, contactSurfaces, markerLocations, ...
+    markerBodyIndices);
+[groundReactionsLab, midfootSuperior] = splitGroundContactOutputs( ...
+    forces, moments, midfootSuperiorPositions, length(contactSurfaces));
+end
@@ -0,0 +1,53 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calculates inverse dynamics moments and fills the
+% requested output channels from the same frame states, so body positions,
+% velocities, momentum and joint reactions do not need another pass over
+% the model. channelRequests is a struct array with the fields kind,
+% bodies and points. kind is 'massCenterPosition', 'massCenterVelocity',
+% 'bodyOriginPosition', 'bodyOriginVelocity', 'bodyRotation',
+% 'stationPosition', 'stationVelocity', 'systemMomentum' or
+% 'jointReaction'. bodies holds zero-based body set indices and points
+% holds one row of body frame coordinates per body for the station
+% channels. Each channel is returned as a frames x width x items array,
+% where the width is 6 for momentum and joint reactions (force or angular
+% momentum first) and 3 otherwise.
+%
+% (Array of double, 2D matrix, 2D matrix, 2D matrix, Cell, 2D matrix,
+% struct array, double) -> (2D matrix, Cell)
+% Returns inverse dynamic moments and the requested output channels
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [inverseDynamicsMoments, channels] = ...
+    inverseDynamicsWithOutputChannels(time, jointAngles, ...
+    jointVelocities, jointAccelerations, coordinateLabels, ...
+    appliedLoads, channelRequests, version)
+assert(getNativeMexInterfaceVersion(version) >= 7, "Output channels " + ...
+    "require MEX functions compiled from the current sources.")
+[inverseDynamicsMoments, ~, ~, ~, ~, channels] = ...
+    feval(getInverseDynamicsMexName(version), ...
+    'inverseDynamicsWithChannels', time, jointAngles, jointVelocities, ...
+    jointAccelerations, coordinateLabels, appliedLoads, [], [], 0, 0, 0, ...
+    channelRequests);
+end
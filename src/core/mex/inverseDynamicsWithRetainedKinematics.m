@@ -0,0 +1,45 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calculates inverse dynamics moments for the frames kept by
+% retainInverseDynamicsKinematics with new joint accelerations and applied
+% loads. Rows are the retained frames and the acceleration columns follow
+% the retained coordinate labels. Only the forces and the inverse dynamics
+% solve are evaluated. Contact surfaces, if given, are applied as in
+% inverseDynamicsWithGroundContact.
+%
+% (2D matrix, 2D matrix, double, Cell) -> (2D matrix)
+% Returns inverse dynamic moments of the retained frames
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function inverseDynamicsMoments = inverseDynamicsWithRetainedKinematics( ...
+    jointAccelerations, appliedLoads, version, contactSurfaces)
+assert(getNativeMexInterfaceVersion(version) >= 4, "Retained " + ...
+    "kinematics require MEX functions compiled from the current sources.")
+mexArguments = {jointAccelerations, appliedLoads};
+if nargin > 3 && ~isempty(contactSurfaces)
+    mexArguments{end + 1} = contactSurfaces;
+end
+inverseDynamicsMoments = feval(getInverseDynamicsMexName(version), ...
+    'retainedInverseDynamics', mexArguments{:});
+end
@@ -0,0 +1,50 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function loads a model into new sessions of the native inverse
+% dynamics and point kinematics MEX functions and returns their handles.
+% Sessions stay loaded side by side, so code that switches between models
+% passes a session to callNativeModelSession instead of loading the model
+% again. Models loaded with initializeMexOrMatlabParallelFunctions are not
+% affected. Free a session with releaseNativeModelSession.
+%
+% (string, double, double) -> (struct)
+% Returns the session handles of the native MEX functions
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function session = loadNativeModelSession(modelFile, version, numThreads)
+if nargin < 2
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 8, "Model sessions " + ...
+    "require MEX functions compiled from the current sources.")
+loadArguments = {'loadSession', char(modelFile)};
+if nargin > 2
+    loadArguments{end + 1} = numThreads;
+end
+session.version = version;
+session.inverseDynamics = feval(getInverseDynamicsMexName(version), ...
+    loadArguments{:});
+session.pointKinematics = feval(getPointKinematicsMexName(version), ...
+    loadArguments{:});
+end
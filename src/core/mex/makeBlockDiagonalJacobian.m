@@ -0,0 +1,40 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function assembles per-frame Jacobian blocks from
+% inverseDynamicsJacobian into a sparse block-diagonal matrix. Rows and
+% columns follow MATLAB's column-major order of the (frames x columns)
+% output and input matrices, so J * input(:) matches output(:) for a
+% linear change of input.
+%
+% (3D matrix) -> (sparse matrix)
+% Returns the block-diagonal Jacobian of all frames
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function jacobian = makeBlockDiagonalJacobian(blocks)
+[numRows, numColumns, numFrames] = size(blocks);
+[row, column, frame] = ndgrid(1:numRows, 1:numColumns, 1:numFrames);
+jacobian = sparse(frame(:) + numFrames * (row(:) - 1), ...
+    frame(:) + numFrames * (column(:) - 1), blocks(:), ...
+    numFrames * numRows, numFrames * numColumns);
+end
@@ -42,6 +42,10 @@ if isequal(mexext, 'mexw64')
             pointKinematicsMexWindows40400(time, jointAngles, ...
             jointVelocities, pointLocationOnBody', body, coordinateLabels);
     end
+elseif hasNativeMexFunctions(version)
+    [pointPositions, pointVelocities] = feval( ...
+        "pointKinematicsMexLinux" + version, time, jointAngles, ...
+        jointVelocities, pointLocationOnBody', body, coordinateLabels);
 else
     [pointPositions, pointVelocities] = pointKinematicsMatlabParallel(time, ...
         jointAngles, jointVelocities, pointLocationOnBody, body, modelName, ...
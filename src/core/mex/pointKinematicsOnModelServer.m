@@ -0,0 +1,41 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function calculates the positions and velocities of points on
+% bodies on a local model server connected with connectNativeModelServer.
+% The inputs are those of pointKinematics, with one row of
+% pointLocationOnBody and one zero-based body set index per point.
+%
+% (struct, Array of double, 2D matrix, 2D matrix, 2D matrix, Array of
+% double, Cell) -> (3D matrix, 3D matrix)
+% Returns frames x 3 x points positions and velocities
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [pointPositions, pointVelocities] = ...
+    pointKinematicsOnModelServer(server, time, jointAngles, ...
+    jointVelocities, pointLocationOnBody, body, coordinateLabels)
+[pointPositions, pointVelocities] = feval(getPointKinematicsMexName( ...
+    server.version), 'serverPointKinematics', server.pointKinematics, ...
+    time, jointAngles, jointVelocities, pointLocationOnBody', ...
+    double(body), coordinateLabels);
+end
@@ -0,0 +1,40 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function releases the model of a connectNativeModelServer struct on
+% the server and disconnects the native MEX functions. The server frees
+% the model when no process uses it.
+%
+% (struct) -> (None)
+% Releases a model on the local model server
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function releaseNativeModelServer(server)
+mexNames = [getInverseDynamicsMexName(server.version), ...
+    getPointKinematicsMexName(server.version)];
+handles = [server.inverseDynamics, server.pointKinematics];
+for i = 1 : 2
+    feval(mexNames(i), 'serverRelease', handles(i));
+    feval(mexNames(i), 'disconnectServer');
+end
+end
@@ -0,0 +1,43 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function sets the joint angles and velocities of every frame in the
+% native inverse dynamics MEX function and keeps the frame states realized
+% to velocity. inverseDynamicsWithRetainedKinematics then solves those
+% frames for new joint accelerations and applied loads without repeating
+% the position and velocity kinematics, which suits finite differences and
+% design variables that only change controls or accelerations. The frames
+% are kept until this function is called again,
+% releaseInverseDynamicsKinematics is called or a model is loaded.
+%
+% (Array of number, 2D matrix, 2D matrix, Cell, double) -> (None)
+% Keeps the realized frame states in the inverse dynamics MEX function
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function retainInverseDynamicsKinematics(time, jointAngles, ...
+    jointVelocities, coordinateLabels, version)
+assert(getNativeMexInterfaceVersion(version) >= 4, "Retained " + ...
+    "kinematics require MEX functions compiled from the current sources.")
+feval(getInverseDynamicsMexName(version), 'retainFrameKinematics', ...
+    time, jointAngles, jointVelocities, coordinateLabels);
+end
@@ -0,0 +1,422 @@
+// This function is part of the NMSM Pipeline, see file for full license.
+//
+// Local model server. It owns the model sessions and one OpenMP thread
+// team for every MATLAB process on the machine that connects to it, so
+// concurrent personalizations share the replicas of a model and do not
+// oversubscribe the cores with separate pools. Requests from all clients
+// run one at a time in the order they were submitted, each on all of the
+// server's threads, with frames handed out in chunks as threads finish.
+// Clients that load the same model file share its session.
+//
+// nmsmModelServer [--name default] [--threads N] [--memory-budget bytes]
+//     [--pin-threads 0|1]
+
+// ----------------------------------------------------------------------- //
+// The NMSM Pipeline is a toolkit for model personalization and treatment  //
+// optimization of neuromusculoskeletal models through OpenSim. See        //
+// nmsm.rice.edu and the NOTICE file for more information. The             //
+// NMSM Pipeline is developed at Rice University and supported by the US   //
+// National Institutes of Health (R01 EB030520).                           //
+//                                                                         //
+// Copyright (c) 2021 Rice University and the Authors                      //
+// Author(s): Spencer Williams                                             //
+//                                                                         //
+// Licensed under the Apache License, Version 2.0 (the "License");         //
+// you may not use this file except in compliance with the License.        //
+// You may obtain a copy of the License at                                 //
+// http://www.apache.org/licenses/LICENSE-2.0.                             //
+//                                                                         //
+// Unless required by applicable law or agreed to in writing, software     //
+// distributed under the License is distributed on an "AS IS" BASIS,       //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         //
+// implied. See the License for the specific language governing            //
+// permissions and limitations under the License.                          //
+// ----------------------------------------------------------------------- //
+
+#include <OpenSim/OpenSim.h>
+#include <omp.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../ModelServerProtocol.h"
+#include "../ModelSession.h"
+#include "../ModelSessionRegistry.h"
+#include "../SharedMemory.h"
+
+struct ModelServerOptions {
+    std::string name = "default";
+    int numThreads = 0;
+    std::size_t memoryBudget = 0;
+    bool pinThreads = false;
+};
+
+static volatile std::sig_atomic_t isStopRequested = 0;
+
+// Identifies a model file by its path, size and the time it was last
+// written, so clients share a model only while its file is unchanged
+std::string getModelFileKey(const std::string& modelFile) {
+    struct stat status;
+    if (stat(modelFile.c_str(), &status) != 0) {
+        throw std::runtime_error("The model file " + modelFile +
+            " cannot be read.");
+    }
+    return modelFile + "\n" + std::to_string((long long) status.st_mtime) +
+        "\n" + std::to_string((long long) status.st_size);
+}
+
+extern "C" void requestStop(int) {
+    isStopRequested = 1;
+}
+
+ModelServerOptions parseOptions(int argc, char* argv[]) {
+    ModelServerOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Option " + option + " needs a value.");
+        }
+        const std::string value = argv[++i];
+        if (option == "--name") {
+            options.name = value;
+        } else if (option == "--threads") {
+            options.numThreads = std::atoi(value.c_str());
+        } else if (option == "--memory-budget") {
+            options.memoryBudget = (std::size_t) std::atof(value.c_str());
+        } else if (option == "--pin-threads") {
+            options.pinThreads = std::atoi(value.c_str()) != 0;
+        } else {
+            throw std::runtime_error("Unknown option " + option + ".");
+        }
+    }
+    if (options.numThreads <= 0) {
+        options.numThreads = omp_get_max_threads();
+    }
+    return options;
+}
+
+// Sessions by model file, each counting the clients that loaded it
+class ModelServer {
+public:
+    explicit ModelServer(const ModelServerOptions& options)
+        : options(options) {
+        registry.setMemoryBudget(options.memoryBudget);
+    }
+
+    // Runs the request named by the slot and writes its outputs or error
+    // into the client's payload
+    void serve(const ModelServerSlot& slot) {
+        const int client = slot.clientProcess.load(std::memory_order_acquire);
+        const std::string payloadName(slot.payloadName,
+            strnlen(slot.payloadName, sizeof(slot.payloadName)));
+        SharedMemorySegment payload;
+        try {
+            payload.open(payloadName, (std::size_t) slot.payloadSize);
+        }
+        catch (const std::exception& ex) {
+            std::cerr << ex.what() << std::endl;
+            return;
+        }
+        ModelServerPayloadHeader& header =
+            *(ModelServerPayloadHeader*) payload.getData();
+        ModelServerPayloadReader reader(payload.getData(), payload.getSize());
+        std::string error;
+        try {
+            switch (slot.kind) {
+            case requestLoadModel:
+                load(reader, client);
+                break;
+            case requestReleaseModel:
+                release(reader, client);
+                break;
+            case requestInverseDynamics:
+                calcInverseDynamics(reader);
+                break;
+            case requestPointKinematics:
+                calcPointKinematics(reader);
+                break;
+            default:
+                throw std::runtime_error("Unknown model server request.");
+            }
+        }
+        catch (const std::exception& ex) {
+            error = ex.what();
+            if (error.empty()) {
+                error = "The model server request failed.";
+            }
+        }
+        std::strncpy(header.error, error.c_str(), sizeof(header.error) - 1);
+        header.error[sizeof(header.error) - 1] = '\0';
+        header.status = error.empty() ? 0 : 1;
+    }
+
+    // Releases the models loaded by clients that exited without releasing
+    // them, and frees the models no running client has loaded
+    void releaseExitedClients() {
+        for (auto served = handles.begin(); served != handles.end();) {
+            std::map<int, int>& clients = served->second.clients;
+            for (auto client = clients.begin(); client != clients.end();) {
+                if (isProcessRunning(client->first)) {
+                    ++client;
+                } else {
+                    client = clients.erase(client);
+                }
+            }
+            if (clients.empty()) {
+                served = releaseServedModel(served);
+            } else {
+                ++served;
+            }
+        }
+    }
+
+private:
+    struct ServedModel {
+        int handle;
+        std::string modelFile;
+        // Loads not yet released by each client process
+        std::map<int, int> clients;
+    };
+    typedef std::map<std::string, ServedModel>::iterator ServedIterator;
+
+    ServedIterator releaseServedModel(ServedIterator served) {
+        registry.release(served->second.handle);
+        std::cout << "Released " << served->second.modelFile << std::endl;
+        return handles.erase(served);
+    }
+
+    void load(ModelServerPayloadReader& reader, int client) {
+        ModelServerLoadRequest request;
+        transferModelServerRequest(reader, request);
+        const std::string key = getModelFileKey(request.modelFile);
+        auto served = handles.find(key);
+        if (served == handles.end()) {
+            const int handle = registry.load(request.modelFile,
+                options.numThreads);
+            // Requests of other clients wait for each call, so threads that
+            // finish early take chunks of the slower frames
+            FrameScheduleOptions schedule;
+            schedule.kind = frameScheduleDynamic;
+            schedule.pinThreads = options.pinThreads;
+            registry.get(handle).getPool().setScheduleOptions(schedule);
+            served = handles.emplace(key, ServedModel{handle,
+                request.modelFile, std::map<int, int>()}).first;
+            std::cout << "Loaded " << request.modelFile << std::endl;
+        }
+        served->second.clients[client]++;
+        ModelSession& session = registry.get(served->second.handle);
+        request.result[0] = served->second.handle;
+        request.result[1] = session.getPool().getBase().state->getNQ();
+    }
+
+    void release(ModelServerPayloadReader& reader, int client) {
+        ModelServerReleaseRequest request;
+        transferModelServerRequest(reader, request);
+        for (auto served = handles.begin(); served != handles.end();
+                ++served) {
+            if (served->second.handle != request.handle) {
+                continue;
+            }
+            std::map<int, int>& clients = served->second.clients;
+            auto loads = clients.find(client);
+            if (loads == clients.end()) {
+                throw std::runtime_error("This process has not loaded "
+                    "model " + std::to_string(request.handle) + ".");
+            }
+            if (--loads->second == 0) {
+                clients.erase(loads);
+            }
+            if (clients.empty()) {
+                releaseServedModel(served);
+            }
+            return;
+        }
+        throw std::runtime_error("The model server has no model " +
+            std::to_string(request.handle) + ".");
+    }
+
+    void calcInverseDynamics(ModelServerPayloadReader& reader) {
+        ModelServerInverseDynamicsRequest request;
+        transferModelServerRequest(reader, request);
+        ModelSession& session = registry.get(request.handle);
+        const CoordinateBinding& binding =
+            session.bindCoordinates(request.labels);
+        if (request.numCoordinates != binding.numStateCoordinates) {
+            throw std::runtime_error("The request expects a different "
+                "number of model coordinates.");
+        }
+        const int numPts = request.numPts;
+        const int numLabels = (int) request.labels.size();
+        InverseDynamicsInputs inputs;
+        inputs.time = request.time;
+        inputs.q = MatrixView(request.q, numPts, numLabels);
+        inputs.qp = MatrixView(request.qp, numPts, numLabels);
+        inputs.qpp = MatrixView(request.qpp, numPts, numLabels);
+        inputs.controls = MatrixView(request.controls, numPts,
+            request.numControls);
+        InverseDynamicsOutputs outputs;
+        outputs.idLoads = OutputMatrixView(request.idLoads, numPts,
+            request.numCoordinates);
+        session.calcInverseDynamics(inputs, outputs);
+    }
+
+    void calcPointKinematics(ModelServerPayloadReader& reader) {
+        ModelServerPointKinematicsRequest request;
+        transferModelServerRequest(reader, request);
+        ModelSession& session = registry.get(request.handle);
+        session.bindCoordinates(request.labels);
+        const int numPts = request.numPts;
+        const int numLabels = (int) request.labels.size();
+        PointKinematicsInputs inputs;
+        inputs.time = request.time;
+        inputs.q = MatrixView(request.q, numPts, numLabels);
+        inputs.qp = MatrixView(request.qp, numPts, numLabels);
+        for (int j = 0; j < request.numPoints; j++) {
+            inputs.bodies.push_back(session.getBody((int) request.bodies[j],
+                "Point kinematics"));
+            inputs.stations.push_back(SimTK::Vec3(request.stations[3 * j],
+                request.stations[3 * j + 1], request.stations[3 * j + 2]));
+        }
+        PointKinematicsOutputs outputs;
+        outputs.positions = OutputMatrixView(request.positions, numPts,
+            3 * request.numPoints);
+        outputs.velocities = OutputMatrixView(request.velocities, numPts,
+            3 * request.numPoints);
+        session.calcPointKinematics(inputs, outputs);
+    }
+
+    ModelServerOptions options;
+    ModelSessionRegistry registry;
+    // By model file key
+    std::map<std::string, ServedModel> handles;
+};
+
+// The ready slot with the lowest ticket, or null
+ModelServerSlot* findNextRequest(ModelServerControl& control) {
+    ModelServerSlot* next = nullptr;
+    for (ModelServerSlot& slot : control.slots) {
+        if (slot.state.load(std::memory_order_acquire) == slotReady &&
+                (next == nullptr || slot.ticket < next->ticket)) {
+            next = &slot;
+        }
+    }
+    return next;
+}
+
+// Frees the slots of clients that exited while filling a request or
+// before collecting their outputs. A claimed slot whose owner is not
+// recorded yet is left to its client.
+void freeAbandonedSlots(ModelServerControl& control) {
+    for (ModelServerSlot& slot : control.slots) {
+        int state = slot.state.load(std::memory_order_acquire);
+        if (state != slotClaimed && state != slotReady && state != slotDone) {
+            continue;
+        }
+        const int client = slot.clientProcess.load(std::memory_order_acquire);
+        if (client == 0 || isProcessRunning(client)) {
+            continue;
+        }
+        slot.clientProcess.store(0, std::memory_order_relaxed);
+        // Unless the slot changed state since it was read
+        slot.state.compare_exchange_strong(state, slotFree,
+            std::memory_order_release);
+    }
+}
+
+// Throws if a server of the same name is running. A control segment left by
+// a server that exited is replaced.
+void checkNoRunningServer(const std::string& name) {
+    SharedMemorySegment existing;
+    try {
+        existing.open(getModelServerControlName(name),
+            sizeof(ModelServerControl));
+    }
+    catch (const std::exception&) {
+        return;
+    }
+    const ModelServerControl& control =
+        *(const ModelServerControl*) existing.getData();
+    if (control.magic == modelServerMagic &&
+            isProcessRunning(control.serverProcess)) {
+        throw std::runtime_error("A model server named " + name +
+            " is already running.");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        const ModelServerOptions options = parseOptions(argc, argv);
+        OpenSim::Logger::setLevel(OpenSim::Logger::Level::Warn);
+        checkNoRunningServer(options.name);
+        SharedMemorySegment controlSegment;
+        controlSegment.create(getModelServerControlName(options.name),
+            sizeof(ModelServerControl));
+        ModelServerControl& control =
+            *new (controlSegment.getData()) ModelServerControl();
+        control.protocol = modelServerProtocol;
+        control.serverProcess = getCurrentProcessNumber();
+        control.numThreads = options.numThreads;
+        for (ModelServerSlot& slot : control.slots) {
+            slot.state.store(slotFree);
+        }
+        // Clients check the protocol after the magic, so it is set last
+        std::atomic_thread_fence(std::memory_order_release);
+        control.magic = modelServerMagic;
+
+        std::signal(SIGINT, requestStop);
+        std::signal(SIGTERM, requestStop);
+        std::atomic<bool> isRunning(true);
+        std::thread heartbeat([&]() {
+            while (isRunning.load()) {
+                control.heartbeat.fetch_add(1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        });
+        std::cout << "NMSM model server " << options.name << " running "
+            "with " << options.numThreads << " threads" << std::endl;
+
+        ModelServer server(options);
+        auto lastCleanup = std::chrono::steady_clock::now();
+        int idlePolls = 0;
+        while (!isStopRequested) {
+            ModelServerSlot* slot = findNextRequest(control);
+            if (slot == nullptr) {
+                // Poll quickly right after a request and back off to 1 ms
+                idlePolls++;
+                if (idlePolls > 1000) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                } else {
+                    std::this_thread::yield();
+                }
+                const auto now = std::chrono::steady_clock::now();
+                if (now - lastCleanup > std::chrono::seconds(1)) {
+                    freeAbandonedSlots(control);
+                    server.releaseExitedClients();
+                    lastCleanup = now;
+                }
+                continue;
+            }
+            idlePolls = 0;
+            slot->state.store(slotRunning, std::memory_order_release);
+            server.serve(*slot);
+            slot->state.store(slotDone, std::memory_order_release);
+        }
+        isRunning.store(false);
+        heartbeat.join();
+        control.magic = 0;
+        return 0;
+    }
+    catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+}
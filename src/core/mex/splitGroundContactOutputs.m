@@ -0,0 +1,43 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function splits the ground reaction forces, moments and midfoot
+% superior positions of the native ground contact inverse dynamics call,
+% which hold three columns per contact surface, into one cell per surface.
+%
+% (2D matrix, 2D matrix, 2D matrix, double) -> (struct, Cell)
+% Returns the ground reactions and midfoot positions of each surface
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function [groundReactionsLab, midfootSuperior] = ...
+    splitGroundContactOutputs(forces, moments, ...
+    midfootSuperiorPositions, numSurfaces)
+groundReactionsLab = [];
+midfootSuperior = cell(1, numSurfaces);
+for i = 1:numSurfaces
+    columns = 3 * i - 2 : 3 * i;
+    groundReactionsLab.forces{i} = forces(:, columns);
+    groundReactionsLab.moments{i} = moments(:, columns);
+    midfootSuperior{i} = midfootSuperiorPositions(:, columns);
+end
+end
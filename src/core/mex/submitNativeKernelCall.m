@@ -0,0 +1,55 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function submits a call of the native inverse dynamics or point
+% kinematics MEX function and returns at once with a ticket, while the
+% call runs on a worker thread of its model session. The kernel is
+% "inverseDynamics" or "pointKinematics", and the arguments are those of a
+% kernel call to the MEX function, optionally starting with 'session' and
+% a handle from loadNativeModelSession. Calls submitted to a session run
+% one after another in the order they were submitted, and calls to
+% different sessions run at the same time. Collect the outputs with
+% waitNativeKernelCall. Other calls to the session wait for its submitted
+% calls to finish.
+%
+% (string, double, ...) -> (struct)
+% Returns a ticket for the outputs of a submitted native kernel call
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function ticket = submitNativeKernelCall(kernel, version, varargin)
+assert(getNativeMexInterfaceVersion(version) >= 11, "Submitted " + ...
+    "calls require MEX functions compiled from the current sources.")
+if kernel == "inverseDynamics"
+    ticket.mexName = getInverseDynamicsMexName(version);
+elseif kernel == "pointKinematics"
+    ticket.mexName = getPointKinematicsMexName(version);
+else
+    error("Native kernel must be inverseDynamics or pointKinematics.")
+end
+if ~isempty(varargin) && isequal(varargin{1}, 'session')
+    ticket.ticket = feval(ticket.mexName, varargin{1:2}, 'submit', ...
+        varargin{3:end});
+else
+    ticket.ticket = feval(ticket.mexName, 'submit', varargin{:});
+end
+end
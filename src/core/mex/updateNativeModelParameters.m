@@ -0,0 +1,60 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function changes properties of the model loaded in the native
+% inverse dynamics and point kinematics MEX functions without writing and
+% loading a model file. updates is a struct array with the fields
+% component, a component path such as "/forceset/soleus_r" or
+% "/bodyset/pelvis", property, the name of a double or Vec3 property such
+% as "tendon_slack_length" or "mass", and values, with three values per
+% Vec3 element. Every model copy is updated and rebuilt without parsing.
+% The updates apply to a session from loadNativeModelSession if one is
+% given and to the model loaded with initializeMexOrMatlabParallelFunctions
+% otherwise. Ground contact spring parameters are arguments of each
+% contact call and need no update.
+%
+% (struct array, double, struct) -> (None)
+% Updates the parameters of the models of the native MEX functions
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function updateNativeModelParameters(updates, version, session)
+if nargin < 2
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 9, "Parameter " + ...
+    "updates require MEX functions compiled from the current sources.")
+for i = 1 : numel(updates)
+    updates(i).component = char(updates(i).component);
+    updates(i).property = char(updates(i).property);
+    updates(i).values = double(updates(i).values);
+end
+if nargin > 2
+    callNativeModelSession(session, "inverseDynamics", ...
+        'updateParameters', updates);
+    callNativeModelSession(session, "pointKinematics", ...
+        'updateParameters', updates);
+else
+    feval(getInverseDynamicsMexName(version), 'updateParameters', updates);
+    feval(getPointKinematicsMexName(version), 'updateParameters', updates);
+end
+end
@@ -0,0 +1,44 @@
+% This function is part of the NMSM Pipeline, see file for full license.
+%
+% This function writes the stages recorded with tracing enabled in
+% configureNativeProfiler as Chrome trace JSON files, which can be opened
+% in chrome://tracing or Perfetto. The inverse dynamics and point
+% kinematics traces are written to inverseDynamicsTrace.json and
+% pointKinematicsTrace.json in the directory.
+%
+% (string, double) -> (None)
+% Writes the native MEX profiler traces
+
+% ----------------------------------------------------------------------- %
+% The NMSM Pipeline is a toolkit for model personalization and treatment  %
+% optimization of neuromusculoskeletal models through OpenSim. See        %
+% nmsm.rice.edu and the NOTICE file for more information. The             %
+% NMSM Pipeline is developed at Rice University and supported by the US   %
+% National Institutes of Health (R01 EB030520).                           %
+%                                                                         %
+% Copyright (c) 2021 Rice University and the Authors                      %
+% Author(s): Spencer Williams                                             %
+%                                                                         %
+% Licensed under the Apache License, Version 2.0 (the "License");         %
+% you may not use this file except in compliance with the License.        %
+% You may obtain a copy of the License at                                 %
+% http://www.apache.org/licenses/LICENSE-2.0.                             %
+%                                                                         %
+% Unless required by applicable law or agreed to in writing, software     %
+% distributed under the License is distributed on an "AS IS" BASIS,       %
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or         %
+% implied. See the License for the specific language governing            %
+% permissions and limitations under the License.                          %
+% ----------------------------------------------------------------------- %
+
+function writeNativeProfileTrace(directory, version)
+if nargin < 2
+    version = getOpenSimVersion();
+end
+assert(getNativeMexInterfaceVersion(version) >= 5, "Profiling " + ...
+    "requires MEX functions compiled from the current sources.")
+feval(getInverseDynamicsMexName(version), 'writeProfileTrace', ...
+    char(fullfile(directory, "inverseDynamicsTrace.json")));
+feval(getPointKinematicsMexName(version), 'writeProfileTrace', ...
+    char(fullfile(directory, "pointKinematicsTrace.json")));
+end
@@ -39,7 +39,7 @@ inputs.costTerms = parseRcnlCostTermSetHelper( ...
     getFieldByNameOrError(tree, 'RCNLCostTermSet'));
 inputs.costTerms = splitListTerms(inputs.costTerms);
 inputs.costTerms = splitAxesTerms(inputs.costTerms);
-if isequal(mexext, 'mexw64') 
+if hasNativeMexFunctions()
     inputs.calculateAngularMomentum = any(all([ ...
         strcmp(cellfun(@(term) term.type, inputs.costTerms, ...
         'UniformOutput', false), {'angular_momentum_minimization'}) ...
@@ -72,6 +72,9 @@ if isequal(mexext, 'mexw64')
         cell2mat(cellfun(@(term) term.isEnabled, inputs.costTerms, ...
         'UniformOutput', false)) ...
         ], 1));
+    inputs.useBodyForceInverseDynamics = getBooleanLogicFromField( ...
+        getFieldByNameOrAlternate(tree, ...
+        'use_body_force_inverse_dynamics', false));
 end
 [inputs.path, inputs.terminal] = parseRcnlConstraintTermSetHelper( ...
     getFieldByNameOrError(tree, 'RCNLConstraintTermSet'), ...